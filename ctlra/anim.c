@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "impl.h"
+#include "anim.h"
+
+struct light_anim_t {
+	uint32_t light_id;
+	uint64_t start_ns;
+	/* light id of the chase that was lit on the last tick */
+	uint32_t last_chase;
+	struct ctlra_light_anim_t anim;
+};
+
+struct ctlra_light_anims_t {
+	uint32_t count;
+	struct light_anim_t anims[CTLRA_LIGHT_ANIMS_MAX];
+};
+
+/* Interpolates each byte of the light_status, *pos* is 0 to 256 */
+static inline uint32_t
+light_status_lerp(uint32_t from, uint32_t to, uint32_t pos)
+{
+	uint32_t out = 0;
+	for(int shift = 0; shift < 32; shift += 8) {
+		int32_t a = (from >> shift) & 0xff;
+		int32_t b = (to   >> shift) & 0xff;
+		uint32_t v = a + (((b - a) * (int32_t)pos) >> 8);
+		out |= (v & 0xff) << shift;
+	}
+	return out;
+}
+
+/* Returns 1 while the animation is running, 0 once it completed. The
+ * final state is written to the lights before returning 0 */
+static int
+light_anim_eval(struct ctlra_dev_t *dev, struct light_anim_t *a,
+		uint64_t now_ns)
+{
+	const struct ctlra_light_anim_t *anim = &a->anim;
+	uint64_t period = anim->period_ms * 1000000ull;
+	uint64_t t = now_ns - a->start_ns;
+	uint64_t cycle = t / period;
+	uint64_t phase = t % period;
+
+	if(anim->type == CTLRA_LIGHT_ANIM_FADE) {
+		if(t >= period) {
+			dev->light_set(dev, a->light_id, anim->to);
+			return 0;
+		}
+		dev->light_set(dev, a->light_id,
+			       light_status_lerp(anim->from, anim->to,
+						 (phase << 8) / period));
+		return 1;
+	}
+
+	uint32_t length = anim->length ? anim->length : 1;
+	uint64_t cycles = anim->type == CTLRA_LIGHT_ANIM_CHASE ?
+			  cycle / length : cycle;
+	int done = anim->repeats && cycles >= anim->repeats;
+
+	switch(anim->type) {
+	case CTLRA_LIGHT_ANIM_BLINK:
+		dev->light_set(dev, a->light_id, done || phase >= period / 2 ?
+			       anim->from : anim->to);
+		break;
+	case CTLRA_LIGHT_ANIM_PULSE: {
+		/* triangle: from -> to -> from over one period */
+		uint64_t half = period / 2 ? period / 2 : 1;
+		uint64_t pos = phase < half ? phase : period - phase;
+		pos = pos > half ? half : pos;
+		dev->light_set(dev, a->light_id, done ? anim->from :
+			       light_status_lerp(anim->from, anim->to,
+						 (pos << 8) / half));
+		} break;
+	case CTLRA_LIGHT_ANIM_CHASE: {
+		/* one light of the run is lit, stepping once per period */
+		uint32_t lit = a->light_id + (cycle % length);
+		if(done) {
+			for(uint32_t i = 0; i < length; i++)
+				dev->light_set(dev, a->light_id + i,
+					       anim->from);
+		} else if(lit != a->last_chase) {
+			if(a->last_chase != UINT32_MAX)
+				dev->light_set(dev, a->last_chase,
+					       anim->from);
+			dev->light_set(dev, lit, anim->to);
+			a->last_chase = lit;
+		}
+		} break;
+	default:
+		return 0;
+	}
+	return !done;
+}
+
+int32_t ctlra_dev_light_animate(struct ctlra_dev_t *dev,
+				uint32_t light_id,
+				const struct ctlra_light_anim_t *anim)
+{
+	if(!dev || !dev->light_set)
+		return -ENOTSUP;
+
+	if(anim && (anim->type < CTLRA_LIGHT_ANIM_BLINK ||
+		    anim->type > CTLRA_LIGHT_ANIM_CHASE ||
+		    anim->period_ms == 0))
+		return -EINVAL;
+
+	struct ctlra_light_anims_t *anims = dev->light_anims;
+	if(!anims) {
+		if(!anim)
+			return 0;
+		anims = calloc(1, sizeof(*anims));
+		if(!anims)
+			return -ENOMEM;
+		dev->light_anims = anims;
+	}
+
+	/* replace or stop an existing animation on this light */
+	struct light_anim_t *a = 0;
+	for(uint32_t i = 0; i < anims->count; i++) {
+		if(anims->anims[i].light_id == light_id) {
+			a = &anims->anims[i];
+			break;
+		}
+	}
+
+	if(!anim) {
+		if(a)
+			*a = anims->anims[--anims->count];
+		return 0;
+	}
+
+	if(!a) {
+		if(anims->count == CTLRA_LIGHT_ANIMS_MAX)
+			return -ENOSPC;
+		a = &anims->anims[anims->count++];
+	}
+
+	a->light_id = light_id;
+	a->start_ns = ctlra_impl_time_ns();
+	a->last_chase = UINT32_MAX;
+	a->anim = *anim;
+	return 0;
+}
+
+int ctlra_impl_light_anim_tick(struct ctlra_dev_t *dev, uint64_t now_ns)
+{
+	struct ctlra_light_anims_t *anims = dev->light_anims;
+	if(!anims || !anims->count)
+		return 0;
+
+	for(uint32_t i = 0; i < anims->count; ) {
+		if(light_anim_eval(dev, &anims->anims[i], now_ns))
+			i++;
+		else
+			anims->anims[i] = anims->anims[--anims->count];
+	}
+	return 1;
+}
+
+void ctlra_impl_light_anim_free(struct ctlra_dev_t *dev)
+{
+	free(dev->light_anims);
+	dev->light_anims = 0;
+}
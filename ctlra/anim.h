@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CTLRA_ANIM_H
+#define CTLRA_ANIM_H
+
+#include <stdint.h>
+
+struct ctlra_dev_t;
+
+/* LED animations run inside Ctlra, see ctlra_dev_light_animate(). They
+ * are evaluated at a fixed tick from ctlra_idle_iter(), written to the
+ * driver with light_set(), and flushed without force, so only LED
+ * reports that changed are sent to the device. Level meters (meter.h)
+ * are rendered on the same tick.
+ */
+#define CTLRA_LIGHT_ANIM_TICK_NS (10 * 1000 * 1000)
+#define CTLRA_LIGHT_ANIMS_MAX 64
+
+/* Evaluates the animations of *dev* at *now_ns*. Returns non-zero if
+ * any light was written */
+int ctlra_impl_light_anim_tick(struct ctlra_dev_t *dev, uint64_t now_ns);
+/* Frees the animation state of *dev*, called on disconnect */
+void ctlra_impl_light_anim_free(struct ctlra_dev_t *dev);
+
+#endif /* CTLRA_ANIM_H */
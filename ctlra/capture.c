@@ -0,0 +1,306 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "impl.h"
+#include "capture.h"
+
+/* The capture file is grown in chunks, so the mmap() only needs to be
+ * redone every few MB of traffic, not on every transfer */
+#define CAPTURE_CHUNK (4 * 1024 * 1024)
+
+/* From ctlra.c */
+extern int ctlra_impl_dev_get_by_vid_pid(struct ctlra_t *ctlra, int32_t vid,
+					 int32_t pid, struct ctlra_dev_t **out_dev);
+
+struct ctlra_capture_t {
+	struct ctlra_t *ctlra;
+	int fd;
+	uint8_t *map;
+	uint64_t capacity;
+	uint64_t used;
+	struct timespec start;
+};
+
+struct ctlra_replay_t {
+	struct ctlra_t *ctlra;
+	uint8_t *map;
+	uint64_t size;
+	uint64_t offset;
+	uint8_t fast;
+	uint8_t started;
+	struct timespec start;
+};
+
+static uint64_t
+ctlra_capture_impl_ns_since(const struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000000000ull +
+	       (now.tv_nsec - start->tv_nsec);
+}
+
+static int
+ctlra_capture_impl_grow(struct ctlra_capture_t *cap, uint64_t min_size)
+{
+	uint64_t capacity = cap->capacity;
+	while(capacity < min_size)
+		capacity += CAPTURE_CHUNK;
+
+	if(cap->map)
+		munmap(cap->map, cap->capacity);
+	cap->map = 0;
+
+	if(ftruncate(cap->fd, capacity))
+		return -1;
+	void *map = mmap(0, capacity, PROT_READ | PROT_WRITE, MAP_SHARED,
+			 cap->fd, 0);
+	if(map == MAP_FAILED)
+		return -1;
+
+	cap->map = map;
+	cap->capacity = capacity;
+	return 0;
+}
+
+struct ctlra_capture_t *
+ctlra_impl_capture_open(struct ctlra_t *ctlra, const char *path)
+{
+	struct ctlra_capture_t *cap = calloc(1, sizeof(*cap));
+	if(!cap)
+		return 0;
+
+	cap->ctlra = ctlra;
+	cap->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(cap->fd < 0) {
+		CTLRA_ERROR(ctlra, "capture open %s failed: %s\n", path,
+			    strerror(errno));
+		free(cap);
+		return 0;
+	}
+
+	if(ctlra_capture_impl_grow(cap, CAPTURE_CHUNK)) {
+		CTLRA_ERROR(ctlra, "capture mmap %s failed: %s\n", path,
+			    strerror(errno));
+		close(cap->fd);
+		free(cap);
+		return 0;
+	}
+
+	struct ctlra_capture_header_t hdr = {
+		.magic = CTLRA_CAPTURE_MAGIC,
+		.version = CTLRA_CAPTURE_VERSION,
+		.header_size = sizeof(hdr),
+	};
+	memcpy(cap->map, &hdr, sizeof(hdr));
+	cap->used = sizeof(hdr);
+
+	clock_gettime(CLOCK_MONOTONIC, &cap->start);
+	CTLRA_INFO(ctlra, "capturing USB reads to %s\n", path);
+
+	return cap;
+}
+
+void
+ctlra_impl_capture_append(struct ctlra_capture_t *cap,
+			  const struct ctlra_dev_t *dev,
+			  uint32_t endpoint, const uint8_t *data,
+			  uint32_t size)
+{
+	if(!cap->map)
+		return;
+
+	struct ctlra_capture_record_t rec = {
+		.time_ns = ctlra_capture_impl_ns_since(&cap->start),
+		.vendor_id = dev->info.vendor_id,
+		.device_id = dev->info.device_id,
+		.endpoint = endpoint,
+		.size = size,
+	};
+
+	uint64_t end = cap->used + sizeof(rec) + size;
+	if(end > cap->capacity && ctlra_capture_impl_grow(cap, end)) {
+		/* Disk full or similar: stop capturing, keep running */
+		CTLRA_ERROR(cap->ctlra, "capture grow failed: %s\n",
+			    strerror(errno));
+		return;
+	}
+
+	memcpy(&cap->map[cap->used], &rec, sizeof(rec));
+	memcpy(&cap->map[cap->used + sizeof(rec)], data, size);
+	cap->used = end;
+}
+
+void
+ctlra_impl_capture_close(struct ctlra_capture_t *cap)
+{
+	if(!cap)
+		return;
+	if(cap->map)
+		munmap(cap->map, cap->capacity);
+	/* remove the unused tail of the last chunk */
+	if(ftruncate(cap->fd, cap->used))
+		CTLRA_ERROR(cap->ctlra, "capture truncate failed: %s\n",
+			    strerror(errno));
+	close(cap->fd);
+	free(cap);
+}
+
+struct ctlra_replay_t *
+ctlra_impl_replay_open(struct ctlra_t *ctlra, const char *path, int fast)
+{
+	struct ctlra_capture_header_t hdr;
+	struct stat st;
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
+		CTLRA_ERROR(ctlra, "replay open %s failed: %s\n", path,
+			    strerror(errno));
+		return 0;
+	}
+	if(fstat(fd, &st) || st.st_size < sizeof(hdr)) {
+		CTLRA_ERROR(ctlra, "replay %s: file too small\n", path);
+		close(fd);
+		return 0;
+	}
+
+	/* private writable map: drivers may scribble on their read buffer */
+	void *map = mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+			 fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) {
+		CTLRA_ERROR(ctlra, "replay mmap %s failed: %s\n", path,
+			    strerror(errno));
+		return 0;
+	}
+
+	memcpy(&hdr, map, sizeof(hdr));
+	if(memcmp(hdr.magic, CTLRA_CAPTURE_MAGIC, sizeof(hdr.magic)) ||
+	   hdr.version != CTLRA_CAPTURE_VERSION ||
+	   hdr.header_size > st.st_size) {
+		CTLRA_ERROR(ctlra, "replay %s: not a v%d capture file\n",
+			    path, CTLRA_CAPTURE_VERSION);
+		munmap(map, st.st_size);
+		return 0;
+	}
+
+	struct ctlra_replay_t *replay = calloc(1, sizeof(*replay));
+	if(!replay) {
+		munmap(map, st.st_size);
+		return 0;
+	}
+
+	replay->ctlra = ctlra;
+	replay->map = map;
+	replay->size = st.st_size;
+	replay->offset = hdr.header_size;
+	replay->fast = fast;
+
+	CTLRA_INFO(ctlra, "replaying USB capture %s (%s)\n", path,
+		   fast ? "fast" : "original timing");
+
+	return replay;
+}
+
+int
+ctlra_impl_replay_has_device(struct ctlra_replay_t *replay, uint32_t vid,
+			     uint32_t pid)
+{
+	struct ctlra_capture_record_t rec;
+	uint64_t offset = replay->offset;
+
+	while(offset + sizeof(rec) <= replay->size) {
+		memcpy(&rec, &replay->map[offset], sizeof(rec));
+		if(rec.vendor_id == vid && rec.device_id == pid)
+			return 1;
+		offset += sizeof(rec) + rec.size;
+	}
+	return 0;
+}
+
+void
+ctlra_impl_replay_idle_iter(struct ctlra_t *ctlra)
+{
+	struct ctlra_replay_t *replay = ctlra->usb_replay;
+	struct ctlra_capture_record_t rec;
+
+	/* time starts at the first iteration, not at open: the app may
+	 * take a while between ctlra_create() and its idle loop */
+	if(!replay->started) {
+		clock_gettime(CLOCK_MONOTONIC, &replay->start);
+		replay->started = 1;
+	}
+	uint64_t now = ctlra_capture_impl_ns_since(&replay->start);
+
+	while(replay->offset + sizeof(rec) <= replay->size) {
+		memcpy(&rec, &replay->map[replay->offset], sizeof(rec));
+		if(replay->offset + sizeof(rec) + rec.size > replay->size) {
+			CTLRA_WARN(ctlra, "replay: truncated record at %lu\n",
+				   (unsigned long)replay->offset);
+			replay->offset = replay->size;
+			break;
+		}
+		if(!replay->fast && rec.time_ns > now)
+			break;
+
+		uint8_t *data = &replay->map[replay->offset + sizeof(rec)];
+		replay->offset += sizeof(rec) + rec.size;
+
+		/* Multiple devices with the same vid:pid are not told
+		 * apart: the first one gets the data, as in the probe */
+		struct ctlra_dev_t *dev;
+		ctlra_impl_dev_get_by_vid_pid(ctlra, rec.vendor_id,
+					      rec.device_id, &dev);
+		if(!dev || dev->banished || !dev->usb_read_cb)
+			continue;
+
+		dev->usb_read_cb(dev, rec.endpoint, data, rec.size);
+		dev->usb_xfer_counts[USB_XFER_INT_READ]++;
+	}
+}
+
+void
+ctlra_impl_replay_close(struct ctlra_replay_t *replay)
+{
+	if(!replay)
+		return;
+	munmap(replay->map, replay->size);
+	free(replay);
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CTLRA_CAPTURE_H
+#define CTLRA_CAPTURE_H
+
+#include <stdint.h>
+
+struct ctlra_t;
+struct ctlra_dev_t;
+struct ctlra_capture_t;
+struct ctlra_replay_t;
+
+/* Capture file layout, all fields in host byte order:
+ *  - struct ctlra_capture_header_t
+ *  - a sequence of struct ctlra_capture_record_t, each followed by
+ *    *size* bytes of transfer data. Records are not padded.
+ */
+#define CTLRA_CAPTURE_MAGIC   "CTLRACAP"
+#define CTLRA_CAPTURE_VERSION 1
+
+struct ctlra_capture_header_t {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+};
+
+struct ctlra_capture_record_t {
+	/* nanoseconds since the capture was started */
+	uint64_t time_ns;
+	uint16_t vendor_id;
+	uint16_t device_id;
+	uint8_t endpoint;
+	uint8_t reserved;
+	uint16_t size;
+};
+
+/* Opens *path* for capture, truncating it. Returns NULL on failure */
+struct ctlra_capture_t *ctlra_impl_capture_open(struct ctlra_t *ctlra,
+						const char *path);
+/* Appends a completed USB read transfer of *dev* to the capture */
+void ctlra_impl_capture_append(struct ctlra_capture_t *cap,
+			       const struct ctlra_dev_t *dev,
+			       uint32_t endpoint, const uint8_t *data,
+			       uint32_t size);
+/* Trims the file to the captured length, and closes it */
+void ctlra_impl_capture_close(struct ctlra_capture_t *cap);
+
+/* Opens a capture for replay. When *fast* is set, all records are
+ * replayed as quickly as possible, otherwise original timing is kept */
+struct ctlra_replay_t *ctlra_impl_replay_open(struct ctlra_t *ctlra,
+					      const char *path, int fast);
+/* Returns 1 if the capture contains transfers from vid:pid */
+int ctlra_impl_replay_has_device(struct ctlra_replay_t *replay,
+				 uint32_t vid, uint32_t pid);
+/* Feeds due records to the drivers' usb_read_cb */
+void ctlra_impl_replay_idle_iter(struct ctlra_t *ctlra);
+void ctlra_impl_replay_close(struct ctlra_replay_t *replay);
+
+#endif /* CTLRA_CAPTURE_H */
@@ -7,6 +7,24 @@
 
 #include "impl.h"
 #include "usb.h"
+#include "capture.h"
+#include "usb_mock.h"
+#include "anim.h"
+#include "meter.h"
+#include "pixel.h"
+#include "render.h"
+#include "text.h"
+#include "sprite.h"
+#include "share.h"
+#ifdef HAVE_EVDEV
+#include "evdev.h"
+#endif
+
+/* virtual device backends, see ctlra_dev_virtualize() */
+CTLRA_DEVICE_DECL(headless);
+#ifdef HAVE_AVTKA
+CTLRA_DEVICE_DECL(avtka);
+#endif
 
 #define CTLRA_MAX_DEVICES 64
 struct ctlra_dev_connect_func_t __ctlra_devices[CTLRA_MAX_DEVICES];
@@ -157,18 +175,25 @@ ctlra_dev_virtualize(struct ctlra_t *c, const char *vendor,
 		return -ENODEV;
 	}
 
+	/* AVTKA shows a UI, which is preferred when available. The
+	 * headless backend works anywhere, eg: CI or load testing */
+	ctlra_dev_connect_func connect = CTLRA_DEVICE_FUNC(headless);
+	const char *backend = "headless";
 #ifdef HAVE_AVTKA
-	/* TODO: find better solution to this hack */
-CTLRA_DEVICE_DECL(avtka);
+	if(!getenv("CTLRA_VIRTUAL_HEADLESS")) {
+		connect = CTLRA_DEVICE_FUNC(avtka);
+		backend = "avtka";
+	}
+#endif
 
-	/* call into AVTKA and virtualize the device, passing info through
-	 * the future (void *) to the AVTKA backend. */
-	CTLRA_INFO(c, "virtualizing dev '%s' '%s'\n",
-		   info->vendor, info->device);
-	struct ctlra_dev_t *dev = ctlra_dev_connect(c, ctlra_avtka_connect,
+	/* call into the backend and virtualize the device, passing info
+	 * through the future (void *) to the backend. */
+	CTLRA_INFO(c, "virtualizing dev '%s' '%s' with %s\n",
+		   info->vendor, info->device, backend);
+	struct ctlra_dev_t *dev = ctlra_dev_connect(c, connect,
 						    0x0, 0x0, info);
 	if(!dev) {
-		CTLRA_ERROR(c, "avtka dev returned %p\n", dev);
+		CTLRA_ERROR(c, "%s dev returned %p\n", backend, dev);
 		return -EINVAL;
 	}
 
@@ -185,10 +210,6 @@ CTLRA_DEVICE_DECL(avtka);
 		return -ECONNREFUSED;
 	}
 	return 0;
-#else
-	CTLRA_STRERROR(c, "No virtualized backends available\n");
-	return -ENOTSUP;
-#endif
 }
 
 uint32_t ctlra_dev_poll(struct ctlra_dev_t *dev)
@@ -247,10 +268,29 @@ int32_t ctlra_dev_disconnect(struct ctlra_dev_t *dev)
 	struct ctlra_dev_t *dev_iter = ctlra->dev_list;
 
 	if(dev && dev->disconnect) {
+		if(dev->usb_xfer_counts[USB_XFER_LIGHTS_SUPPRESSED])
+			CTLRA_INFO(ctlra, "%s %s: %u unchanged light writes "
+				   "suppressed\n", dev->info.vendor,
+				   dev->info.device,
+				   dev->usb_xfer_counts[USB_XFER_LIGHTS_SUPPRESSED]);
+		if(dev->mem_bytes)
+			CTLRA_INFO(ctlra, "%s %s: %u KB of driver memory\n",
+				   dev->info.vendor, dev->info.device,
+				   (dev->mem_bytes + 1023) / 1024);
+
+		ctlra_impl_light_anim_free(dev);
+		ctlra_impl_render_free(dev);
+		ctlra_impl_text_free(dev);
+		ctlra_impl_sprite_free(dev);
+		ctlra_impl_share_free(dev);
+
 		/* call the application remove_func() to inform app */
 		if(dev->remove_func)
 			dev->remove_func(dev, dev->banished,
 					 dev->event_func_userdata);
+		/* the application may set meter levels until it is told
+		 * the device is gone */
+		ctlra_impl_meter_free(dev);
 
 		if(dev_iter == dev) {
 			ctlra->dev_list = dev_iter->dev_list_next;
@@ -280,6 +320,69 @@ void ctlra_dev_light_set(struct ctlra_dev_t *dev, uint32_t light_id,
 		dev->light_set(dev, light_id, light_status);
 }
 
+void ctlra_dev_lights_set_frame(struct ctlra_dev_t *dev,
+				const uint32_t *ids,
+				const uint32_t *values,
+				uint32_t count)
+{
+	if(!dev || !ids || !values)
+		return;
+	if(dev->lights_set_frame) {
+		dev->lights_set_frame(dev, ids, values, count);
+		return;
+	}
+	if(dev->light_set)
+		for(uint32_t i = 0; i < count; i++)
+			dev->light_set(dev, ids[i], values[i]);
+}
+
+void ctlra_dev_lights_set_dense(struct ctlra_dev_t *dev,
+				const uint32_t *values,
+				uint32_t count)
+{
+	if(!dev || !values)
+		return;
+	if(dev->lights_set_frame) {
+		dev->lights_set_frame(dev, NULL, values, count);
+		return;
+	}
+	if(dev->light_set)
+		for(uint32_t i = 0; i < count; i++)
+			dev->light_set(dev, i, values[i]);
+}
+
+void ctlra_dev_light_set_rt(struct ctlra_dev_t *dev, uint32_t light_id,
+			    uint32_t light_status)
+{
+	if(!dev || light_id >= CTLRA_RT_LIGHTS_MAX)
+		return;
+	__atomic_store_n(&dev->rt_lights[light_id], light_status,
+			 __ATOMIC_RELAXED);
+	__atomic_fetch_or(&dev->rt_lights_dirty[light_id / 32],
+			  1u << (light_id % 32), __ATOMIC_RELEASE);
+}
+
+/* Applies lights written with ctlra_dev_light_set_rt() since the last
+ * tick. Returns non-zero if any light was written */
+static int
+ctlra_impl_lights_rt_apply(struct ctlra_dev_t *dev)
+{
+	int written = 0;
+	for(uint32_t w = 0; w < CTLRA_RT_LIGHTS_MAX / 32; w++) {
+		uint32_t dirty = __atomic_exchange_n(&dev->rt_lights_dirty[w],
+						     0, __ATOMIC_ACQUIRE);
+		while(dirty) {
+			uint32_t id = w * 32 + __builtin_ctz(dirty);
+			dirty &= dirty - 1;
+			dev->light_set(dev, id,
+				       __atomic_load_n(&dev->rt_lights[id],
+						       __ATOMIC_RELAXED));
+			written = 1;
+		}
+	}
+	return written;
+}
+
 void ctlra_dev_feedback_set(struct ctlra_dev_t *dev, uint32_t fb_id,
 			    float value)
 {
@@ -308,6 +411,51 @@ void ctlra_dev_grid_light_set(struct ctlra_dev_t *dev, uint32_t grid_id,
 		dev->grid_light_set(dev, grid_id, light_id, light_status);
 }
 
+int32_t ctlra_dev_grid_frame_set(struct ctlra_dev_t *dev,
+				 uint32_t grid_id,
+				 const uint32_t *rgb,
+				 uint32_t count)
+{
+	if(!dev || !rgb || grid_id >= CTLRA_NUM_GRIDS_MAX)
+		return -ENOTSUP;
+
+	if(dev->grid_frame_set)
+		return dev->grid_frame_set(dev, grid_id, rgb, count);
+
+	if(dev->grid_light_set) {
+		for(uint32_t i = 0; i < count; i++)
+			dev->grid_light_set(dev, grid_id, i, rgb[i]);
+		return 0;
+	}
+
+	/* fall back to the light ids the grid info advertises */
+	const struct ctlra_grid_info_t *grid = &dev->info.grid_info[grid_id];
+	uint32_t size = grid->x * grid->y;
+	if(!dev->light_set || grid->info.params[0] == 255 ||
+	   grid_id >= dev->info.control_count[CTLRA_EVENT_GRID])
+		return -ENOTSUP;
+
+	count = count > size ? size : count;
+	for(uint32_t i = 0; i < count; i++)
+		dev->light_set(dev, grid->info.params[0] + i, rgb[i]);
+	return 0;
+}
+
+int32_t ctlra_dev_grid_pressure_stream(struct ctlra_dev_t *dev,
+				       uint32_t grid_id,
+				       uint32_t max_rate_hz,
+				       float min_delta)
+{
+	if(!dev || grid_id >= CTLRA_NUM_GRIDS_MAX ||
+	   !(dev->grid_pressure_caps & (1 << grid_id)))
+		return -ENOTSUP;
+
+	dev->grid_pressure[grid_id].interval_ns = max_rate_hz ?
+		1000000000ull / max_rate_hz : 0;
+	dev->grid_pressure[grid_id].delta = min_delta < 0.f ? 0.f : min_delta;
+	return 0;
+}
+
 int32_t ctlra_screen_get_data(struct ctlra_dev_t *dev,
 				  uint32_t screen_idx,
 				  uint8_t **pixels,
@@ -331,6 +479,84 @@ int32_t ctlra_dev_screen_get_data(struct ctlra_dev_t *dev,
 	return ctlra_screen_get_data(dev, 0, pixels, bytes, &redraw, flush);
 }
 
+int32_t ctlra_dev_screen_dither(struct ctlra_dev_t *dev, uint32_t dither,
+				uint8_t threshold)
+{
+	if(!dev || dither > CTLRA_DITHER_FLOYD_STEINBERG)
+		return -EINVAL;
+	dev->screen_dither = dither;
+	dev->screen_threshold = threshold;
+	return 0;
+}
+
+const struct ctlra_item_info_t *
+ctlra_impl_screen_item(const struct ctlra_dev_t *dev, uint32_t screen_idx)
+{
+	const struct ctlra_dev_info_t *info = &dev->info;
+	const struct ctlra_item_info_t *items =
+		info->control_info[CTLRA_FEEDBACK_ITEM];
+	if(!items)
+		return 0;
+
+	for(uint32_t i = 0; i < info->control_count[CTLRA_FEEDBACK_ITEM]; i++) {
+		if(!(items[i].flags & CTLRA_ITEM_FB_SCREEN))
+			continue;
+		if(screen_idx-- == 0)
+			return &items[i];
+	}
+	return 0;
+}
+
+int32_t ctlra_screen_convert(struct ctlra_dev_t *dev,
+			     uint32_t screen_idx,
+			     uint8_t *pixel_data,
+			     uint32_t src_format,
+			     const uint8_t *src,
+			     uint32_t src_stride,
+			     const struct ctlra_screen_zone_t *zone)
+{
+	if(!dev || !pixel_data || !src)
+		return -ENOTSUP;
+
+	const struct ctlra_item_info_t *item =
+		ctlra_impl_screen_item(dev, screen_idx);
+	if(!item)
+		return -ENOTSUP;
+
+	const uint32_t w = item->params[0];
+	const uint32_t h = item->params[1];
+
+	if(item->params[3] == CTLRA_PIXEL_FORMAT_MONO1)
+		return ctlra_pixel_mono1_convert(pixel_data, w, h, src_format,
+						 src, src_stride,
+						 dev->screen_dither,
+						 dev->screen_threshold);
+	const uint32_t dst_bpp = ctlra_pixel_format_bpp(item->params[3]);
+	const uint32_t src_bpp = ctlra_pixel_format_bpp(src_format);
+	ctlra_pixel_row_func convert =
+		ctlra_pixel_kernel_get(src_format, item->params[3]);
+	/* sub-byte formats are packed by the driver, not per row */
+	if(!convert || dst_bpp % 8 || src_bpp % 8)
+		return -ENOTSUP;
+
+	struct ctlra_screen_zone_t z = {0, 0, w, h};
+	if(zone) {
+		if(zone->x >= w || zone->y >= h)
+			return 0;
+		z = *zone;
+		if(z.w > w - z.x)
+			z.w = w - z.x;
+		if(z.h > h - z.y)
+			z.h = h - z.y;
+	}
+
+	for(uint32_t y = z.y; y < z.y + z.h; y++)
+		convert(&pixel_data[(y * w + z.x) * dst_bpp / 8],
+			&src[y * src_stride + z.x * src_bpp / 8], z.w);
+
+	return 0;
+}
+
 void ctlra_dev_get_info(const struct ctlra_dev_t *dev,
 		       struct ctlra_dev_info_t * info)
 {
@@ -379,11 +605,27 @@ struct ctlra_t *ctlra_create(const struct ctlra_create_opts_t *opts)
 		CTLRA_INFO(c, "Cairo: %s\n", CTLRA_OPT_CAIRO);
 	}
 
+	/* USB traffic capture / replay, see capture.h for the format */
+	char *usb_capture = getenv("CTLRA_USB_CAPTURE");
+	if(usb_capture)
+		c->usb_capture = ctlra_impl_capture_open(c, usb_capture);
+	char *usb_replay = getenv("CTLRA_USB_REPLAY");
+	if(usb_replay)
+		c->usb_replay = ctlra_impl_replay_open(c, usb_replay,
+					getenv("CTLRA_USB_REPLAY_FAST") != 0);
+
 	/* register USB hotplug etc */
 	int err = ctlra_dev_impl_usb_init(c);
 	if(err)
 		CTLRA_ERROR(c, "impl_usb_init() returned %d\n", err);
 
+#ifdef HAVE_EVDEV
+	/* register evdev hotplug */
+	err = ctlra_impl_evdev_init(c);
+	if(err)
+		CTLRA_ERROR(c, "impl_evdev_init() returned %d\n", err);
+#endif
+
 	return c;
 }
 
@@ -433,10 +675,21 @@ int ctlra_probe(struct ctlra_t *ctlra,
 
 	ctlra->accept_dev_func = accept_func;
 	ctlra->accept_dev_func_userdata = userdata;
-	for(; i < __ctlra_device_count; i++) {
-		num_accepted += ctlra_impl_accept_dev(ctlra, i);
+	if(ctlra_impl_usb_mock_active()) {
+		/* mock transport: connect every emulated device, there may
+		 * be many of the same type */
+		num_accepted += ctlra_impl_usb_mock_probe(ctlra);
+	} else {
+		for(; i < __ctlra_device_count; i++) {
+			num_accepted += ctlra_impl_accept_dev(ctlra, i);
+		}
 	}
 
+#ifdef HAVE_EVDEV
+	/* kernel handled devices, from /dev/input/eventX nodes */
+	num_accepted += ctlra_impl_evdev_probe(ctlra);
+#endif
+
 	/* virtualize device from ENV variable */
 	char *virt_vendor = getenv("CTLRA_VIRTUAL_VENDOR");
 	char *virt_device = getenv("CTLRA_VIRTUAL_DEVICE");
@@ -456,6 +709,9 @@ int ctlra_probe(struct ctlra_t *ctlra,
 void ctlra_idle_iter(struct ctlra_t *ctlra)
 {
 	ctlra_impl_usb_idle_iter(ctlra);
+#ifdef HAVE_EVDEV
+	ctlra_impl_evdev_idle_iter(ctlra);
+#endif
 
 	/* Poll events from all */
 	struct ctlra_dev_t *dev_iter = ctlra->dev_list;
@@ -490,11 +746,21 @@ void ctlra_idle_iter(struct ctlra_t *ctlra)
 		uint64_t nanos_elapsed = secs * 10e9 + nanos;
 		uint64_t fps_in_nanos = 100000000;
 
-		if(dev_iter->screen_redraw_cb && fps_in_nanos < nanos_elapsed) {
+		ctlra_impl_share_tick(dev_iter);
+
+		if(dev_iter->render) {
+			int redraw = fps_in_nanos < nanos_elapsed;
+			if(redraw)
+				dev_iter->screen_last_redraw = now;
+			ctlra_impl_render_tick(dev_iter, redraw);
+		} else if(dev_iter->screen_redraw_cb &&
+			  fps_in_nanos < nanos_elapsed) {
 			dev_iter->screen_last_redraw = now;
 			for(int i = 0; i < CTLRA_NUM_SCREENS_MAX; i++) {
 				uint8_t *pixel;
 				uint32_t bytes;
+				if(ctlra_impl_share_active(dev_iter, i))
+					continue;
 
 				struct ctlra_screen_zone_t zone_redraw;
 				int32_t ret = ctlra_screen_get_data(dev_iter,
@@ -511,7 +777,7 @@ void ctlra_idle_iter(struct ctlra_t *ctlra)
 					continue;
 				}
 
-				struct ctlra_screen_zone_t redraw;
+				struct ctlra_screen_zone_t redraw = {0};
 				int32_t flush = dev_iter->screen_redraw_cb(
 					dev_iter,
 					i, /* screen idx */
@@ -531,6 +797,26 @@ void ctlra_idle_iter(struct ctlra_t *ctlra)
 		dev_iter = dev_iter->dev_list_next;
 	}
 
+	/* Realtime lights, LED animations and meters are applied after the
+	 * feedback funcs, so they take priority over lights the application
+	 * set from them */
+	uint64_t now_ns = ctlra_impl_time_ns();
+	if(now_ns >= ctlra->light_tick_next_ns) {
+		ctlra->light_tick_next_ns = now_ns + CTLRA_LIGHT_ANIM_TICK_NS;
+		for(dev_iter = ctlra->dev_list; dev_iter;
+		    dev_iter = dev_iter->dev_list_next) {
+			if(dev_iter->banished)
+				continue;
+			int w = 0;
+			if(dev_iter->light_set)
+				w = ctlra_impl_lights_rt_apply(dev_iter);
+			w |= ctlra_impl_light_anim_tick(dev_iter, now_ns);
+			w |= ctlra_impl_meter_tick(dev_iter, now_ns);
+			if(w && dev_iter->light_flush)
+				dev_iter->light_flush(dev_iter, 0);
+		}
+	}
+
 	/* if any devices were banished (I/O Error, malfunctioned etc)
 	 * then we disconnect them here. The dev_disconnect() call will
 	 * inform the application if it registered a remove() callback */
@@ -541,6 +827,33 @@ void ctlra_idle_iter(struct ctlra_t *ctlra)
 	}
 }
 
+int ctlra_dev_impl_lights_write(struct ctlra_dev_t *dev,
+				struct ctlra_lights_shadow_t *shadow,
+				uint32_t idx, uint32_t endpoint,
+				uint8_t *data, uint32_t size,
+				uint32_t force)
+{
+	int cached = size <= CTLRA_LIGHTS_SHADOW_MAX;
+
+	if(!force && cached && shadow->valid && shadow->size == size &&
+	   memcmp(shadow->data, data, size) == 0) {
+		dev->usb_xfer_counts[USB_XFER_LIGHTS_SUPPRESSED]++;
+		return 0;
+	}
+
+	int ret = ctlra_dev_impl_usb_interrupt_write_shadow(dev, idx,
+							   endpoint, data,
+							   size, shadow);
+	/* a report that wasn't submitted must be re-sent next flush */
+	shadow->valid = 0;
+	if(ret > 0 && cached) {
+		memcpy(shadow->data, data, size);
+		shadow->size = size;
+		shadow->valid = 1;
+	}
+	return ret;
+}
+
 void ctlra_dev_impl_banish(struct ctlra_dev_t *dev)
 {
 	struct ctlra_t *ctlra = dev->ctlra_context;
@@ -566,7 +879,11 @@ void ctlra_exit(struct ctlra_t *ctlra)
 		ctlra_dev_disconnect(dev_free);
 	}
 
+	ctlra_impl_render_pool_free(ctlra);
 	ctlra_impl_usb_shutdown(ctlra);
+#ifdef HAVE_EVDEV
+	ctlra_impl_evdev_shutdown(ctlra);
+#endif
 
 	free(ctlra);
 }
@@ -128,11 +128,34 @@ typedef const char *(*ctlra_info_get_name_func)(enum ctlra_event_type_t type,
 #define CTLRA_ITEM_LED_INTENSITY (1<< 5)
 #define CTLRA_ITEM_LED_COLOR     (1<< 6)
 
+/* LED strips: params[0] and params[1] are the first and one-past-last
+ * light ids of the strip, or 0 and the LED count if the LEDs have no
+ * light ids. Set with ctlra_dev_feedback_set() or ctlra_dev_meter_set() */
 #define CTLRA_ITEM_FB_LED_STRIP  (1<< 7)
+/* Screens: params[0] and params[1] are the width and height in pixels,
+ * params[2] is the bits per pixel and params[3] the CTLRA_PIXEL_FORMAT
+ * of the pixel data passed to the screen redraw callback */
 #define CTLRA_ITEM_FB_SCREEN     (1<< 8)
 #define CTLRA_ITEM_FB_7_SEGMENT  (1<< 9)
 
 #define CTLRA_ITEM_HAS_FB_ID     (1<<31)
+
+/* Pixel formats of screens, and of images passed to
+ * ctlra_screen_convert() */
+#define CTLRA_PIXEL_FORMAT_UNKNOWN   0
+#define CTLRA_PIXEL_FORMAT_ARGB32    1 /* uint32_t 0xAARRGGBB, as cairo */
+#define CTLRA_PIXEL_FORMAT_RGB565    2 /* uint16_t in host byte order */
+#define CTLRA_PIXEL_FORMAT_GREY8     3 /* one byte per pixel */
+#define CTLRA_PIXEL_FORMAT_RGB565_BE 4 /* big endian 565, eg: Maschine MK3 */
+#define CTLRA_PIXEL_FORMAT_MONO1     5 /* 1 bit per pixel, eg: Mikro MK2.
+					* Pages of 8 rows, a byte per column
+					* with the top row in bit 0 */
+
+/* How images are reduced to 1 bit screens by ctlra_screen_convert() */
+#define CTLRA_DITHER_THRESHOLD       0
+#define CTLRA_DITHER_ORDERED         1 /* 8x8 Bayer matrix */
+#define CTLRA_DITHER_FLOYD_STEINBERG 2
+
 struct ctlra_item_info_t {
 	uint32_t x; /* location of item on X axis */
 	uint32_t y; /* location of item on Y axis */
@@ -281,14 +304,17 @@ struct ctlra_screen_zone_t {
  * in the devices native screen data type.
  *
  * In order to abstract the application from the device's native data
- * format, various functions are exposed to translate the data. For
+ * format, *ctlra_screen_convert* translates common formats into it. For
  * example, the common Cairo library can be used to draw pixels, and the
  * cairo_surface_t * passed to the *ctlra_screen_cairo_to_device* helper
- * function, and then the appropriate pixel converion will take place.
+ * from ctlra_cairo.h, and then the appropriate pixel converion will take
+ * place.
  *
  * @retval 0 Screen will not be redrawn
- * @retval 1 Screen will fully redrawn
+ * @retval 1 Screen will fully redrawn. Drivers that can, diff the frame
+ *           against the last one sent and transfer only what changed
  * @retval 2 Screen will redraw only zone as indicated in *redraw_zone*
+ * @retval 3 Screen will fully redrawn, sending the whole frame
  */
 typedef int32_t (*ctlra_screen_redraw_cb)(struct ctlra_dev_t *dev,
 					  uint32_t screen_idx,
@@ -326,6 +352,257 @@ void ctlra_dev_set_callback_userdata(struct ctlra_dev_t *dev,
 void ctlra_dev_set_screen_feedback_func(struct ctlra_dev_t *dev,
 					ctlra_screen_redraw_cb func);
 
+/** Run the screen redraw callback of *dev* on worker threads when
+ * *enable* is non-zero, so rendering doesn't delay input polling and
+ * LED feedback in ctlra_idle_iter(). Each screen is drawn into its own
+ * buffer, and the screens of a device may be drawn in parallel, so the
+ * callback must be safe to call from other threads, and at the same
+ * time as the feedback func. The contents of the buffer passed to the
+ * callback are the last frame drawn. Finished frames are sent to the
+ * device from ctlra_idle_iter().
+ * @retval 0 on success
+ * @retval -ENOTSUP if the device has no screens
+ * @retval -ENOMEM if buffers or threads couldn't be allocated
+ * @retval -EBUSY if a screen is shared, see ctlra_dev_screen_share()
+ */
+int32_t ctlra_dev_screen_async(struct ctlra_dev_t *dev, uint32_t enable);
+
+/** Convert an image into the native format of screen *screen_idx*, for
+ * use in the screen redraw callback. The *src* image is in *src_format*,
+ * is the size of the screen, and its rows are *src_stride* bytes apart.
+ * The result is written to *pixel_data*, the buffer passed to the
+ * callback. When *zone* is not NULL, only the pixels in *zone* are
+ * converted, 1 bit screens are always converted whole. The fastest
+ * conversion the CPU supports is used.
+ * @retval 0 on success
+ * @retval -ENOTSUP if the screen or the conversion isn't supported
+ */
+int32_t ctlra_screen_convert(struct ctlra_dev_t *dev,
+			     uint32_t screen_idx,
+			     uint8_t *pixel_data,
+			     uint32_t src_format,
+			     const uint8_t *src,
+			     uint32_t src_stride,
+			     const struct ctlra_screen_zone_t *zone);
+
+/** Set how ctlra_screen_convert() reduces images for the 1 bit screens
+ * of *dev*, to one of the CTLRA_DITHER_* modes. Pixels at least as
+ * bright as *threshold* are set, a *threshold* of 0 selects the default
+ * of 128. With ordered dithering the threshold biases the matrix, with
+ * Floyd-Steinberg it is the quantisation point.
+ * @retval 0 on success
+ * @retval -EINVAL if *dither* is not a CTLRA_DITHER_* mode
+ */
+int32_t ctlra_dev_screen_dither(struct ctlra_dev_t *dev, uint32_t dither,
+				uint8_t threshold);
+
+/** Width and height in pixels of a glyph of the built-in font at scale
+ * 1, including spacing. See ctlra_screen_text() */
+#define CTLRA_FONT_W 6
+#define CTLRA_FONT_H 8
+#define CTLRA_FONT_SCALE_MAX 4
+
+/** Draw *text* into *pixel_data*, the buffer passed to the redraw
+ * callback of screen *screen_idx*, without going through an ARGB image.
+ * The top left of the text is at *x*, *y* and it is clipped to the
+ * screen. Glyphs are drawn with the built-in 6x8 pixel ASCII font
+ * enlarged *scale* times, in colour *fg* on background *bg*, both
+ * 0xRRGGBB. Glyph cells are opaque, so redrawing a label clears the old
+ * text under it. A newline starts a new line at *x*. Glyphs are cached
+ * in the screen's native format, so redrawing labels every frame is
+ * cheap. When *damage* is not NULL it is grown to include the pixels
+ * written, so it can be passed back as the redraw zone.
+ * @retval The width in pixels of the widest line of *text*
+ * @retval -ENOTSUP if the screen doesn't exist or isn't supported
+ * @retval -EINVAL if *scale* is larger than CTLRA_FONT_SCALE_MAX
+ * @retval -ENOMEM if a glyph couldn't be cached
+ */
+int32_t ctlra_screen_text(struct ctlra_dev_t *dev, uint32_t screen_idx,
+			  uint8_t *pixel_data, int32_t x, int32_t y,
+			  uint32_t scale, uint32_t fg, uint32_t bg,
+			  const char *text,
+			  struct ctlra_screen_zone_t *damage);
+
+/** Sprites each screen can hold, see ctlra_screen_sprite_add() */
+#define CTLRA_SPRITES_MAX 64
+/** Composite the sprite using the alpha of its ARGB32 image */
+#define CTLRA_SPRITE_BLEND       (1 << 0)
+/** The image has straight alpha, premultiply it on upload. Images from
+ * cairo are already premultiplied */
+#define CTLRA_SPRITE_PREMULTIPLY (1 << 1)
+
+/** Upload a *w* x *h* image to screen *screen_idx* as a sprite, which
+ * can then be drawn by ctlra_screen_sprite_draw() without converting it
+ * again. The *src* image is in *src_format*, and its rows are
+ * *src_stride* bytes apart. The image is converted to the native format
+ * of the screen once, here. With the CTLRA_SPRITE_BLEND flag an ARGB32
+ * image is alpha blended when drawn, otherwise it is copied opaque.
+ * Sprites must be added, drawn and removed from one thread at a time
+ * for each screen, eg: from the screen's redraw callback.
+ * @retval The id of the sprite, to pass to ctlra_screen_sprite_draw()
+ * @retval -ENOTSUP if the screen or the conversion isn't supported
+ * @retval -EINVAL if the size is 0 or larger than the screen, or
+ *         blending a non ARGB32 image
+ * @retval -ENOSPC if the screen has CTLRA_SPRITES_MAX sprites
+ * @retval -ENOMEM if the sprite couldn't be allocated
+ */
+int32_t ctlra_screen_sprite_add(struct ctlra_dev_t *dev,
+				uint32_t screen_idx,
+				uint32_t src_format,
+				const uint8_t *src,
+				uint32_t w, uint32_t h,
+				uint32_t src_stride,
+				uint32_t flags);
+
+/** Draw sprite *sprite_id* into *pixel_data*, the buffer passed to the
+ * redraw callback of screen *screen_idx*, with its top left at *x*, *y*.
+ * The sprite is clipped to the screen. When *damage* is not NULL it is
+ * grown to include the pixels drawn, so it can be passed back as the
+ * redraw zone.
+ * @retval 0 on success
+ * @retval -EINVAL if the screen has no sprite *sprite_id*
+ */
+int32_t ctlra_screen_sprite_draw(struct ctlra_dev_t *dev,
+				 uint32_t screen_idx,
+				 uint8_t *pixel_data,
+				 uint32_t sprite_id,
+				 int32_t x, int32_t y,
+				 struct ctlra_screen_zone_t *damage);
+
+/** Free sprite *sprite_id* of screen *screen_idx*, its id may be
+ * returned by a later ctlra_screen_sprite_add(). Sprites are freed when
+ * the device is removed.
+ * @retval 0 on success
+ * @retval -EINVAL if the screen has no sprite *sprite_id*
+ */
+int32_t ctlra_screen_sprite_remove(struct ctlra_dev_t *dev,
+				   uint32_t screen_idx, uint32_t sprite_id);
+
+/** Scrolling waveform display, see ctlra_screen_waveform_create() */
+struct ctlra_screen_waveform_t;
+
+/** Create a scrolling waveform in *area* of screen *screen_idx*, drawn in
+ * colour *fg* on background *bg*, both 0xRRGGBB. Columns pushed with
+ * ctlra_screen_waveform_push() enter on the right and scroll left. Each
+ * ctlra_screen_waveform_draw() moves the pixels already on screen and
+ * draws only the new columns, so the area must not be drawn over by
+ * anything else. On 1 bit screens *area* must start and end on a
+ * multiple of 8 rows. The waveform doesn't refer to *dev* after this
+ * call, and must be freed with ctlra_screen_waveform_destroy().
+ * @retval The waveform, or NULL if *area* or the screen is invalid
+ */
+struct ctlra_screen_waveform_t *
+ctlra_screen_waveform_create(struct ctlra_dev_t *dev, uint32_t screen_idx,
+			     const struct ctlra_screen_zone_t *area,
+			     uint32_t fg, uint32_t bg);
+
+/** Free a waveform created by ctlra_screen_waveform_create() */
+void ctlra_screen_waveform_destroy(struct ctlra_screen_waveform_t *wf);
+
+/** Push *count* columns onto the right of the waveform, each the *min*
+ * and *max* peak of the audio it covers, in the range -1 to 1. This may
+ * be called from another thread than the draw, as long as only one
+ * thread pushes, and it doesn't get more than the area width ahead.
+ */
+void ctlra_screen_waveform_push(struct ctlra_screen_waveform_t *wf,
+				const float *min, const float *max,
+				uint32_t count);
+
+/** Draw the columns pushed since the last draw into *pixel_data*, the
+ * buffer passed to the screen redraw callback, scrolling the rest. The
+ * first draw, and the first after ctlra_screen_waveform_invalidate(),
+ * draws the whole area. When *damage* is not NULL it is grown to
+ * include the area, so it can be passed back as the redraw zone.
+ * @retval The number of columns drawn, 0 if nothing changed
+ * @retval -EINVAL if *wf* or *pixel_data* is NULL
+ */
+int32_t ctlra_screen_waveform_draw(struct ctlra_screen_waveform_t *wf,
+				   uint8_t *pixel_data,
+				   struct ctlra_screen_zone_t *damage);
+
+/** Make the next ctlra_screen_waveform_draw() redraw the whole area, eg:
+ * after the application drew over it */
+void ctlra_screen_waveform_invalidate(struct ctlra_screen_waveform_t *wf);
+
+/** Identifies the control page of a shared screen, see
+ * ctlra_dev_screen_share() */
+#define CTLRA_SCREEN_SHARE_MAGIC 0x4352534c
+#define CTLRA_SCREEN_SHARE_VERSION 1
+/** Number of frame buffers of a shared screen */
+#define CTLRA_SCREEN_SHARE_BUFFERS 2
+
+/** Frame description written by the renderer with each frame */
+struct ctlra_screen_share_frame_t {
+	/* How the frame is sent, as returned by the screen redraw
+	 * callback: 1 for the whole frame, 2 for *zone* only, 3 to resend
+	 * every pixel. 0 is taken as 1 */
+	uint32_t flush;
+	struct ctlra_screen_zone_t zone;
+};
+
+/** The control page at offset 0 of a shared screen. The fields up to
+ * *buffer_offset* are written once by Ctlra before the fd is returned.
+ */
+struct ctlra_screen_share_t {
+	uint32_t magic;
+	uint32_t version;
+	/* Size of the whole mapping in bytes */
+	uint32_t size;
+	uint32_t width;
+	uint32_t height;
+	/* Bytes between rows, for CTLRA_PIXEL_FORMAT_MONO1 between pages
+	 * of 8 rows */
+	uint32_t stride;
+	/* A CTLRA_PIXEL_FORMAT_* */
+	uint32_t format;
+	/* Bytes of pixels in each buffer */
+	uint32_t bytes;
+	/* Page aligned offset of each buffer from the start of the mapping */
+	uint32_t buffer_offset[CTLRA_SCREEN_SHARE_BUFFERS];
+	/* Written by the renderer before it publishes frame n to *seq* */
+	struct ctlra_screen_share_frame_t frame[CTLRA_SCREEN_SHARE_BUFFERS];
+	/* Number of the last frame published, written by the renderer */
+	uint32_t seq;
+	/* Number of the last frame Ctlra is done with, written by Ctlra */
+	uint32_t acked;
+};
+
+/** Move screen *screen_idx* into shared memory that another process can
+ * draw into, and return a file descriptor for it in *fd*. Map all of
+ * it, *size* bytes, shared and writable: the mapping starts with a
+ * struct ctlra_screen_share_t describing the layout, followed by
+ * CTLRA_SCREEN_SHARE_BUFFERS frame buffers. Frame n, starting at 1, is
+ * drawn whole into buffer n % CTLRA_SCREEN_SHARE_BUFFERS, once *acked*
+ * is at least n - CTLRA_SCREEN_SHARE_BUFFERS. The renderer then fills
+ * in the frame description of that buffer and atomically stores n to
+ * *seq* with release ordering. ctlra_idle_iter() sends the newest frame
+ * published straight from its buffer where the driver supports it, and
+ * stores its number to *acked*. Frames published faster than that are
+ * skipped. The screen redraw callback is not called for the screen
+ * while it is shared. The fd stays owned by Ctlra, and is closed by
+ * ctlra_dev_screen_unshare() or when the device is disconnected; it
+ * can be sent to another process over a unix socket, or dup()-ed. The
+ * size of the memory is sealed. Sharing a screen that is already
+ * shared returns the same fd.
+ * @retval 0 on success
+ * @retval -ENOTSUP if the screen doesn't exist, or the platform has no
+ *         memfd
+ * @retval -EBUSY if the device renders with ctlra_dev_screen_async()
+ * @retval -ENOMEM or another negative errno if the memory couldn't be
+ *         created
+ */
+int32_t ctlra_dev_screen_share(struct ctlra_dev_t *dev, uint32_t screen_idx,
+			       int *fd);
+
+/** Stop sharing screen *screen_idx*, and close its fd. The last frame
+ * sent stays on the screen, and the redraw callback takes over again.
+ * Other processes may keep their mapping, Ctlra no longer reads it.
+ * @retval 0 on success
+ * @retval -EINVAL if the screen isn't shared
+ */
+int32_t ctlra_dev_screen_unshare(struct ctlra_dev_t *dev,
+				 uint32_t screen_idx);
+
 /** Sets the function that will be called on device removal */
 void ctlra_dev_set_remove_func(struct ctlra_dev_t *dev,
 			       ctlra_remove_dev_func func);
@@ -390,6 +667,11 @@ int32_t ctlra_get_devices_by_vendor(const char *vendor,
  * application, with the device descriptor filled out as if it was the
  * actual hardware plugged in. This allows total emulation of the hardware.
  *
+ * When Ctlra is built without AVTKA, or the CTLRA_VIRTUAL_HEADLESS
+ * environment variable is set, a headless backend is used instead. It
+ * generates scripted or random events, and records the feedback written
+ * by the application - see devices/headless.c for its options.
+ *
  * @retval 0 Successfully virtualized the device using an available backend
  * @retval -1 Error in virtualizing
  */
@@ -421,6 +703,110 @@ void ctlra_dev_light_set(struct ctlra_dev_t *dev,
 			uint32_t light_id,
 			uint32_t light_status);
 
+/** Realtime safe variant of ctlra_dev_light_set(), which may be called
+ * from any thread, eg: a JACK process callback lighting the pad of a
+ * sequencer step. It does not lock, allocate or make system calls. The
+ * light is applied and flushed by ctlra_idle_iter() on its next LED
+ * tick, after the feedback func of the device has run. Only light ids
+ * below 256 are supported. It must not be called once the remove
+ * callback of the device has been called.
+ */
+void ctlra_dev_light_set_rt(struct ctlra_dev_t *dev,
+			    uint32_t light_id,
+			    uint32_t light_status);
+
+/** Set many lights in one call: light *ids[i]* is set to *values[i]*,
+ * for *count* lights. The result is the same as calling
+ * ctlra_dev_light_set() for each light, which is what Ctlra does for
+ * drivers without a frame writer. Lights still need to be written to
+ * the device with ctlra_dev_light_flush().
+ */
+void ctlra_dev_lights_set_frame(struct ctlra_dev_t *dev,
+				const uint32_t *ids,
+				const uint32_t *values,
+				uint32_t count);
+
+/** Dense variant of ctlra_dev_lights_set_frame(): light id *i* is set to
+ * *values[i]*, for light ids 0 to *count* - 1. Drivers with a simple LED
+ * layout (Maschine MK3, Maschine Jam) write the whole frame straight into
+ * their LED state, which is cheaper than setting each light in turn.
+ */
+void ctlra_dev_lights_set_dense(struct ctlra_dev_t *dev,
+				const uint32_t *values,
+				uint32_t count);
+
+/** LED animation types, see struct ctlra_light_anim_t */
+#define CTLRA_LIGHT_ANIM_BLINK 1
+#define CTLRA_LIGHT_ANIM_PULSE 2
+#define CTLRA_LIGHT_ANIM_FADE  3
+#define CTLRA_LIGHT_ANIM_CHASE 4
+
+/** Describes an LED animation run by Ctlra. Colours *from* and *to* are
+ * light_status values as passed to ctlra_dev_light_set().
+ * - BLINK: *to* for the first half of each period, then *from*
+ * - PULSE: fades *from* -> *to* -> *from* over each period
+ * - FADE: fades *from* -> *to* over one period, then holds *to*
+ * - CHASE: lights *length* consecutive light ids from the animated id
+ *   with *from*, except one light set to *to* which steps along the run
+ *   once per period. Useful for touchstrips and LED rings.
+ */
+struct ctlra_light_anim_t {
+	uint32_t type;
+	uint32_t from;
+	uint32_t to;
+	/** Period of one cycle, or of one chase step, in milliseconds */
+	uint32_t period_ms;
+	/** Number of lights in a chase */
+	uint32_t length;
+	/** Cycles to run before setting *from*, or zero to run forever.
+	 * A chase cycle is the full run of *length* steps */
+	uint32_t repeats;
+};
+
+/** Start an LED animation on *light_id*, replacing any animation that
+ * was running on it. The animation is evaluated by ctlra_idle_iter() at
+ * a fixed tick and written to the device without any calls from the
+ * application. Passing NULL as *anim* stops the animation, leaving the
+ * light as it is. Calling ctlra_dev_light_set() on an animated light has
+ * no lasting effect until its animation is stopped.
+ * @retval 0 on success
+ * @retval -EINVAL if *anim* is invalid
+ * @retval -ENOSPC if the device has too many animations running
+ * @retval -ENOTSUP if the device has no lights
+ */
+int32_t ctlra_dev_light_animate(struct ctlra_dev_t *dev,
+				uint32_t light_id,
+				const struct ctlra_light_anim_t *anim);
+
+/** Turn feedback item *fb_id* into a level meter. The bar follows the
+ * level set with ctlra_dev_meter_set(), and falls back at
+ * *fall_per_sec* (full scale per second). If *hold_ms* is non-zero, the
+ * peak LED is held for *hold_ms* before it falls too. Meters are
+ * rendered by ctlra_idle_iter() on the same tick as LED animations.
+ * Calling again resets the meter with the new parameters.
+ * @retval 0 on success
+ * @retval -ENOTSUP if the device has no LED strip feedback items
+ * @retval -EINVAL if feedback item *fb_id* is not a
+ *         CTLRA_ITEM_FB_LED_STRIP
+ */
+int32_t ctlra_dev_meter_enable(struct ctlra_dev_t *dev,
+			       uint32_t fb_id,
+			       uint32_t hold_ms,
+			       float fall_per_sec);
+
+/** Stop rendering meter *fb_id*, leaving its LEDs as they are */
+void ctlra_dev_meter_disable(struct ctlra_dev_t *dev, uint32_t fb_id);
+
+/** Set the level of meter *fb_id*, from 0 to 1. This is a single atomic
+ * store, and may be called from a realtime thread, eg: once per JACK
+ * period with the peak sample of that period. It must not be called
+ * before ctlra_dev_meter_enable() returns, or once the remove callback
+ * of the device has been called.
+ */
+void ctlra_dev_meter_set(struct ctlra_dev_t *dev,
+			 uint32_t fb_id,
+			 float level);
+
 /** Feedback item set: sets the value for a feedback item */
 void ctlra_dev_feedback_set(struct ctlra_dev_t *dev,
 			    uint32_t fb_id,
@@ -447,6 +833,34 @@ void ctlra_dev_grid_light_set(struct ctlra_dev_t *dev,
 			     uint32_t light_id,
 			     uint32_t light_status);
 
+/** Enable a continuous pressure stream from the pads of grid *grid_id*.
+ * By default grids only send events when a pad is pressed or released.
+ * When enabled, held pads also send grid events with only the
+ * CTLRA_EVENT_GRID_FLAG_PRESSURE flag set, at most *max_rate_hz* times per
+ * second per pad, and only when the pressure moved by more than
+ * *min_delta* (0.f to 1.f) since the last event sent for that pad.
+ * Passing a *max_rate_hz* of zero disables the stream again.
+ * @retval 0 on success
+ * @retval -ENOTSUP if the grid or its driver doesn't support pressure
+ */
+int32_t ctlra_dev_grid_pressure_stream(struct ctlra_dev_t *dev,
+				       uint32_t grid_id,
+				       uint32_t max_rate_hz,
+				       float min_delta);
+
+/** Set all lights of grid *grid_id* in one call. *rgb[i]* is the light
+ * status of grid position *i*, in the format of ctlra_dev_light_set(),
+ * and positions are numbered as in grid events. Up to *count* positions
+ * are written, positions past the size of the grid are ignored. Lights
+ * still need to be written to the device with ctlra_dev_light_flush().
+ * @retval 0 on success
+ * @retval -ENOTSUP if the device has no lights for grid *grid_id*
+ */
+int32_t ctlra_dev_grid_frame_set(struct ctlra_dev_t *dev,
+				 uint32_t grid_id,
+				 const uint32_t *rgb,
+				 uint32_t count);
+
 /** @warning
  * @b DEPRECATED: this API has been superseeded, use the screen update
  * callback APIs instead.
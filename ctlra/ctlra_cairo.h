@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef OPENAV_CTLRA_CAIRO_H
+#define OPENAV_CTLRA_CAIRO_H
+
+#include <errno.h>
+#include <cairo/cairo.h>
+
+#include "ctlra.h"
+
+/** Helper for screen redraw callbacks that draw with Cairo: converts the
+ * image *surface* into the native format of screen *screen_idx* of *dev*,
+ * writing it to *pixel_data*. The surface must be the size of the
+ * screen, and be ARGB32, RGB24, RGB16_565 or A8. This is header only, so
+ * Ctlra itself doesn't depend on Cairo.
+ * @retval 0 on success
+ * @retval -ENOTSUP if the surface format or screen isn't supported
+ */
+static inline int32_t
+ctlra_screen_cairo_to_device(struct ctlra_dev_t *dev, uint32_t screen_idx,
+			     uint8_t *pixel_data, uint32_t bytes,
+			     struct ctlra_screen_zone_t *redraw_zone,
+			     cairo_surface_t *surface)
+{
+	uint32_t format;
+	switch(cairo_image_surface_get_format(surface)) {
+	case CAIRO_FORMAT_ARGB32:
+	case CAIRO_FORMAT_RGB24:
+		format = CTLRA_PIXEL_FORMAT_ARGB32;
+		break;
+	case CAIRO_FORMAT_RGB16_565:
+		format = CTLRA_PIXEL_FORMAT_RGB565;
+		break;
+	case CAIRO_FORMAT_A8:
+		format = CTLRA_PIXEL_FORMAT_GREY8;
+		break;
+	default:
+		return -ENOTSUP;
+	}
+
+	cairo_surface_flush(surface);
+	const uint8_t *data = cairo_image_surface_get_data(surface);
+	int stride = cairo_image_surface_get_stride(surface);
+	return ctlra_screen_convert(dev, screen_idx, pixel_data, format,
+				    data, stride, NULL);
+}
+
+#endif /* OPENAV_CTLRA_CAIRO_H */
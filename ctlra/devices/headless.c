@@ -0,0 +1,510 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "impl.h"
+#include "pixel.h"
+
+/* The headless virtual device emulates any registered device from its
+ * static info, without opening a UI. It generates events for the app
+ * and records the feedback the app writes, which allows load testing
+ * applications on machines without hardware or a display.
+ *
+ * It is configured by environment variables:
+ *  CTLRA_HEADLESS_RATE   : random events per second (default 1000, or
+ *                          0 if a script is given)
+ *  CTLRA_HEADLESS_SEED   : seed of the random event generator
+ *  CTLRA_HEADLESS_SCRIPT : file with one event per line:
+ *                          <time ms> <button|slider|encoder|grid> <id> <value>
+ *                          Lines need not be in time order, events at
+ *                          the same time are sent in file order
+ *  CTLRA_HEADLESS_LOG    : file to record light/feedback/screen writes
+ */
+
+/* max events passed to the app in one event_func() call */
+#define HEADLESS_BATCH 256
+/* limits the catch-up after the app stalls */
+#define HEADLESS_POLL_MAX (HEADLESS_BATCH * 64)
+
+struct headless_script_ev_t {
+	uint64_t time_ns;
+	/* file order, keeps events at the same time in order when sorted */
+	uint32_t line_no;
+	struct ctlra_event_t event;
+};
+
+struct headless_t {
+	/* base handles usb i/o etc */
+	struct ctlra_dev_t base;
+
+	uint64_t start_ns;
+
+	/* random event generation */
+	uint32_t rate;
+	uint32_t rng;
+	uint64_t generated;
+	uint8_t *button_state;
+	uint8_t *grid_state;
+	uint32_t grid_size;
+
+	/* scripted events */
+	struct headless_script_ev_t *script;
+	uint32_t script_count;
+	uint32_t script_idx;
+
+	/* recording of app feedback */
+	FILE *log;
+	uint64_t lights_set;
+	uint64_t light_flushes;
+	uint64_t feedback_set;
+	uint64_t grid_lights_set;
+	uint64_t screen_flushes;
+
+	/* screens, as described by the FB_SCREEN items, in their format */
+	uint8_t *screen[CTLRA_NUM_SCREENS_MAX];
+	uint32_t screen_bytes[CTLRA_NUM_SCREENS_MAX];
+
+	struct ctlra_event_t events[HEADLESS_BATCH];
+	struct ctlra_event_t *event_ptrs[HEADLESS_BATCH];
+};
+
+static uint64_t
+headless_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* xorshift32: cheap enough to generate millions of events per second */
+static inline uint32_t
+headless_rand(struct headless_t *dev)
+{
+	uint32_t x = dev->rng;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	dev->rng = x;
+	return x;
+}
+
+static void
+headless_random_event(struct headless_t *dev, struct ctlra_event_t *e)
+{
+	const uint32_t *counts = dev->base.info.control_count;
+	uint32_t buttons  = counts[CTLRA_EVENT_BUTTON];
+	uint32_t encoders = counts[CTLRA_EVENT_ENCODER];
+	uint32_t sliders  = counts[CTLRA_EVENT_SLIDER];
+	uint32_t total = buttons + encoders + sliders + dev->grid_size;
+
+	memset(e, 0, sizeof(*e));
+	if(!total) {
+		e->type = CTLRA_EVENT_BUTTON;
+		return;
+	}
+
+	/* controls are picked uniformly, so pads and buttons dominate
+	 * just as they do when a device is played */
+	uint32_t r = headless_rand(dev) % total;
+	if(r < buttons) {
+		e->type = CTLRA_EVENT_BUTTON;
+		e->button.id = r;
+		e->button.pressed = dev->button_state[r] ^= 1;
+	} else if((r -= buttons) < encoders) {
+		e->type = CTLRA_EVENT_ENCODER;
+		e->encoder.id = r;
+		e->encoder.flags = CTLRA_EVENT_ENCODER_FLAG_INT;
+		e->encoder.delta = (headless_rand(dev) & 1) ? 1 : -1;
+	} else if((r -= encoders) < sliders) {
+		e->type = CTLRA_EVENT_SLIDER;
+		e->slider.id = r;
+		e->slider.value = (headless_rand(dev) & 0xffff) / 65535.f;
+	} else {
+		r -= sliders;
+		e->type = CTLRA_EVENT_GRID;
+		e->grid.id = 0;
+		e->grid.pos = r;
+		e->grid.pressed = dev->grid_state[r] ^= 1;
+		e->grid.flags = CTLRA_EVENT_GRID_FLAG_BUTTON;
+		if(dev->base.info.grid_info[0].pressure) {
+			e->grid.flags |= CTLRA_EVENT_GRID_FLAG_PRESSURE;
+			e->grid.pressure = e->grid.pressed ?
+				(headless_rand(dev) & 0xff) / 255.f : 0.f;
+		}
+	}
+}
+
+static void
+headless_send(struct headless_t *dev, uint32_t count)
+{
+	if(count && dev->base.event_func)
+		dev->base.event_func(&dev->base, count, dev->event_ptrs,
+				     dev->base.event_func_userdata);
+}
+
+static uint32_t
+headless_poll(struct ctlra_dev_t *base)
+{
+	struct headless_t *dev = (struct headless_t *)base;
+	uint64_t elapsed = headless_now() - dev->start_ns;
+	uint32_t count = 0;
+
+	/* scripted events that are due */
+	while(dev->script_idx < dev->script_count &&
+	      dev->script[dev->script_idx].time_ns <= elapsed) {
+		dev->events[count++] = dev->script[dev->script_idx++].event;
+		if(count == HEADLESS_BATCH) {
+			headless_send(dev, count);
+			count = 0;
+		}
+	}
+
+	/* random events that are due at the configured rate */
+	uint64_t due = (elapsed * dev->rate) / 1000000000ull - dev->generated;
+	if(due > HEADLESS_POLL_MAX) {
+		/* drop what can't be caught up on */
+		dev->generated += due - HEADLESS_POLL_MAX;
+		due = HEADLESS_POLL_MAX;
+	}
+	for(uint64_t i = 0; i < due; i++) {
+		headless_random_event(dev, &dev->events[count++]);
+		if(count == HEADLESS_BATCH) {
+			headless_send(dev, count);
+			count = 0;
+		}
+	}
+	dev->generated += due;
+
+	headless_send(dev, count);
+	return 0;
+}
+
+static void
+headless_light_set(struct ctlra_dev_t *base, uint32_t light_id,
+		   uint32_t light_status)
+{
+	struct headless_t *dev = (struct headless_t *)base;
+	dev->lights_set++;
+	if(dev->log)
+		fprintf(dev->log, "%lu light %u 0x%08x\n",
+			(unsigned long)(headless_now() - dev->start_ns),
+			light_id, light_status);
+}
+
+static void
+headless_feedback_set(struct ctlra_dev_t *base, uint32_t fb_id,
+		      float value)
+{
+	struct headless_t *dev = (struct headless_t *)base;
+	dev->feedback_set++;
+	if(dev->log)
+		fprintf(dev->log, "%lu feedback %u %f\n",
+			(unsigned long)(headless_now() - dev->start_ns),
+			fb_id, value);
+}
+
+static int32_t
+headless_grid_light_set(struct ctlra_dev_t *base, uint32_t grid_id,
+			uint32_t light_id, uint32_t light_status)
+{
+	struct headless_t *dev = (struct headless_t *)base;
+	dev->grid_lights_set++;
+	if(dev->log)
+		fprintf(dev->log, "%lu grid %u %u 0x%08x\n",
+			(unsigned long)(headless_now() - dev->start_ns),
+			grid_id, light_id, light_status);
+	return 0;
+}
+
+static void
+headless_light_flush(struct ctlra_dev_t *base, uint32_t force)
+{
+	struct headless_t *dev = (struct headless_t *)base;
+	dev->light_flushes++;
+	if(dev->log)
+		fprintf(dev->log, "%lu flush %u\n",
+			(unsigned long)(headless_now() - dev->start_ns),
+			force);
+}
+
+static int32_t
+headless_screen_get_data(struct ctlra_dev_t *base, uint32_t screen_idx,
+			 uint8_t **pixels, uint32_t *bytes,
+			 struct ctlra_screen_zone_t *zone, uint8_t flush)
+{
+	struct headless_t *dev = (struct headless_t *)base;
+
+	if(screen_idx >= CTLRA_NUM_SCREENS_MAX || !dev->screen[screen_idx])
+		return -1;
+
+	*pixels = dev->screen[screen_idx];
+	*bytes = dev->screen_bytes[screen_idx];
+
+	if(flush) {
+		dev->screen_flushes++;
+		if(dev->log)
+			fprintf(dev->log, "%lu screen %u %u bytes\n",
+				(unsigned long)(headless_now() - dev->start_ns),
+				screen_idx, *bytes);
+	}
+	return 0;
+}
+
+static int32_t
+headless_disconnect(struct ctlra_dev_t *base)
+{
+	struct headless_t *dev = (struct headless_t *)base;
+	struct ctlra_t *ctlra = base->ctlra_context;
+
+	CTLRA_INFO(ctlra, "headless '%s': %lu events, %lu light sets, "
+		   "%lu flushes, %lu feedback, %lu grid lights, "
+		   "%lu screen flushes\n", base->info.device,
+		   (unsigned long)(dev->generated + dev->script_idx),
+		   (unsigned long)dev->lights_set,
+		   (unsigned long)dev->light_flushes,
+		   (unsigned long)dev->feedback_set,
+		   (unsigned long)dev->grid_lights_set,
+		   (unsigned long)dev->screen_flushes);
+
+	if(dev->log)
+		fclose(dev->log);
+	for(int i = 0; i < CTLRA_NUM_SCREENS_MAX; i++)
+		free(dev->screen[i]);
+	free(dev->script);
+	free(dev->button_state);
+	free(dev->grid_state);
+	free(dev);
+	return 0;
+}
+
+static int
+headless_script_ev_cmp(const void *a, const void *b)
+{
+	const struct headless_script_ev_t *ea = a;
+	const struct headless_script_ev_t *eb = b;
+	if(ea->time_ns != eb->time_ns)
+		return ea->time_ns < eb->time_ns ? -1 : 1;
+	return ea->line_no < eb->line_no ? -1 : ea->line_no > eb->line_no;
+}
+
+static int
+headless_script_load(struct headless_t *dev, const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if(!f)
+		return -1;
+
+	const uint32_t *counts = dev->base.info.control_count;
+	char line[256];
+	uint32_t size = 0;
+	uint32_t line_no = 0;
+	while(fgets(line, sizeof(line), f)) {
+		line_no++;
+		double ms;
+		char type[16];
+		uint32_t id;
+		float value;
+		if(line[0] == '#' ||
+		   sscanf(line, "%lf %15s %u %f", &ms, type, &id, &value) != 4)
+			continue;
+		if(!(ms >= 0)) {
+			printf("Ctlra headless: %s:%u: negative time, skipped\n",
+			       path, line_no);
+			continue;
+		}
+
+		if(dev->script_count == size) {
+			size = size ? size * 2 : 64;
+			void *s = realloc(dev->script, size * sizeof(*dev->script));
+			if(!s)
+				break;
+			dev->script = s;
+		}
+
+		struct headless_script_ev_t *s = &dev->script[dev->script_count];
+		memset(s, 0, sizeof(*s));
+		s->time_ns = ms * 1000000;
+		s->line_no = line_no;
+
+		/* ids index the application's arrays, which are sized from
+		 * the device info */
+		uint32_t max = 0;
+		if(strcmp(type, "button") == 0)
+			max = counts[CTLRA_EVENT_BUTTON];
+		else if(strcmp(type, "slider") == 0)
+			max = counts[CTLRA_EVENT_SLIDER];
+		else if(strcmp(type, "encoder") == 0)
+			max = counts[CTLRA_EVENT_ENCODER];
+		else if(strcmp(type, "grid") == 0)
+			max = dev->grid_size;
+		else
+			continue;
+		if(id >= max) {
+			printf("Ctlra headless: %s:%u: %s %u out of range, "
+			       "skipped\n", path, line_no, type, id);
+			continue;
+		}
+
+		struct ctlra_event_t *e = &s->event;
+		if(strcmp(type, "button") == 0) {
+			e->type = CTLRA_EVENT_BUTTON;
+			e->button.id = id;
+			e->button.pressed = value != 0;
+		} else if(strcmp(type, "slider") == 0) {
+			e->type = CTLRA_EVENT_SLIDER;
+			e->slider.id = id;
+			e->slider.value = value;
+		} else if(strcmp(type, "encoder") == 0) {
+			e->type = CTLRA_EVENT_ENCODER;
+			e->encoder.id = id;
+			e->encoder.flags = CTLRA_EVENT_ENCODER_FLAG_INT;
+			e->encoder.delta = (int32_t)value;
+		} else {
+			e->type = CTLRA_EVENT_GRID;
+			e->grid.pos = id;
+			e->grid.pressed = value != 0;
+			e->grid.flags = CTLRA_EVENT_GRID_FLAG_BUTTON;
+		}
+		dev->script_count++;
+	}
+
+	fclose(f);
+
+	/* poll() sends events in array order as their time passes */
+	qsort(dev->script, dev->script_count, sizeof(*dev->script),
+	      headless_script_ev_cmp);
+	return 0;
+}
+
+static int
+headless_screens_alloc(struct headless_t *dev)
+{
+	const struct ctlra_dev_info_t *info = &dev->base.info;
+	uint32_t screen = 0;
+
+	for(uint32_t i = 0; i < info->control_count[CTLRA_FEEDBACK_ITEM]; i++) {
+		struct ctlra_item_info_t *item =
+			info->control_info[CTLRA_FEEDBACK_ITEM];
+		if(!item)
+			break;
+		item = &item[i];
+		if(!(item->flags & CTLRA_ITEM_FB_SCREEN))
+			continue;
+		if(screen >= CTLRA_NUM_SCREENS_MAX)
+			break;
+
+		/* screens without a format predate them, and were 565 */
+		uint32_t bpp = ctlra_pixel_format_bpp(item->params[3]);
+		if(!bpp)
+			bpp = 16;
+		uint32_t bytes = item->params[0] * item->params[1] * bpp / 8;
+		dev->screen[screen] = calloc(1, bytes);
+		if(!dev->screen[screen])
+			return -1;
+		dev->screen_bytes[screen] = bytes;
+		screen++;
+	}
+	return 0;
+}
+
+struct ctlra_dev_t *
+ctlra_headless_connect(ctlra_event_func event_func, void *userdata,
+		       void *future)
+{
+	/* future is the info of the device to emulate */
+	const struct ctlra_dev_info_t *info = future;
+	if(!info)
+		return 0;
+
+	struct headless_t *dev = calloc(1, sizeof(struct headless_t));
+	if(!dev)
+		return 0;
+
+	dev->base.info = *info;
+	for(int i = 0; i < HEADLESS_BATCH; i++)
+		dev->event_ptrs[i] = &dev->events[i];
+
+	const struct ctlra_grid_info_t *grid = &info->grid_info[0];
+	dev->grid_size = grid->x * grid->y;
+	dev->button_state = calloc(1, info->control_count[CTLRA_EVENT_BUTTON] + 1);
+	dev->grid_state = calloc(1, dev->grid_size + 1);
+	if(!dev->button_state || !dev->grid_state)
+		goto fail;
+
+	if(headless_screens_alloc(dev))
+		goto fail;
+
+	char *script = getenv("CTLRA_HEADLESS_SCRIPT");
+	if(script && headless_script_load(dev, script))
+		printf("Ctlra headless: error loading script %s\n", script);
+
+	char *rate = getenv("CTLRA_HEADLESS_RATE");
+	dev->rate = rate ? atoi(rate) : (script ? 0 : 1000);
+
+	char *seed = getenv("CTLRA_HEADLESS_SEED");
+	dev->rng = seed ? strtoul(seed, 0, 0) : 0x0a7c7a;
+	if(!dev->rng)
+		dev->rng = 1;
+
+	char *log = getenv("CTLRA_HEADLESS_LOG");
+	if(log) {
+		dev->log = fopen(log, "w");
+		if(!dev->log)
+			printf("Ctlra headless: error opening log %s\n", log);
+	}
+
+	dev->base.poll = headless_poll;
+	dev->base.disconnect = headless_disconnect;
+	dev->base.light_set = headless_light_set;
+	dev->base.light_flush = headless_light_flush;
+	dev->base.feedback_set = headless_feedback_set;
+	dev->base.grid_light_set = headless_grid_light_set;
+	dev->base.screen_get_data = headless_screen_get_data;
+
+	dev->base.event_func = event_func;
+	dev->base.event_func_userdata = userdata;
+
+	dev->start_ns = headless_now();
+
+	return (struct ctlra_dev_t *)dev;
+fail:
+	for(int i = 0; i < CTLRA_NUM_SCREENS_MAX; i++)
+		free(dev->screen[i]);
+	free(dev->button_state);
+	free(dev->grid_state);
+	free(dev);
+	return 0;
+}
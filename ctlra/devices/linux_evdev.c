@@ -0,0 +1,372 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include <linux/input.h>
+
+#include "impl.h"
+#include "evdev.h"
+
+/* evdev devices are found by scanning /dev/input, not by USB IDs. The
+ * registered IDs only need to never match a real USB device */
+#define CTLRA_DRIVER_VENDOR (0x0)
+#define CTLRA_DRIVER_DEVICE (0x0)
+
+#define EVDEV_PATH_MAX     64
+/* Number of input_event structs pulled from the kernel per read() */
+#define EVDEV_READ_BATCH   64
+/* Max ctlra events sent to the application per SYN_REPORT frame */
+#define EVDEV_EVENTS_MAX   64
+
+#define BITS_PER_LONG      (sizeof(long) * 8)
+#define NBITS(x)           ((((x) - 1) / BITS_PER_LONG) + 1)
+#define TEST_BIT(bit, arr) ((arr[(bit) / BITS_PER_LONG] >> \
+			     ((bit) % BITS_PER_LONG)) & 1)
+
+/* Represents the the hardware device */
+struct evdev_t {
+	/* base handles usb i/o etc */
+	struct ctlra_dev_t base;
+	int fd;
+	char path[EVDEV_PATH_MAX];
+
+	/* SYN_DROPPED: skip events until the next SYN_REPORT */
+	uint8_t dropping;
+
+	/* kernel code -> ctlra control id + 1, 0 for unused codes */
+	uint16_t key_ids[KEY_CNT];
+	uint16_t abs_ids[ABS_CNT];
+	uint16_t rel_ids[REL_CNT];
+	/* ranges of each EV_ABS axis, to normalize to 0.f - 1.f */
+	int32_t abs_min[ABS_CNT];
+	float   abs_scale[ABS_CNT];
+
+	/* events of the current SYN_REPORT frame */
+	uint32_t event_count;
+	struct ctlra_event_t events[EVDEV_EVENTS_MAX];
+	struct ctlra_event_t *event_ptrs[EVDEV_EVENTS_MAX];
+};
+
+static const char *
+evdev_control_get_name(enum ctlra_event_type_t type,
+		       uint32_t control)
+{
+	/* evdev devices are not known until runtime, and get_name() has
+	 * no per-device context, so only generic names can be returned */
+	switch(type) {
+	case CTLRA_EVENT_BUTTON:  return "Key";
+	case CTLRA_EVENT_SLIDER:  return "Axis";
+	case CTLRA_EVENT_ENCODER: return "Relative";
+	default: break;
+	}
+	return 0;
+}
+
+static void
+evdev_frame_flush(struct evdev_t *dev)
+{
+	if(dev->event_count && dev->base.event_func)
+		dev->base.event_func(&dev->base, dev->event_count,
+				     dev->event_ptrs,
+				     dev->base.event_func_userdata);
+	dev->event_count = 0;
+}
+
+static struct ctlra_event_t *
+evdev_frame_next(struct evdev_t *dev)
+{
+	/* frames with more events than we can store are split */
+	if(dev->event_count == EVDEV_EVENTS_MAX)
+		evdev_frame_flush(dev);
+	return &dev->events[dev->event_count++];
+}
+
+static void
+evdev_input_event(struct evdev_t *dev, const struct input_event *ev)
+{
+	struct ctlra_event_t *e;
+	uint16_t id;
+
+	if(ev->type == EV_SYN) {
+		if(ev->code == SYN_DROPPED) {
+			/* kernel buffer overrun, this frame is incomplete */
+			dev->dropping = 1;
+			dev->event_count = 0;
+		} else if(ev->code == SYN_REPORT) {
+			if(!dev->dropping)
+				evdev_frame_flush(dev);
+			dev->dropping = 0;
+			dev->event_count = 0;
+		}
+		return;
+	}
+
+	if(dev->dropping)
+		return;
+
+	switch(ev->type) {
+	case EV_KEY:
+		/* value 2 is autorepeat, which is not a state change */
+		if(ev->code >= KEY_CNT || ev->value == 2)
+			return;
+		id = dev->key_ids[ev->code];
+		if(!id)
+			return;
+		e = evdev_frame_next(dev);
+		e->type = CTLRA_EVENT_BUTTON;
+		e->button.id = id - 1;
+		e->button.pressed = ev->value != 0;
+		e->button.has_pressure = 0;
+		e->button.pressure = 0.f;
+		break;
+	case EV_ABS:
+		if(ev->code >= ABS_CNT)
+			return;
+		id = dev->abs_ids[ev->code];
+		if(!id)
+			return;
+		e = evdev_frame_next(dev);
+		e->type = CTLRA_EVENT_SLIDER;
+		e->slider.id = id - 1;
+		e->slider.value = (ev->value - dev->abs_min[ev->code]) *
+				  dev->abs_scale[ev->code];
+		break;
+	case EV_REL:
+		if(ev->code >= REL_CNT)
+			return;
+		id = dev->rel_ids[ev->code];
+		if(!id)
+			return;
+		e = evdev_frame_next(dev);
+		e->type = CTLRA_EVENT_ENCODER;
+		e->encoder.id = id - 1;
+		e->encoder.flags = CTLRA_EVENT_ENCODER_FLAG_INT;
+		e->encoder.delta = ev->value;
+		break;
+	default:
+		break;
+	}
+}
+
+static uint32_t
+evdev_poll(struct ctlra_dev_t *base)
+{
+	struct evdev_t *dev = (struct evdev_t *)base;
+	struct input_event evs[EVDEV_READ_BATCH];
+
+	for(;;) {
+		ssize_t ret = read(dev->fd, evs, sizeof(evs));
+		if(ret < 0) {
+			if(errno == EAGAIN || errno == EINTR)
+				break;
+			/* ENODEV when unplugged: banish, ctlra cleans up */
+			CTLRA_INFO(base->ctlra_context, "%s read error: %s\n",
+				   dev->path, strerror(errno));
+			ctlra_dev_impl_banish(base);
+			break;
+		}
+
+		int count = ret / sizeof(struct input_event);
+		for(int i = 0; i < count; i++)
+			evdev_input_event(dev, &evs[i]);
+
+		/* a short read means the kernel queue is drained */
+		if(count < EVDEV_READ_BATCH)
+			break;
+	}
+
+	return 0;
+}
+
+static void
+evdev_light_set(struct ctlra_dev_t *base, uint32_t light_id,
+		uint32_t light_status)
+{
+	(void)base;
+	(void)light_id;
+	(void)light_status;
+}
+
+static void
+evdev_light_flush(struct ctlra_dev_t *base, uint32_t force)
+{
+	(void)base;
+	(void)force;
+}
+
+static int32_t
+evdev_disconnect(struct ctlra_dev_t *base)
+{
+	struct evdev_t *dev = (struct evdev_t *)base;
+	close(dev->fd);
+	free(dev);
+	return 0;
+}
+
+const char *
+ctlra_evdev_dev_get_path(struct ctlra_dev_t *base)
+{
+	if(!base || base->disconnect != evdev_disconnect)
+		return 0;
+	struct evdev_t *dev = (struct evdev_t *)base;
+	return dev->path;
+}
+
+/* Keyboards and mice are left to the desktop: picking them up as
+ * controllers would swallow events the user expects elsewhere */
+static int
+evdev_is_desktop_input(const unsigned long *key_bits,
+		       const unsigned long *rel_bits)
+{
+	int keyboard = TEST_BIT(KEY_A, key_bits) && TEST_BIT(KEY_Z, key_bits);
+	int mouse = TEST_BIT(BTN_LEFT, key_bits) && TEST_BIT(REL_X, rel_bits);
+	return keyboard || mouse;
+}
+
+struct ctlra_dev_info_t ctlra_evdev_info;
+
+struct ctlra_dev_t *
+ctlra_evdev_connect(ctlra_event_func event_func, void *userdata,
+		    void *future)
+{
+	/* future is the /dev/input/eventX path, passed by the evdev
+	 * backend. Probing the registered drivers passes NULL: ignore */
+	const char *path = future;
+	if(!path)
+		return 0;
+
+	struct evdev_t *dev = calloc(1, sizeof(struct evdev_t));
+	if(!dev)
+		return 0;
+
+	dev->fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if(dev->fd < 0)
+		goto fail;
+
+	unsigned long ev_bits[NBITS(EV_CNT)] = {0};
+	unsigned long key_bits[NBITS(KEY_CNT)] = {0};
+	unsigned long abs_bits[NBITS(ABS_CNT)] = {0};
+	unsigned long rel_bits[NBITS(REL_CNT)] = {0};
+	struct input_id input_id;
+
+	if(ioctl(dev->fd, EVIOCGBIT(0, sizeof(ev_bits)), ev_bits) < 0 ||
+	   ioctl(dev->fd, EVIOCGID, &input_id) < 0)
+		goto fail_close;
+	if(TEST_BIT(EV_KEY, ev_bits))
+		ioctl(dev->fd, EVIOCGBIT(EV_KEY, sizeof(key_bits)), key_bits);
+	if(TEST_BIT(EV_ABS, ev_bits))
+		ioctl(dev->fd, EVIOCGBIT(EV_ABS, sizeof(abs_bits)), abs_bits);
+	if(TEST_BIT(EV_REL, ev_bits))
+		ioctl(dev->fd, EVIOCGBIT(EV_REL, sizeof(rel_bits)), rel_bits);
+
+	if(evdev_is_desktop_input(key_bits, rel_bits))
+		goto fail_close;
+
+	/* Devices with a native Ctlra driver are claimed over USB */
+	if(input_id.vendor &&
+	   ctlra_impl_get_id_by_vid_pid(input_id.vendor,
+					input_id.product) >= 0)
+		goto fail_close;
+
+	/* assign dense control ids in kernel code order */
+	uint32_t buttons = 0, sliders = 0, encoders = 0;
+	for(int i = 0; i < KEY_CNT; i++)
+		if(TEST_BIT(i, key_bits))
+			dev->key_ids[i] = ++buttons;
+	for(int i = 0; i < ABS_CNT; i++) {
+		struct input_absinfo abs;
+		if(!TEST_BIT(i, abs_bits) ||
+		   ioctl(dev->fd, EVIOCGABS(i), &abs) < 0)
+			continue;
+		int32_t range = abs.maximum - abs.minimum;
+		dev->abs_min[i] = abs.minimum;
+		dev->abs_scale[i] = range > 0 ? 1.f / range : 0.f;
+		dev->abs_ids[i] = ++sliders;
+	}
+	for(int i = 0; i < REL_CNT; i++)
+		if(TEST_BIT(i, rel_bits))
+			dev->rel_ids[i] = ++encoders;
+
+	if(!buttons && !sliders && !encoders)
+		goto fail_close;
+
+	for(int i = 0; i < EVDEV_EVENTS_MAX; i++)
+		dev->event_ptrs[i] = &dev->events[i];
+
+	snprintf(dev->path, sizeof(dev->path), "%s", path);
+
+	dev->base.info = ctlra_evdev_info;
+	ioctl(dev->fd, EVIOCGNAME(sizeof(dev->base.info.device)),
+	      dev->base.info.device);
+	ioctl(dev->fd, EVIOCGUNIQ(sizeof(dev->base.info.serial)),
+	      dev->base.info.serial);
+	dev->base.info.vendor_id = input_id.vendor;
+	dev->base.info.device_id = input_id.product;
+	dev->base.info.control_count[CTLRA_EVENT_BUTTON] = buttons;
+	dev->base.info.control_count[CTLRA_EVENT_SLIDER] = sliders;
+	dev->base.info.control_count[CTLRA_EVENT_ENCODER] = encoders;
+
+	dev->base.poll = evdev_poll;
+	dev->base.disconnect = evdev_disconnect;
+	dev->base.light_set = evdev_light_set;
+	dev->base.light_flush = evdev_light_flush;
+
+	dev->base.event_func = event_func;
+	dev->base.event_func_userdata = userdata;
+
+	return (struct ctlra_dev_t *)dev;
+fail_close:
+	close(dev->fd);
+fail:
+	free(dev);
+	return 0;
+}
+
+struct ctlra_dev_info_t ctlra_evdev_info = {
+	.vendor    = "Linux",
+	.device    = "evdev",
+	.vendor_id = CTLRA_DRIVER_VENDOR,
+	.device_id = CTLRA_DRIVER_DEVICE,
+	.get_name  = evdev_control_get_name,
+};
+
+/* Not registered: evdev nodes are probed from /dev/input by evdev.c.
+ * A registered entry with VID/PID 0/0 would be listed as a vendor, and
+ * connected by ctlra_probe() and ctlra_dev_virtualize() without a node */
+//CTLRA_DEVICE_REGISTER(evdev)
@@ -29,6 +29,7 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
@@ -36,6 +37,7 @@
 
 #include "ni_kontrol_d2.h"
 #include "impl.h"
+#include "ni_screen.h"
 
 #define CTLRA_DRIVER_VENDOR       (0x17cc)
 #define CTLRA_DRIVER_DEVICE       (0x1400)
@@ -146,6 +148,16 @@ static const char *ni_kontrol_d2_encoder_names[] = {
 #define ENCODER_SIZE (sizeof(ni_kontrol_d2_encoder_names) /\
 				    sizeof(ni_kontrol_d2_encoder_names[0]))
 
+static struct ctlra_item_info_t feedback_info[] = {
+	{.x = 40, .y = 60, .w = 95, .h = 54, .flags = CTLRA_ITEM_FB_SCREEN,
+		.params = {480, 272, 16, CTLRA_PIXEL_FORMAT_RGB565_BE}},
+};
+#define FEEDBACK_SIZE (sizeof(feedback_info) / sizeof(feedback_info[0]))
+
+static const char *ni_kontrol_d2_feedback_names[] = {
+	"Screen",
+};
+
 #define CONTROL_NAMES_SIZE (BUTTON_SIZE + \
 			    SLIDER_SIZE + \
 			    ENCODER_SIZE)
@@ -277,6 +289,15 @@ struct d2_screen_blit {
 	uint8_t footer [sizeof(footer)];
 };
 
+/* Screen memory, allocated on first use of the screen */
+struct d2_screen_t {
+	struct d2_screen_blit blit;
+	/* partial updates and diffs are encoded here, see ni_screen.h */
+	uint8_t cmd[NI_SCREEN_PARTIAL_MAX];
+	/* last frame sent to the screen, full redraws send the diff */
+	struct ni_screen_diff_t diff;
+};
+
 /* Represents the the hardware device */
 struct ni_kontrol_d2_t {
 	/* base handles usb i/o etc */
@@ -302,11 +323,13 @@ struct ni_kontrol_d2_t {
 	 * transfer. */
 	uint8_t lights_endpoint;
 	uint8_t lights[LEDS_SIZE];
+	struct ctlra_lights_shadow_t lights_shadow;
 	uint8_t waste;
 
-	/* this is a huge datastructure that includes full frame pixels,
-	 * leave it at the end of the struct to get out of the way */
-	struct d2_screen_blit screen_blit;
+	struct d2_screen_t *screen;
+	/* pixels set by screen_set_pixels, read instead of the screen's
+	 * when not NULL */
+	uint8_t *screen_ext;
 };
 
 static const char *
@@ -330,6 +353,11 @@ ni_kontrol_d2_control_get_name(enum ctlra_event_type_t type,
 			break;
 		ret = ni_kontrol_d2_encoder_names[control];
 		break;
+	case CTLRA_FEEDBACK_ITEM:
+		if(control >= FEEDBACK_SIZE)
+			break;
+		ret = ni_kontrol_d2_feedback_names[control];
+		break;
 	default:
 		break;
 	};
@@ -488,19 +516,55 @@ void ni_kontrol_d2_usb_read_cb(struct ctlra_dev_t *base, uint32_t endpoint,
 	} /* switch */
 }
 
+static struct d2_screen_t *
+ni_kontrol_d2_screen_get(struct ni_kontrol_d2_t *dev)
+{
+	if(dev->screen)
+		return dev->screen;
+
+	struct d2_screen_t *screen = calloc(1, sizeof(struct d2_screen_t));
+	if(!screen)
+		return 0;
+	/* Copy the screen update details into the blit struct */
+	memcpy(screen->blit.header , header , sizeof(screen->blit.header));
+	memcpy(screen->blit.command, command, sizeof(screen->blit.command));
+	memcpy(screen->blit.footer , footer , sizeof(screen->blit.footer));
+
+	dev->screen = screen;
+	dev->base.mem_bytes += sizeof(*screen);
+	return screen;
+}
+
 uint8_t *
 ni_kontrol_d2_screen_get_pixels(struct ctlra_dev_t *base)
 {
 	struct ni_kontrol_d2_t *dev = (struct ni_kontrol_d2_t *)base;
-	return (uint8_t *)&dev->screen_blit.pixels;
+	if(dev->screen_ext)
+		return dev->screen_ext;
+	struct d2_screen_t *screen = ni_kontrol_d2_screen_get(dev);
+	return screen ? screen->blit.pixels : 0;
+}
+
+static int32_t
+ni_kontrol_d2_screen_set_pixels(struct ctlra_dev_t *base,
+				uint32_t screen_idx, uint8_t *pixels)
+{
+	struct ni_kontrol_d2_t *dev = (struct ni_kontrol_d2_t *)base;
+	if(screen_idx > 0)
+		return -EINVAL;
+	if(!ni_kontrol_d2_screen_get(dev))
+		return -ENOMEM;
+	dev->screen_ext = pixels;
+	return 0;
 }
 
 static void
 ni_kontrol_d2_screen_splash(struct ctlra_dev_t *base)
 {
 	struct ni_kontrol_d2_t *dev = (struct ni_kontrol_d2_t *)base;
-	memset(dev->screen_blit.pixels, 0x0,
-	       sizeof(dev->screen_blit.pixels));
+	dev->screen_ext = 0;
+	memset(dev->screen->blit.pixels, 0x0,
+	       sizeof(dev->screen->blit.pixels));
 	ni_kontrol_d2_screen_blit(&dev->base);
 }
 
@@ -508,11 +572,20 @@ void
 ni_kontrol_d2_screen_blit(struct ctlra_dev_t *base)
 {
 	struct ni_kontrol_d2_t *dev = (struct ni_kontrol_d2_t *)base;
+	if(!dev->screen)
+		return;
+	struct d2_screen_blit *blit = &dev->screen->blit;
+	uint8_t *data = (uint8_t *)blit;
+	uint32_t size = sizeof(*blit);
+	if(dev->screen_ext) {
+		data = dev->screen->cmd;
+		size = ni_screen_encode_full(dev->screen->cmd, blit->header,
+					     blit->footer, dev->screen_ext);
+	}
 
 	int ret = ctlra_dev_impl_usb_bulk_write(base, USB_INTERFACE_SCREEN,
 						USB_ENDPOINT_SCREEN_WRITE,
-						(uint8_t *)&dev->screen_blit,
-						sizeof(dev->screen_blit));
+						data, size);
 	if(ret < 0)
 		printf("%s write failed!\n", __func__);
 }
@@ -526,12 +599,62 @@ ni_kontrol_d2_screen_get_data(struct ctlra_dev_t *base,
 			      uint8_t flush)
 {
 	struct ni_kontrol_d2_t *dev = (struct ni_kontrol_d2_t *)base;
+	struct d2_screen_t *screen = ni_kontrol_d2_screen_get(dev);
+	if(!screen)
+		return -ENOMEM;
+
 	/* fill in out params */
 	*pixels = ni_kontrol_d2_screen_get_pixels(base);
-	*bytes = sizeof(dev->screen_blit.pixels);
+	*bytes = sizeof(screen->blit.pixels);
+
+	struct d2_screen_blit *blit = &screen->blit;
+	uint8_t *px = *pixels;
+	uint32_t size = 0;
+
+	if(flush > 3)
+		flush = 3;
+
+	if(flush == 2) {
+		struct ctlra_screen_zone_t z = *redraw;
+		if(!ni_screen_zone_clip(&z))
+			return 0;
+
+		/* large zones are cheaper to send as a full frame */
+		if(ni_screen_zone_size(&z) >= sizeof(*blit)) {
+			flush = 3;
+		} else {
+			size = ni_screen_encode_zone(screen->cmd,
+						     blit->header, blit->footer,
+						     px, &z);
+			ni_screen_diff_zone(&screen->diff, px, &z);
+		}
+	}
+
+	if(flush == 1) {
+		size = ni_screen_encode_diff(screen->cmd, &screen->diff,
+					     blit->header, blit->footer, px);
+		if(size == 0)
+			return 0;
+		if(size >= sizeof(*blit)) {
+			ni_kontrol_d2_screen_blit(base);
+			return 0;
+		}
+	}
 
-	if(flush)
+	if(flush == 3) {
+		ni_screen_diff_full(&screen->diff, px);
 		ni_kontrol_d2_screen_blit(base);
+		return 0;
+	}
+
+	if(flush) {
+		int ret = ctlra_dev_impl_usb_bulk_write(base,
+						USB_INTERFACE_SCREEN,
+						USB_ENDPOINT_SCREEN_WRITE,
+						screen->cmd, size);
+		if(ret < 0)
+			printf("%s write failed!\n", __func__);
+	}
 
 	return 0;
 }
@@ -678,10 +801,11 @@ ni_kontrol_d2_light_flush(struct ctlra_dev_t *base, uint32_t force)
 	uint8_t *data = &dev->lights_endpoint;
 	dev->lights_endpoint = 0x80;
 
-	int ret = ctlra_dev_impl_usb_interrupt_write(&dev->base,
+	int ret = ctlra_dev_impl_lights_write(&dev->base,
+	                &dev->lights_shadow,
 	                USB_INTERFACE_BTNS,
 	                USB_ENDPOINT_BTNS_WRITE,
-	                data, LEDS_SIZE+1);
+	                data, LEDS_SIZE+1, force);
 	if(ret < 0)
 		printf("%s write failed!\n", __func__);
 }
@@ -695,10 +819,13 @@ ni_kontrol_d2_disconnect(struct ctlra_dev_t *base)
 	memset(dev->lights, 0x0, sizeof(dev->lights));
 	if(!base->banished) {
 		ni_kontrol_d2_light_flush(&dev->base, 1);
-		ni_kontrol_d2_screen_splash(base);
+		/* a screen that was never drawn shows the device's own */
+		if(dev->screen)
+			ni_kontrol_d2_screen_splash(base);
 	}
 
 	ctlra_dev_impl_usb_close(base);
+	free(dev->screen);
 	free(dev);
 	return 0;
 }
@@ -745,12 +872,11 @@ ctlra_ni_kontrol_d2_connect(ctlra_event_func event_func,
 	dev->base.info.control_count[CTLRA_EVENT_SLIDER] = SLIDER_SIZE;
 	dev->base.info.control_count[CTLRA_EVENT_BUTTON] = BUTTON_SIZE;
 	dev->base.info.control_count[CTLRA_EVENT_ENCODER] = ENCODER_SIZE;
+	dev->base.info.control_count[CTLRA_FEEDBACK_ITEM] = FEEDBACK_SIZE;
+	dev->base.info.control_info[CTLRA_FEEDBACK_ITEM] = feedback_info;
 	dev->base.info.get_name = ni_kontrol_d2_control_get_name;
 
-	/* Copy the screen update details into the embedded struct */
-	memcpy(dev->screen_blit.header , header , sizeof(dev->screen_blit.header));
-	memcpy(dev->screen_blit.command, command, sizeof(dev->screen_blit.command));
-	memcpy(dev->screen_blit.footer , footer , sizeof(dev->screen_blit.footer));
+	dev->base.mem_bytes = sizeof(*dev);
 
 	dev->base.poll = ni_kontrol_d2_poll;
 	dev->base.disconnect = ni_kontrol_d2_disconnect;
@@ -758,6 +884,7 @@ ctlra_ni_kontrol_d2_connect(ctlra_event_func event_func,
 	dev->base.light_flush = ni_kontrol_d2_light_flush;
 	dev->base.usb_read_cb = ni_kontrol_d2_usb_read_cb;
 	dev->base.screen_get_data = ni_kontrol_d2_screen_get_data;
+	dev->base.screen_set_pixels = ni_kontrol_d2_screen_set_pixels;
 
 	dev->base.event_func = event_func;
 	dev->base.event_func_userdata = userdata;
@@ -782,12 +909,12 @@ struct ctlra_dev_info_t ctlra_ni_kontrol_d2_info = {
 	.control_count[CTLRA_EVENT_BUTTON] = BUTTONS_SIZE,
 	.control_count[CTLRA_EVENT_SLIDER] = SLIDERS_SIZE,
 	.control_count[CTLRA_EVENT_ENCODER] = ENCODER_SIZE,
-	.control_count[CTLRA_FEEDBACK_ITEM] = FEEDBACK_SIZE,
 	.control_info[CTLRA_EVENT_BUTTON] = buttons_info,
 	.control_info[CTLRA_EVENT_SLIDER] = sliders_info,
 	.control_count[CTLRA_EVENT_ENCODER] = encoders,
-	.control_info[CTLRA_FEEDBACK_ITEM] = feedback_info,
 #endif
+	.control_count[CTLRA_FEEDBACK_ITEM] = FEEDBACK_SIZE,
+	.control_info[CTLRA_FEEDBACK_ITEM] = feedback_info,
 
 	.get_name = ni_kontrol_d2_control_get_name,
 };
@@ -200,7 +200,8 @@ void ni_kontrol_d2_light_touchstrip(struct ctlra_dev_t *dev,
  *   - 5 bits red 
  *
  * The application is expected to write this format directly the the
- * pointer returned by this function.
+ * pointer returned by this function. The screen memory is allocated by
+ * the first call, NULL is returned if that fails.
  */
 uint8_t *ni_kontrol_d2_screen_get_pixels(struct ctlra_dev_t *base);
 
@@ -169,6 +169,9 @@ struct ni_kontrol_f1_t {
 #define LED_SIZE 79
 	uint8_t lights_interface;
 	uint8_t lights[LED_SIZE];
+	/* the report written is one byte longer than the lights, zero */
+	uint8_t lights_report_pad;
+	struct ctlra_lights_shadow_t lights_shadow;
 };
 
 static const char *
@@ -369,9 +372,10 @@ ni_kontrol_f1_light_flush(struct ctlra_dev_t *base, uint32_t force)
 	uint8_t *data = &dev->lights_interface;
 
 	dev->lights[0] = 0x80;
-	int ret = ctlra_dev_impl_usb_interrupt_write(base, USB_HANDLE_IDX,
-						     USB_ENDPOINT_WRITE,
-						     data, 81);
+	int ret = ctlra_dev_impl_lights_write(base, &dev->lights_shadow,
+					      USB_HANDLE_IDX,
+					      USB_ENDPOINT_WRITE,
+					      data, 81, force);
 	if(ret < 0) {
 		//base->usb_xfer_counts[USB_XFER_ERROR]++;
 	}
@@ -399,6 +399,10 @@ struct ni_kontrol_s2_mk2_t {
 
 	uint8_t deck_lights_interface;
 	uint8_t deck_lights[LED_DECK_COUNT];
+
+	/* last sent 0x80 and 0x81 reports, only changed ones are sent */
+	struct ctlra_lights_shadow_t lights_shadow;
+	struct ctlra_lights_shadow_t deck_lights_shadow;
 };
 
 static const char *
@@ -606,10 +610,11 @@ ni_kontrol_s2_mk2_light_flush(struct ctlra_dev_t *base, uint32_t force)
 	/* all normal single-colour (brightness) leds */
 	dev->lights_interface = 0x80;
 
-	int ret = ctlra_dev_impl_usb_interrupt_write(base, USB_HANDLE_IDX,
-						     USB_ENDPOINT_WRITE,
-						     data,
-						     LED_COUNT+1);
+	int ret = ctlra_dev_impl_lights_write(base, &dev->lights_shadow,
+					      USB_HANDLE_IDX,
+					      USB_ENDPOINT_WRITE,
+					      data,
+					      LED_COUNT+1, force);
 	if(ret < 0) {
 		//printf("%s write failed!\n", __func__);
 	}
@@ -617,10 +622,11 @@ ni_kontrol_s2_mk2_light_flush(struct ctlra_dev_t *base, uint32_t force)
 	/* Cue / Remix slots, shift0sync-cue-play for both decks */
 	data = &dev->deck_lights_interface;
 	dev->deck_lights_interface = 0x81;
-	ret = ctlra_dev_impl_usb_interrupt_write(base, USB_HANDLE_IDX,
-						     USB_ENDPOINT_WRITE,
-						     data,
-						     LED_DECK_COUNT+1);
+	ret = ctlra_dev_impl_lights_write(base, &dev->deck_lights_shadow,
+					  USB_HANDLE_IDX,
+					  USB_ENDPOINT_WRITE,
+					  data,
+					  LED_DECK_COUNT+1, force);
 	if(ret < 0) {
 		//printf("%s write failed!\n", __func__);
 	}
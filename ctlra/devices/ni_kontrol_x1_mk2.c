@@ -264,10 +264,10 @@ static const struct ni_kontrol_x1_mk2_ctlra_t buttons[] = {
 
 
 static struct ctlra_item_info_t feedback_info[] = {
-	/* horizontal LED strip */
+	/* horizontal LED strip, 21 LEDs in the 0x81 report */
 	{	.x = 10, .y = 180, .w = 100, .h = 3,
 		.flags = CTLRA_ITEM_FB_LED_STRIP,
-		.params = {0, 1, 1, 0},
+		.params = {0, TOUCHSTRIP / 2, 1, 0},
 	},
 	/* Left 7 segs */
 	{	.x = 10, .y = 141, .w = (3 * 7) + 2, .h = 10,
@@ -309,6 +309,9 @@ struct ni_kontrol_x1_mk2_t {
 	uint8_t lights_interface;
 	uint8_t lights[LIGHTS_SIZE];
 	uint8_t lights_81[IFACE_Ox81_TOTAL];
+	/* last sent 0x80 and 0x81 reports, only changed ones are sent */
+	struct ctlra_lights_shadow_t lights_shadow;
+	struct ctlra_lights_shadow_t lights_81_shadow;
 };
 
 static const char *
@@ -497,17 +500,44 @@ ni_kontrol_x1_mk2_light_flush(struct ctlra_dev_t *base, uint32_t force)
 	uint8_t *data = &dev->lights_interface;
 	dev->lights_interface = 0x80;
 	const uint32_t size = LIGHTS_SIZE + 1;
-	ctlra_dev_impl_usb_interrupt_write(base,
-					   USB_HANDLE_IDX,
-					   USB_ENDPOINT_WRITE,
-					   data, size);
+	ctlra_dev_impl_lights_write(base, &dev->lights_shadow,
+				    USB_HANDLE_IDX,
+				    USB_ENDPOINT_WRITE,
+				    data, size, force);
 
 	dev->lights_81[0] = 0x81;
-	ctlra_dev_impl_usb_interrupt_write(base,
-					   USB_HANDLE_IDX,
-					   USB_ENDPOINT_WRITE,
-					   dev->lights_81,
-					   IFACE_Ox81_TOTAL);
+	ctlra_dev_impl_lights_write(base, &dev->lights_81_shadow,
+				    USB_HANDLE_IDX,
+				    USB_ENDPOINT_WRITE,
+				    dev->lights_81,
+				    IFACE_Ox81_TOTAL, force);
+}
+
+/* Touchstrip LEDs are orange and blue byte pairs after the digits. The
+ * bar is drawn in orange, the peak in blue, off LEDs stay dimly lit */
+static void
+ni_kontrol_x1_mk2_strip_set(struct ctlra_dev_t *base, uint32_t fb_id,
+			    float value, float peak)
+{
+	struct ni_kontrol_x1_mk2_t *dev = (struct ni_kontrol_x1_mk2_t *)base;
+	if(fb_id != 0)
+		return;
+
+	const uint32_t n = TOUCHSTRIP / 2;
+	uint8_t *leds = &dev->lights_81[IFACE_Ox81 + NUM_DIGIT_LEDS];
+	for(uint32_t i = 0; i < n; i++) {
+		int s = ctlra_dev_impl_strip_led(i, n, value, peak);
+		leds[i*2  ] = s == 1 ? 0xff : 0x1;
+		leds[i*2+1] = s == 2 ? 0xff : 0x0;
+	}
+	dev->lights_dirty = 1;
+}
+
+static void
+ni_kontrol_x1_mk2_feedback_set(struct ctlra_dev_t *base, uint32_t fb_id,
+			       float value)
+{
+	ni_kontrol_x1_mk2_strip_set(base, fb_id, value, 0.f);
 }
 
 void ni_kontrol_x1_mk2_feedback_digits(struct ctlra_dev_t *base,
@@ -631,6 +661,8 @@ ctlra_ni_kontrol_x1_mk2_connect(ctlra_event_func event_func,
 	dev->base.light_flush = ni_kontrol_x1_mk2_light_flush;
 	dev->base.usb_read_cb = ni_kontrol_x1_mk2_usb_read_cb;
 	dev->base.feedback_digits = ni_kontrol_x1_mk2_feedback_digits;
+	dev->base.feedback_set = ni_kontrol_x1_mk2_feedback_set;
+	dev->base.strip_set = ni_kontrol_x1_mk2_strip_set;
 
 	dev->base.event_func = event_func;
 	dev->base.event_func_userdata = userdata;
@@ -175,6 +175,7 @@ struct ni_kontrol_z1_t {
 
 	uint8_t lights_interface;
 	uint8_t lights[NI_KONTROL_Z1_LED_COUNT];
+	struct ctlra_lights_shadow_t lights_shadow;
 };
 
 static const char *
@@ -328,11 +329,11 @@ ni_kontrol_z1_light_flush(struct ctlra_dev_t *base, uint32_t force)
 	dev->lights_interface = 0x80;
 
 	/* error handling in USB subsystem */
-	ctlra_dev_impl_usb_interrupt_write(base,
-					   USB_HANDLE_IDX,
-					   USB_ENDPOINT_WRITE,
-					   data,
-					   NI_KONTROL_Z1_LED_COUNT+1);
+	ctlra_dev_impl_lights_write(base, &dev->lights_shadow,
+				    USB_HANDLE_IDX,
+				    USB_ENDPOINT_WRITE,
+				    data,
+				    NI_KONTROL_Z1_LED_COUNT+1, force);
 }
 
 static int32_t
@@ -29,6 +29,7 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
@@ -36,6 +37,7 @@
 #include <unistd.h>
 
 #include "impl.h"
+#include "palette.h"
 #include "ni_maschine_jam.h"
 
 #define CTLRA_DRIVER_VENDOR (0x17cc)
@@ -206,6 +208,41 @@ static struct ctlra_item_info_t sliders_info[] = {
 	{.x = 256, .y = 185, .w = 16, .h = 65, .flags = CTLRA_ITEM_FADER},
 };
 
+/* LED strip feedback ids: VU left and right, then the 8 touchstrips */
+#define JAM_FB_TOUCHSTRIP_1 2
+/* light ids of the VU LEDs, 8 per side, bottom to top */
+#define JAM_VU_LIGHT_FIRST  38
+
+#define JAM_STRIP (CTLRA_ITEM_FB_LED_STRIP)
+static struct ctlra_item_info_t feedback_info[] = {
+	/* VU left, right: light ids 38 to 45, 46 to 53 */
+	{.x = 292, .y = 20, .w = 4, .h = 56, .flags = JAM_STRIP, .params = {38, 46, 1, 0}},
+	{.x = 306, .y = 20, .w = 4, .h = 56, .flags = JAM_STRIP, .params = {46, 54, 1, 0}},
+	/* touchstrip LEDs, 11 each, not addressable by light id */
+	{.x =  58, .y = 185, .w = 4, .h = 65, .flags = JAM_STRIP, .params = {0, 11, 1, 0}},
+	{.x =  87, .y = 185, .w = 4, .h = 65, .flags = JAM_STRIP, .params = {0, 11, 1, 0}},
+	{.x = 116, .y = 185, .w = 4, .h = 65, .flags = JAM_STRIP, .params = {0, 11, 1, 0}},
+	{.x = 143, .y = 185, .w = 4, .h = 65, .flags = JAM_STRIP, .params = {0, 11, 1, 0}},
+	{.x = 171, .y = 185, .w = 4, .h = 65, .flags = JAM_STRIP, .params = {0, 11, 1, 0}},
+	{.x = 202, .y = 185, .w = 4, .h = 65, .flags = JAM_STRIP, .params = {0, 11, 1, 0}},
+	{.x = 230, .y = 185, .w = 4, .h = 65, .flags = JAM_STRIP, .params = {0, 11, 1, 0}},
+	{.x = 262, .y = 185, .w = 4, .h = 65, .flags = JAM_STRIP, .params = {0, 11, 1, 0}},
+};
+#define FEEDBACK_SIZE (sizeof(feedback_info) / sizeof(feedback_info[0]))
+
+static const char *ni_maschine_jam_feedback_names[] = {
+	"VU Left",
+	"VU Right",
+	"Strip 1 LEDs",
+	"Strip 2 LEDs",
+	"Strip 3 LEDs",
+	"Strip 4 LEDs",
+	"Strip 5 LEDs",
+	"Strip 6 LEDs",
+	"Strip 7 LEDs",
+	"Strip 8 LEDs",
+};
+
 static struct ctlra_item_info_t encoder_info[] = {
 	{.x = 287, .y = 125, .w = 24, .h = 24, .flags = CTLRA_ITEM_ENCODER},
 };
@@ -371,6 +408,13 @@ struct ni_maschine_jam_t {
 
 	uint8_t grid[GRID_SIZE];
 	uint8_t touchstrips[TOUCHSTRIP_LEDS_SIZE];
+	/* 0x81 report: endpoint, 8 top buttons, 8*8 grid, 8 bottom */
+	uint8_t grid_lights[GRID_SIZE];
+
+	/* last sent button, touchstrip and grid reports */
+	struct ctlra_lights_shadow_t lights_shadow;
+	struct ctlra_lights_shadow_t touchstrips_shadow;
+	struct ctlra_lights_shadow_t grid_shadow;
 };
 
 static const char *
@@ -386,6 +430,10 @@ ni_maschine_jam_control_get_name(enum ctlra_event_type_t type,
 			return "Encoder";
 		}
 		return 0;
+	case CTLRA_FEEDBACK_ITEM:
+		if(control_id < FEEDBACK_SIZE)
+			return ni_maschine_jam_feedback_names[control_id];
+		return 0;
 	default:
 		break;
 	}
@@ -599,24 +647,140 @@ void ni_machine_jam_usb_read_cb(struct ctlra_dev_t *base, uint32_t endpoint,
 	} /* switch */
 }
 
-static void ni_maschine_jam_light_set(struct ctlra_dev_t *base,
+/* RGB to palette hue for the RGB LEDs of the 0x81 grid report. Grey
+ * colours keep the plain brightness encoding */
+#define JAM_PALETTE_GREY 0xff
+static struct ctlra_palette_t jam_palette;
+
+/* single colour LEDs take the brightness only */
+static inline uint8_t
+ni_maschine_jam_light_encode(uint32_t light_status)
+{
+	uint32_t bright = (light_status >> 24) & 0x7F;
+	return bright | 0x2;
+}
+
+static inline uint8_t
+ni_maschine_jam_light_encode_rgb(uint32_t light_status)
+{
+	uint8_t hue = ctlra_palette_lookup(&jam_palette, light_status);
+	if(hue == JAM_PALETTE_GREY)
+		return ni_maschine_jam_light_encode(light_status);
+
+	/* palette colour, 2 bits of brightness */
+	uint32_t bright = (light_status >> 24) & 0x7F;
+	return (hue << 2) | (bright >> 5);
+}
+
+static inline void ni_maschine_jam_light_set(struct ctlra_dev_t *base,
 				    uint32_t light_id,
 				    uint32_t light_status)
 {
 	struct ni_maschine_jam_t *dev = (struct ni_maschine_jam_t *)base;
 	int ret;
 
-	if(!dev || light_id > NI_MASCHINE_JAM_LED_COUNT)
+	if(!dev || light_id >= NI_MASCHINE_JAM_LED_COUNT)
 		return;
 
-	/* write brighness to all LEDs */
-	uint32_t bright = (light_status >> 24) & 0x7F;
-/* base brightness */
-	dev->lights[light_id] = bright | 0x2;
+	/* light ids address the 0x80 report, whose LEDs are all single
+	 * colour */
+	dev->lights[light_id] = ni_maschine_jam_light_encode(light_status);
+	dev->lights_dirty = 1;
+}
+
+/* grid light ids are the 8x8 pads of the 0x81 report, which are RGB */
+static int32_t
+ni_maschine_jam_grid_light_set(struct ctlra_dev_t *base, uint32_t grid_id,
+			       uint32_t light_id, uint32_t light_status)
+{
+	struct ni_maschine_jam_t *dev = (struct ni_maschine_jam_t *)base;
+	if(grid_id != 0 || light_id >= 64)
+		return -ENOTSUP;
+
+	dev->grid_lights[9 + light_id] =
+		ni_maschine_jam_light_encode_rgb(light_status);
+	dev->lights_dirty = 1;
+	return 0;
+}
+
+static int32_t
+ni_maschine_jam_grid_frame_set(struct ctlra_dev_t *base, uint32_t grid_id,
+			       const uint32_t *rgb, uint32_t count)
+{
+	struct ni_maschine_jam_t *dev = (struct ni_maschine_jam_t *)base;
+	if(grid_id != 0)
+		return -ENOTSUP;
+
+	count = count > 64 ? 64 : count;
+	for(uint32_t p = 0; p < count; p++)
+		dev->grid_lights[9 + p] =
+			ni_maschine_jam_light_encode_rgb(rgb[p]);
+	dev->lights_dirty = 1;
+	return 0;
+}
+
+static void
+ni_maschine_jam_lights_set_frame(struct ctlra_dev_t *base,
+		   const uint32_t *ids, const uint32_t *values,
+		   uint32_t count)
+{
+	struct ni_maschine_jam_t *dev = (struct ni_maschine_jam_t *)base;
+
+	if(ids) {
+		for(uint32_t i = 0; i < count; i++)
+			ni_maschine_jam_light_set(base, ids[i], values[i]);
+		return;
+	}
+
+	/* dense: light ids index the 0x80 report directly */
+	if(count > NI_MASCHINE_JAM_LED_COUNT)
+		count = NI_MASCHINE_JAM_LED_COUNT;
+	for(uint32_t i = 0; i < count; i++)
+		dev->lights[i] = ni_maschine_jam_light_encode(values[i]);
+	if(count)
+		dev->lights_dirty = 1;
+}
+
+/* touchstrip LED values, as used for touch feedback */
+#define JAM_STRIP_BAR       30
+#define JAM_STRIP_PEAK      20
+
+static void
+ni_maschine_jam_strip_set(struct ctlra_dev_t *base, uint32_t fb_id,
+			  float value, float peak)
+{
+	struct ni_maschine_jam_t *dev = (struct ni_maschine_jam_t *)base;
+	if(fb_id >= FEEDBACK_SIZE)
+		return;
 
+	if(fb_id < JAM_FB_TOUCHSTRIP_1) {
+		uint32_t first = JAM_VU_LIGHT_FIRST + fb_id * 8;
+		for(uint32_t i = 0; i < 8; i++) {
+			int s = ctlra_dev_impl_strip_led(i, 8, value, peak);
+			ni_maschine_jam_light_set(base, first + i,
+						  s ? 0xff000000 : 0);
+		}
+		return;
+	}
+
+	uint8_t lights[11];
+	for(uint32_t i = 0; i < 11; i++) {
+		int s = ctlra_dev_impl_strip_led(i, 11, value, peak);
+		lights[i] = s == 1 ? JAM_STRIP_BAR :
+			    s == 2 ? JAM_STRIP_PEAK : 0;
+	}
+	ni_maschine_jam_touchstrip_led(base, fb_id - JAM_FB_TOUCHSTRIP_1,
+				       lights);
 	dev->lights_dirty = 1;
 }
 
+static void
+ni_maschine_jam_feedback_set(struct ctlra_dev_t *base, uint32_t fb_id,
+			     float value)
+{
+	ni_maschine_jam_strip_set(base, fb_id, value, 0.f);
+}
+
 uint8_t *
 ni_maschine_jam_grid_get_data(struct ctlra_dev_t *base)
 {
@@ -656,22 +820,32 @@ ni_maschine_jam_light_flush(struct ctlra_dev_t *base, uint32_t force)
 	int ret;
 
 	data[0] = 0x80;
-	ret = ctlra_dev_impl_usb_interrupt_write(base, USB_HANDLE_IDX,
-						     USB_ENDPOINT_WRITE,
-						     data,
-						     64+2);
+	ret = ctlra_dev_impl_lights_write(base, &dev->lights_shadow,
+					  USB_HANDLE_IDX,
+					  USB_ENDPOINT_WRITE,
+					  data,
+					  64+2, force);
 	if(ret < 0)
 		printf("%s write failed, ret %d\n", __func__, ret);
 
 	/* touchstrips */
 	dev->touchstrips[0] = 0x82;
-	ret = ctlra_dev_impl_usb_interrupt_write(base, USB_HANDLE_IDX,
-						     USB_ENDPOINT_WRITE,
-						     dev->touchstrips,
-						     88+2);
+	ret = ctlra_dev_impl_lights_write(base, &dev->touchstrips_shadow,
+					  USB_HANDLE_IDX,
+					  USB_ENDPOINT_WRITE,
+					  dev->touchstrips,
+					  88+2, force);
 	if(ret < 0)
 		printf("%s touchstrip write failed, ret %d\n", __func__, ret);
 
+	/* grid: only sent if changed, including the 2nd button write */
+	dev->grid_lights[0] = 0x81;
+	if(!force && dev->grid_shadow.valid &&
+	   memcmp(dev->grid_shadow.data, dev->grid_lights, GRID_SIZE) == 0) {
+		base->usb_xfer_counts[USB_XFER_LIGHTS_SUPPRESSED]++;
+		return;
+	}
+
 	/* writing the LED button a *second time* (see above) allows grid
 	 * messages to work afterwards. If this 2nd button data is removed,
 	 * the grid message later is ignored for some reason */
@@ -684,11 +858,11 @@ ni_maschine_jam_light_flush(struct ctlra_dev_t *base, uint32_t force)
 		printf("%s 2nd btn write failed, ret %d\n", __func__, ret);
 
 	/* grid */
-	dev->touchstrips[0] = 0x81;
-	ret = ctlra_dev_impl_usb_interrupt_write(base, USB_HANDLE_IDX,
-						     USB_ENDPOINT_WRITE,
-						     dev->touchstrips,
-						     79+2);
+	ret = ctlra_dev_impl_lights_write(base, &dev->grid_shadow,
+					  USB_HANDLE_IDX,
+					  USB_ENDPOINT_WRITE,
+					  dev->grid_lights,
+					  GRID_SIZE, 1);
 	if(ret < 0)
 		printf("%s grid write failed, ret %d\n", __func__, ret);
 }
@@ -702,6 +876,7 @@ ni_maschine_jam_disconnect(struct ctlra_dev_t *base)
 	memset(dev->lights, 0, sizeof(dev->lights));
 	memset(dev->grid, 0, sizeof(dev->grid));
 	memset(dev->touchstrips, 0, sizeof(dev->touchstrips));
+	memset(dev->grid_lights, 0, sizeof(dev->grid_lights));
 	if(!base->banished)
 		ni_maschine_jam_light_flush(base, 1);
 
@@ -737,9 +912,17 @@ ctlra_ni_maschine_jam_connect(ctlra_event_func event_func,
 	dev->base.poll = ni_maschine_jam_poll;
 	dev->base.disconnect = ni_maschine_jam_disconnect;
 	dev->base.light_set = ni_maschine_jam_light_set;
+	dev->base.lights_set_frame = ni_maschine_jam_lights_set_frame;
+	dev->base.grid_light_set = ni_maschine_jam_grid_light_set;
+	dev->base.grid_frame_set = ni_maschine_jam_grid_frame_set;
+	dev->base.strip_set = ni_maschine_jam_strip_set;
+	dev->base.feedback_set = ni_maschine_jam_feedback_set;
 	dev->base.light_flush = ni_maschine_jam_light_flush;
 	dev->base.usb_read_cb = ni_machine_jam_usb_read_cb;
 
+	ctlra_palette_init(&jam_palette, ctlra_palette_ni_hue,
+			   (void *)(uintptr_t)JAM_PALETTE_GREY);
+
 	dev->base.event_func = event_func;
 	dev->base.event_func_userdata = userdata;
 
@@ -773,15 +956,8 @@ struct ctlra_dev_info_t ctlra_ni_maschine_jam_info = {
 	*/
 	.control_info[CTLRA_EVENT_ENCODER] = encoder_info,
 
-	/* TODO: feedback items:
-	 * - 2 VU meter style LED strips
-	 *   Left  id: 38 to 45,
-	 *   Right id: 46 to 53
-	 */
-#if 0
 	.control_count[CTLRA_FEEDBACK_ITEM] = FEEDBACK_SIZE,
 	.control_info[CTLRA_FEEDBACK_ITEM] = feedback_info,
-#endif
 
 	.grid_info[0] = {
 		.rgb = 1,
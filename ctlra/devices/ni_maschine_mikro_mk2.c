@@ -29,6 +29,7 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
@@ -188,6 +189,7 @@ static struct ctlra_item_info_t feedback_info[] = {
 		.params[0] = 128, /* width px */
 		.params[1] = 64, /* height px */
 		.params[2] = 1, /* bits per pixel (not bytes) */
+		.params[3] = CTLRA_PIXEL_FORMAT_MONO1,
 	},
 };
 #define FEEDBACK_SIZE (sizeof(feedback_info) / sizeof(feedback_info[0]))
@@ -203,8 +205,18 @@ static struct ctlra_item_info_t feedback_info[] = {
 #define KERNEL_LENGTH          (8)
 #define KERNEL_MASK            (KERNEL_LENGTH-1)
 #define PAD_SENSITIVITY        (650)
-/* Screen: 1 byte endpoint, 8 bytes header, 256 bytes binary data */
-#define SCREEN_XFER_SIZE (1 + 8 + 256)
+#define PAD_PRESS_THRESHOLD    (550)
+#define PAD_RELEASE_THRESHOLD  (100)
+/* Velocity curve is sampled at 4 pressure units, 12 bit input */
+#define VELOCITY_LUT_SHIFT     (2)
+#define VELOCITY_LUT_SIZE      (4096 >> VELOCITY_LUT_SHIFT)
+/* Screen: 1 byte endpoint, 8 bytes header, 256 bytes binary data. The
+ * 128x64 px screen is sent in 4 segments of two 8 row pages each */
+#define SCREEN_HEADER_SIZE (1 + 8)
+#define SCREEN_SEGMENT_SIZE 256
+#define SCREEN_SEGMENTS 4
+#define SCREEN_SIZE (SCREEN_SEGMENT_SIZE * SCREEN_SEGMENTS)
+#define SCREEN_XFER_SIZE (SCREEN_HEADER_SIZE + SCREEN_SEGMENT_SIZE)
 
 
 /* Represents the the hardware device */
@@ -219,16 +231,25 @@ struct ni_maschine_mikro_mk2_t {
 	/* Lights endpoint used to transfer with hidapi */
 	uint8_t lights_endpoint;
 	uint8_t lights[LIGHTS_SIZE];
+	struct ctlra_lights_shadow_t lights_shadow;
 
 	/* Store the current encoder value */
 	uint8_t encoder_value;
-	/* Pressure filtering for note-onset detection */
-	uint8_t pad_idx[NPADS];
+	/* Pressure filtering for note-onset detection. The history is
+	 * stored slot-major so each sorting network stage below works on
+	 * 16 contiguous pads at once, which the compiler vectorizes */
+	uint8_t pad_idx;
 	uint16_t pads[NPADS];
-	uint16_t pad_avg[NPADS];
-	uint16_t pad_pressures[NPADS*KERNEL_LENGTH];
-
-	uint8_t screen_data[SCREEN_XFER_SIZE*4];
+	uint16_t pad_pressures[KERNEL_LENGTH][NPADS];
+	/* Continuous pressure stream state, opt-in by the application */
+	struct ctlra_grid_pressure_t pad_stream[NPADS];
+
+	/* screen pixels as drawn by the application, and as last sent.
+	 * Only segments that changed since are sent on flush */
+	uint8_t screen_px[SCREEN_SIZE];
+	uint8_t screen_sent[SCREEN_SIZE];
+	uint8_t screen_sent_valid;
+	uint8_t screen_xfer[SCREEN_XFER_SIZE];
 };
 
 static const char *
@@ -253,17 +274,59 @@ static uint32_t ni_maschine_mikro_mk2_poll(struct ctlra_dev_t *base)
 void
 ni_maschine_mikro_mk2_light_flush(struct ctlra_dev_t *base, uint32_t force);
 
-typedef uint16_t elem_type;
+/* pressure -> velocity curve, filled once by the first connect() */
+static float velocity_lut[VELOCITY_LUT_SIZE];
+static uint8_t velocity_lut_init;
 
-int compare(const void *f1, const void *f2)
+static void
+ni_maschine_mikro_mk2_velocity_lut_init(void)
 {
-	return ( *(elem_type*)f1 > *(elem_type*)f2) ? 1 : -1;
+	if(velocity_lut_init)
+		return;
+	for(int i = 0; i < VELOCITY_LUT_SIZE; i++) {
+		int med = i << VELOCITY_LUT_SHIFT;
+		/* TODO: improve velocity linearity */
+		float velo = (med - PAD_PRESS_THRESHOLD) / 3500.f;
+		float v2 = velo * velo * velo * velo;
+		float fin = (velo - v2) * 3;
+		fin = fin > 1.0f ? 1.0f : fin;
+		fin = fin < 0.0f ? 0.0f : fin;
+		velocity_lut[i] = fin;
+	}
+	velocity_lut_init = 1;
 }
 
-elem_type qsort_median(elem_type * array, int n)
+/* Compare-exchange one sorting network stage for all pads. The
+ * ternaries compile to min/max, so there are no data dependent branches */
+static inline void
+pad_cx(uint16_t s[KERNEL_LENGTH][NPADS], int a, int b)
 {
-	qsort(array, n, sizeof(elem_type), compare);
-	return array[n/2];
+	for(int p = 0; p < NPADS; p++) {
+		uint16_t lo = s[a][p] < s[b][p] ? s[a][p] : s[b][p];
+		uint16_t hi = s[a][p] < s[b][p] ? s[b][p] : s[a][p];
+		s[a][p] = lo;
+		s[b][p] = hi;
+	}
+}
+
+/* Median of the KERNEL_LENGTH history samples of every pad, using an
+ * optimal 19 comparator network for 8 inputs. The result is the upper
+ * median (sorted[4]), the same element qsort() based filtering picked */
+static void
+ni_maschine_mikro_mk2_pad_median(struct ni_maschine_mikro_mk2_t *dev,
+				 uint16_t med[NPADS])
+{
+	uint16_t s[KERNEL_LENGTH][NPADS];
+	memcpy(s, dev->pad_pressures, sizeof(s));
+
+	pad_cx(s, 0, 2); pad_cx(s, 1, 3); pad_cx(s, 4, 6); pad_cx(s, 5, 7);
+	pad_cx(s, 0, 4); pad_cx(s, 1, 5); pad_cx(s, 2, 6); pad_cx(s, 3, 7);
+	pad_cx(s, 0, 1); pad_cx(s, 2, 3); pad_cx(s, 4, 5); pad_cx(s, 6, 7);
+	pad_cx(s, 2, 4); pad_cx(s, 3, 5);
+	pad_cx(s, 1, 4); pad_cx(s, 3, 6);
+	pad_cx(s, 1, 2); pad_cx(s, 3, 4); pad_cx(s, 5, 6);
+
+	memcpy(med, s[KERNEL_LENGTH/2], sizeof(uint16_t) * NPADS);
 }
 
 void
@@ -273,130 +336,143 @@ ni_maschine_mikro_mk2_usb_read_cb(struct ctlra_dev_t *base,
 {
 	struct ni_maschine_mikro_mk2_t *dev =
 		(struct ni_maschine_mikro_mk2_t *)base;
-	static double worst_poll;
-	int32_t nbytes = size;
+	uint8_t *buf = data;
+
+	switch(size) {
+	case 65: {
+		int i;
+		uint8_t idx = dev->pad_idx++ & KERNEL_MASK;
+		for (i = 0; i < NPADS; i++) {
+			uint16_t new = ((data[i*2+2] & 0xf) << 8) |
+					 data[i*2+1];
+			dev->pad_pressures[idx][i] = new;
+		}
 
-	int count = 0;
+		uint16_t med[NPADS];
+		ni_maschine_mikro_mk2_pad_median(dev, med);
+
+		/* Pad state changes are sent as one batch, and the pad LEDs
+		 * are written once per report instead of once per hit */
+		struct ctlra_event_t events[NPADS];
+		struct ctlra_event_t *e[NPADS];
+		uint32_t n_events = 0;
+		uint32_t n_changes = 0;
+		uint64_t now = 0;
+		if(dev->base.grid_pressure[0].interval_ns)
+			now = ctlra_impl_time_ns();
+
+		for (i = 0; i < NPADS; i++) {
+			struct ctlra_event_t *ev = &events[n_events];
+			float pressure = med[i] * (1 / 4096.f);
+			int pressed;
+			if(med[i] > PAD_PRESS_THRESHOLD && dev->pads[i] == 0) {
+				pressed = 1;
+				ctlra_dev_impl_grid_pressure_reset(
+					&dev->pad_stream[i], now, pressure);
+			} else if(med[i] < PAD_RELEASE_THRESHOLD && dev->pads[i] > 0) {
+				pressed = 0;
+			} else {
+				if(dev->pads[i] && ctlra_dev_impl_grid_pressure_due(
+						&dev->base, 0, &dev->pad_stream[i],
+						now, pressure)) {
+					*ev = (struct ctlra_event_t) {
+						.type = CTLRA_EVENT_GRID,
+						.grid  = {
+							.id = 0,
+							.flags = CTLRA_EVENT_GRID_FLAG_PRESSURE,
+							.pos = i,
+							.pressed = 1,
+							.pressure = pressure,
+						},
+					};
+					e[n_events++] = ev;
+				}
+				continue;
+			}
+
+			*ev = (struct ctlra_event_t) {
+				.type = CTLRA_EVENT_GRID,
+				.grid  = {
+					.id = 0,
+					.flags = CTLRA_EVENT_GRID_FLAG_BUTTON,
+					.pos = i,
+					.pressed = pressed,
+					.pressure = pressed ? velocity_lut[med[i] >>
+						VELOCITY_LUT_SHIFT] : 0.f,
+				},
+			};
+			e[n_events++] = ev;
 
-	do {
-		uint8_t *buf = data;
+			dev->lights[NI_MASCHINE_MIKRO_MK2_LED_PAD_1+3+i*3] =
+				pressed ? 0x7f : 0;
+			dev->pads[i] = pressed ? 2000 : 0;
+			n_changes++;
+		}
 
-		switch(nbytes) {
-		case 65: {
-			int i;
-			for (i = 0; i < NPADS; i++) {
-				uint16_t new = ((data[i*2+2] & 0xf) << 8) |
-						 data[i*2+1];
+		if(n_changes) {
+			dev->lights_dirty = 1;
+			ni_maschine_mikro_mk2_light_flush(&dev->base, 0);
+		}
+		if(n_events) {
+			dev->base.event_func(&dev->base, n_events, e,
+					     dev->base.event_func_userdata);
+		}
+	}
+	break;
+	case 6: {
+		/* Encoder */
+		struct ctlra_event_t event = {
+			.type = CTLRA_EVENT_ENCODER,
+			.encoder = {
+				.id = NI_MASCHINE_MIKRO_MK2_BTN_ENCODER_ROTATE,
+				.flags = CTLRA_EVENT_ENCODER_FLAG_INT,
+				.delta = 0,
+			},
+		};
+		struct ctlra_event_t *e = {&event};
+		int8_t enc   = ((buf[5] & 0x0f)     ) & 0xf;
+		if(enc != dev->encoder_value) {
+			int dir = ctlra_dev_encoder_wrap_16(enc, dev->encoder_value);
+			event.encoder.delta = dir;
+			dev->encoder_value = enc;
+			dev->base.event_func(&dev->base, 1, &e,
+					     dev->base.event_func_userdata);
+		}
 
-				uint8_t idx = dev->pad_idx[i]++ & KERNEL_MASK;
+		/* Buttons */
+		for(uint32_t i = 0; i < BUTTONS_SIZE; i++) {
+			int id     = buttons[i].event_id;
+			int offset = buttons[i].buf_byte_offset;
+			int mask   = buttons[i].mask;
 
-				uint16_t total = 0;
-				for(int j = 0; j < KERNEL_LENGTH; j++) {
-					int idx = i*KERNEL_LENGTH + j;
-					total += dev->pad_pressures[idx];
-				}
+			uint16_t v = *((uint16_t *)&buf[offset]) & mask;
+			int value_idx = i;
 
-				dev->pad_avg[i] = total / KERNEL_LENGTH;
-				dev->pad_pressures[i*KERNEL_LENGTH + idx] = new;
+			if(dev->hw_values[value_idx] != v) {
+				//printf("%s %d\n",
+				//ni_maschine_mikro_mk2_control_names[i], i);
+				dev->hw_values[value_idx] = v;
 
 				struct ctlra_event_t event = {
-					.type = CTLRA_EVENT_GRID,
-					.grid  = {
-						.id = 0,
-						.flags = CTLRA_EVENT_GRID_FLAG_BUTTON,
-						.pos = i,
-						.pressed = 1
+					.type = CTLRA_EVENT_BUTTON,
+					.button  = {
+						.id = id,
+						.pressed = v > 0
 					},
 				};
 				struct ctlra_event_t *e = {&event};
-
-				uint16_t med = qsort_median(
-					&dev->pad_pressures[i*KERNEL_LENGTH],
-					KERNEL_LENGTH);
-
-				if(med > 550 && dev->pads[i] == 0) {
-					/* TODO: improve velocity linearity */
-					float velo = (med - 550) / 3500.f;
-					float v2 = velo * velo * velo * velo;
-					float fin = (velo - v2) * 3;
-					fin = fin > 1.0f ? 1.0f : fin;
-					fin = fin < 0.0f ? 0.0f : fin;
-					e->grid.pressure = fin;
-					dev->base.event_func(&dev->base, 1, &e,
-					                     dev->base.event_func_userdata);
-					dev->lights[NI_MASCHINE_MIKRO_MK2_LED_PAD_1+3+i*3] = 0x7f;
-					dev->lights_dirty = 1;
-					ni_maschine_mikro_mk2_light_flush(&dev->base, 1);
-					dev->pads[i] = 2000;
-				} else if(med < 100 && dev->pads[i] > 0) {
-					dev->lights[NI_MASCHINE_MIKRO_MK2_LED_PAD_1+3+i*3] = 0;
-					dev->lights_dirty = 1;
-					ni_maschine_mikro_mk2_light_flush(&dev->base, 1);
-					dev->pads[i] = 0;
-					event.grid.pressed = 0;
-					event.grid.pressure = 0.f;
-					dev->base.event_func(&dev->base, 1, &e,
-					                     dev->base.event_func_userdata);
-				}
-			}
-		}
-		break;
-		case 6: {
-			/* Encoder */
-			struct ctlra_event_t event = {
-				.type = CTLRA_EVENT_ENCODER,
-				.encoder = {
-					.id = NI_MASCHINE_MIKRO_MK2_BTN_ENCODER_ROTATE,
-					.flags = CTLRA_EVENT_ENCODER_FLAG_INT,
-					.delta = 0,
-				},
-			};
-			struct ctlra_event_t *e = {&event};
-			int8_t enc   = ((buf[5] & 0x0f)     ) & 0xf;
-			if(enc != dev->encoder_value) {
-				int dir = ctlra_dev_encoder_wrap_16(enc, dev->encoder_value);
-				event.encoder.delta = dir;
-				dev->encoder_value = enc;
 				dev->base.event_func(&dev->base, 1, &e,
 						     dev->base.event_func_userdata);
 			}
-
-			/* Buttons */
-			for(uint32_t i = 0; i < BUTTONS_SIZE; i++) {
-				int id     = buttons[i].event_id;
-				int offset = buttons[i].buf_byte_offset;
-				int mask   = buttons[i].mask;
-
-				uint16_t v = *((uint16_t *)&buf[offset]) & mask;
-				int value_idx = i;
-
-				if(dev->hw_values[value_idx] != v) {
-					//printf("%s %d\n",
-					//ni_maschine_mikro_mk2_control_names[i], i);
-					dev->hw_values[value_idx] = v;
-
-					struct ctlra_event_t event = {
-						.type = CTLRA_EVENT_BUTTON,
-						.button  = {
-							.id = id,
-							.pressed = v > 0
-						},
-					};
-					struct ctlra_event_t *e = {&event};
-					dev->base.event_func(&dev->base, 1, &e,
-					                     dev->base.event_func_userdata);
-				}
-			}
-			break;
-		}
 		}
+		break;
+	}
+	}
 
-		/* LIBUSB - no re-reading! */
-		if(count++ < 10)
-			ni_maschine_mikro_mk2_poll(base);
-		else
-			break;
-	} while (nbytes > 0);
+	/* Keep one read in flight per completed report. This used to
+	 * re-submit up to 10 reads from inside the callback, which piled
+	 * up transfers under load without reading any faster */
+	ni_maschine_mikro_mk2_poll(base);
 }
 
 static void ni_maschine_mikro_mk2_light_set(struct ctlra_dev_t *base,
@@ -446,6 +522,20 @@ static void ni_maschine_mikro_mk2_light_set(struct ctlra_dev_t *base,
 	dev->lights_dirty = 1;
 }
 
+static int32_t
+ni_maschine_mikro_mk2_grid_frame_set(struct ctlra_dev_t *base,
+				     uint32_t grid_id, const uint32_t *rgb,
+				     uint32_t count)
+{
+	if(grid_id != 0)
+		return -ENOTSUP;
+	count = count > NPADS ? NPADS : count;
+	for(uint32_t p = 0; p < count; p++)
+		ni_maschine_mikro_mk2_light_set(base,
+			NI_MASCHINE_MIKRO_MK2_LED_PAD_1 + p, rgb[p]);
+	return 0;
+}
+
 void
 ni_maschine_mikro_mk2_light_flush(struct ctlra_dev_t *base, uint32_t force)
 {
@@ -457,17 +547,18 @@ ni_maschine_mikro_mk2_light_flush(struct ctlra_dev_t *base, uint32_t force)
 	dev->lights_endpoint = 0x80;
 
 	/* error handling in USB subsystem */
-	ctlra_dev_impl_usb_interrupt_write(base,
-					   USB_HANDLE_IDX,
-					   USB_ENDPOINT_WRITE,
-					   data,
-					   LIGHTS_SIZE + 1);
+	ctlra_dev_impl_lights_write(base, &dev->lights_shadow,
+				    USB_HANDLE_IDX,
+				    USB_ENDPOINT_WRITE,
+				    data,
+				    LIGHTS_SIZE + 1, force);
 }
 
 static void
-maschine_mikro_mk2_blit_to_screen(struct ni_maschine_mikro_mk2_t *dev)
+maschine_mikro_mk2_blit_to_screen(struct ni_maschine_mikro_mk2_t *dev,
+				  int force)
 {
-	const uint8_t xfer_header[9] = {
+	const uint8_t xfer_header[SCREEN_HEADER_SIZE] = {
 		0xE0, /* 0 */
 		   0, /* 1: overwritten by "segment offset" */
 		   0, /* 2 */
@@ -479,36 +570,30 @@ maschine_mikro_mk2_blit_to_screen(struct ni_maschine_mikro_mk2_t *dev)
 		   0, /* 8 */
 	};
 
-	/* "Stripe" test the screen for accuracy of markings:
-	dev->screen_data[9+0*SCREEN_XFER_SIZE] = -1;
-	dev->screen_data[9+1*SCREEN_XFER_SIZE-9] = -1;
-	dev->screen_data[9+2*SCREEN_XFER_SIZE-18] = -1;
-	dev->screen_data[9+3*SCREEN_XFER_SIZE-27] = -1;
-	*/
+	if(!dev->screen_sent_valid)
+		force = 1;
 
-	int i, j;
-	for (i = 0; i < 4; i++) {
-		/* offset magic: to avoid using multiple buffers, we
-		 * over-write the already sent bitmap data. It is
-		 * over-written by the header for the next segment, which
-		 * allows sending the data without memcpy(). 9 is the
-		 * number of bytes required for the endpoint + header */
-		int offset = -(i * 9);
-		int idx = i * SCREEN_XFER_SIZE + offset;
-		uint8_t *data = &dev->screen_data[idx];
-
-		/* write header + segment directly to data buffer */
-		for (j = 0; j < 9; j++)
-			data[j] = xfer_header[j];
+	uint8_t *data = dev->screen_xfer;
+	for(int i = 0; i < SCREEN_SEGMENTS; i++) {
+		uint8_t *px = &dev->screen_px[i * SCREEN_SEGMENT_SIZE];
+		uint8_t *sent = &dev->screen_sent[i * SCREEN_SEGMENT_SIZE];
+		if(!force && memcmp(px, sent, SCREEN_SEGMENT_SIZE) == 0)
+			continue;
 
+		memcpy(data, xfer_header, SCREEN_HEADER_SIZE);
 		data[1] = i * 32;
-
-		ctlra_dev_impl_usb_interrupt_write(&dev->base,
-						   USB_HANDLE_IDX,
-						   USB_ENDPOINT_WRITE,
-						   data,
-						   SCREEN_XFER_SIZE);
+		memcpy(&data[SCREEN_HEADER_SIZE], px, SCREEN_SEGMENT_SIZE);
+
+		int ret = ctlra_dev_impl_usb_interrupt_write(&dev->base,
+							     USB_HANDLE_IDX,
+							     USB_ENDPOINT_WRITE,
+							     data,
+							     SCREEN_XFER_SIZE);
+		/* a segment that wasn't sent is retried on the next flush */
+		if(ret > 0)
+			memcpy(sent, px, SCREEN_SEGMENT_SIZE);
 	}
+	dev->screen_sent_valid = 1;
 }
 
 int32_t
@@ -522,12 +607,11 @@ ni_maschine_mikro_mk2_screen_get_data(struct ctlra_dev_t *base,
 	struct ni_maschine_mikro_mk2_t *dev = (struct ni_maschine_mikro_mk2_t *)base;
 
 	if(flush)
-		maschine_mikro_mk2_blit_to_screen(dev);
+		maschine_mikro_mk2_blit_to_screen(dev, flush == 3);
 
-	/* skip past the first header */
-	*pixels = &dev->screen_data[9];
+	*pixels = dev->screen_px;
 	/* 128 * 64 pixels, but / 8 pixels per byte */
-	*bytes = (128 * 64) / 8;
+	*bytes = SCREEN_SIZE;
 
 	return 0;
 }
@@ -540,8 +624,8 @@ ni_maschine_mikro_mk2_disconnect(struct ctlra_dev_t *base)
 	memset(dev->lights, 0x0, LIGHTS_SIZE);
 	if(!base->banished) {
 		ni_maschine_mikro_mk2_light_flush(base, 1);
-		memset(&dev->screen_data[9], 0, sizeof(SCREEN_XFER_SIZE*4));
-		maschine_mikro_mk2_blit_to_screen(dev);
+		memset(dev->screen_px, 0, sizeof(dev->screen_px));
+		maschine_mikro_mk2_blit_to_screen(dev, 0);
 	}
 
 	ctlra_dev_impl_usb_close(base);
@@ -593,20 +677,25 @@ ctlra_ni_maschine_mikro_mk2_connect(ctlra_event_func event_func,
 	grid->pressure = 1;
 	grid->x = 4;
 	grid->y = 4;
+	dev->base.grid_pressure_caps = 1 << 0;
 
 	dev->base.info.vendor_id = CTLRA_DRIVER_VENDOR;
 	dev->base.info.device_id = CTLRA_DRIVER_DEVICE;
+	dev->base.mem_bytes = sizeof(*dev);
 
 	dev->base.poll = ni_maschine_mikro_mk2_poll;
 	dev->base.disconnect = ni_maschine_mikro_mk2_disconnect;
 	dev->base.light_set = ni_maschine_mikro_mk2_light_set;
+	dev->base.grid_frame_set = ni_maschine_mikro_mk2_grid_frame_set;
 	dev->base.light_flush = ni_maschine_mikro_mk2_light_flush;
 	dev->base.screen_get_data = ni_maschine_mikro_mk2_screen_get_data;
 
 	dev->base.event_func = event_func;
 	dev->base.event_func_userdata = userdata;
 
-	maschine_mikro_mk2_blit_to_screen(dev);
+	ni_maschine_mikro_mk2_velocity_lut_init();
+
+	maschine_mikro_mk2_blit_to_screen(dev, 1);
 
 	return (struct ctlra_dev_t *)dev;
 fail:
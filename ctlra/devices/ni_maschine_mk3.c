@@ -29,6 +29,7 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
@@ -40,6 +41,8 @@
 #include <sys/time.h>
 
 #include "impl.h"
+#include "palette.h"
+#include "ni_screen.h"
 
 // Uncomment to debug pad on/off
 //#define CTLRA_MK3_PADS 1
@@ -336,18 +339,22 @@ static struct ctlra_item_info_t sliders_info[] = {
 static struct ctlra_item_info_t feedback_info[] = {
 	/* Screen */
 	{.x =  88, .y =  33, .w = 94,  .h = 54, .flags = CTLRA_ITEM_FB_SCREEN,
-		.params[0] = 480, .params[1] = 272},
+		.params = {480, 272, 16, CTLRA_PIXEL_FORMAT_RGB565_BE}},
 	{.x = 200, .y =  33, .w = 94,  .h = 54, .flags = CTLRA_ITEM_FB_SCREEN,
-		.params[0] = 480, .params[1] = 272},
+		.params = {480, 272, 16, CTLRA_PIXEL_FORMAT_RGB565_BE}},
+	/* Touchstrip LEDs: light ids 62 to 86 */
+	{.x = 9, .y = 181, .w = 109, .h = 3, .flags = CTLRA_ITEM_FB_LED_STRIP,
+		.params = {62, 87, 1, 0}},
 	/* TODO: expose LED ids:
 	 * up    : 58
 	 * left  : 59
 	 * right : 60
 	 * down  : 61
-	 * Strip : 62 -> 86
 	 */
 };
 #define FEEDBACK_SIZE (sizeof(feedback_info) / sizeof(feedback_info[0]))
+/* feedback id of the touchstrip LEDs */
+#define MK3_FB_STRIP 2
 
 static const char *encoder_names[] = {
 	"Enc. Turn",
@@ -419,6 +426,16 @@ struct ni_screen_t {
 	uint8_t footer [sizeof(footer)];
 };
 
+/* Screen memory, allocated on first use of a screen so applications
+ * that don't draw don't pay for it */
+struct ni_maschine_mk3_screens_t {
+	struct ni_screen_t scr[2];
+	/* partial updates and diffs are encoded here, see ni_screen.h */
+	uint8_t cmd[NI_SCREEN_PARTIAL_MAX];
+	/* last frame sent to each screen, full redraws send the diff */
+	struct ni_screen_diff_t diff[2];
+};
+
 /* Represents the the hardware device */
 struct ni_maschine_mk3_t {
 	/* base handles usb i/o etc */
@@ -435,6 +452,9 @@ struct ni_maschine_mk3_t {
 
 	uint8_t lights_pads_endpoint;
 	uint8_t lights_pads[LIGHTS_PADS_SIZE];
+	/* last sent button and pad reports, only changed ones are sent */
+	struct ctlra_lights_shadow_t lights_shadow;
+	struct ctlra_lights_shadow_t lights_pads_shadow;
 	uint8_t pad_colour;
 
 	/* state of the pedal, according to the hardware */
@@ -447,9 +467,16 @@ struct ni_maschine_mk3_t {
 	uint16_t pad_hit;
 	uint16_t pad_idx[NPADS];
 	uint16_t pad_pressures[NPADS*KERNEL_LENGTH];
-
-	struct ni_screen_t screen_left;
-	struct ni_screen_t screen_right;
+	/* Continuous pressure stream state, opt-in by the application.
+	 * The period is a running estimate of the time between pad
+	 * reports, used to timestamp set A half a report before set B */
+	uint64_t pad_period_ns;
+	struct ctlra_grid_pressure_t pad_stream[NPADS];
+
+	struct ni_maschine_mk3_screens_t *screens;
+	/* pixels set by screen_set_pixels, read instead of the screen's
+	 * own pixels when not NULL */
+	uint8_t *screen_ext[2];
 };
 
 static const char *
@@ -462,6 +489,8 @@ ni_maschine_mk3_control_get_name(enum ctlra_event_type_t type,
 		return encoder_names[control_id];
 	if(type == CTLRA_EVENT_SLIDER && control_id == 0)
 		return "Touchstrip";
+	if(type == CTLRA_FEEDBACK_ITEM && control_id == MK3_FB_STRIP)
+		return "Touchstrip LEDs";
 	return 0;
 }
 
@@ -489,7 +518,7 @@ static const uint8_t pad_cols[] = {
 
 static void
 ni_maschine_mk3_pads_decode_set(struct ni_maschine_mk3_t *dev,
-				uint8_t *buf)
+				uint8_t *buf, uint64_t sample_ns)
 {
 	/* This function decodes a single 64 byte pads message. See
 	 * comments in calling code to understand how sets work */
@@ -507,8 +536,9 @@ ni_maschine_mk3_pads_decode_set(struct ni_maschine_mk3_t *dev,
 
 	/* pre-process pressed pads into bitmask. Keep state from before,
 	 * the messages will update only those that have changed */
-	uint16_t pad_pressures[16];
+	uint16_t pad_pressures[16] = {0};
 	uint16_t rpt_pressed = dev->pad_hit;
+	uint16_t rpt_listed = 0;
 	int flush_lights = 0;
 	uint8_t d1, d2;
 	int i;
@@ -531,21 +561,47 @@ ni_maschine_mk3_pads_decode_set(struct ni_maschine_mk3_t *dev,
 
 		/* store pressure value for setting in event later */
 		pad_pressures[p] = pressure;
+		rpt_listed |= 1 << p;
 	}
 
+	/* pressure of held pads, batched into one callback per set */
+	struct ctlra_event_t stream[NPADS];
+	struct ctlra_event_t *stream_e[NPADS];
+	uint32_t n_stream = 0;
+
 	for(int i = 0; i < 16; i++) {
 		/* detect state change */
 		int current = (dev->pad_hit & (1 << i));
 		int new     = (rpt_pressed  & (1 << i));
-		if(current == new)
-			continue;
-
 		/* rotate grid to match order on device (but zero
 		 * based counting instead of 1 based). */
-		event.grid.pos = (3-(i/4))*4 + (i%4);
+		int pos = (3-(i/4))*4 + (i%4);
+		float pressure = pad_pressures[i] * (1 / 4096.f);
+
+		if(current == new) {
+			if(new && (rpt_listed & (1 << i)) &&
+			   ctlra_dev_impl_grid_pressure_due(&dev->base, 0,
+							    &dev->pad_stream[i],
+							    sample_ns,
+							    pressure)) {
+				stream[n_stream] = event;
+				stream[n_stream].grid.flags =
+					CTLRA_EVENT_GRID_FLAG_PRESSURE;
+				stream[n_stream].grid.pos = pos;
+				stream[n_stream].grid.pressure = pressure;
+				stream_e[n_stream] = &stream[n_stream];
+				n_stream++;
+			}
+			continue;
+		}
+
+		event.grid.pos = pos;
 		int press = new > 0;
 		event.grid.pressed = press;
-		event.grid.pressure = pad_pressures[i] * (1 / 4096.f) * press;
+		event.grid.pressure = pressure * press;
+		if(press)
+			ctlra_dev_impl_grid_pressure_reset(&dev->pad_stream[i],
+							   sample_ns, pressure);
 
 		dev->base.event_func(&dev->base, 1, &e,
 				     dev->base.event_func_userdata);
@@ -555,6 +611,10 @@ ni_maschine_mk3_pads_decode_set(struct ni_maschine_mk3_t *dev,
 #endif
 	}
 
+	if(n_stream)
+		dev->base.event_func(&dev->base, n_stream, stream_e,
+				     dev->base.event_func_userdata);
+
 	dev->pad_hit = rpt_pressed;
 }
 
@@ -596,9 +656,25 @@ ni_maschine_mk3_pads(struct ni_maschine_mk3_t *dev,
 	}
 	printf("\n");
 #endif
+	/* Timestamps are only needed for the pressure stream. Set B is
+	 * taken as sampled on arrival, set A half a report period before,
+	 * which doubles the temporal resolution of streamed pressure */
+	uint64_t now = 0;
+	uint64_t half = 0;
+	if(dev->base.grid_pressure[0].interval_ns) {
+		now = ctlra_impl_time_ns();
+		uint64_t delta = now - dev->pad_last_msg_time;
+		/* ignore gaps where the device stopped reporting */
+		if(dev->pad_last_msg_time && delta < 20000000)
+			dev->pad_period_ns = dev->pad_period_ns ?
+				(dev->pad_period_ns * 7 + delta) / 8 : delta;
+		dev->pad_last_msg_time = now;
+		half = dev->pad_period_ns / 2;
+	}
+
 	/* call for Set A, then again for set B */
-	ni_maschine_mk3_pads_decode_set(dev, &buf[0]);
-	ni_maschine_mk3_pads_decode_set(dev, &buf[64]);
+	ni_maschine_mk3_pads_decode_set(dev, &buf[0], now - half);
+	ni_maschine_mk3_pads_decode_set(dev, &buf[64], now);
 };
 
 void
@@ -741,7 +817,20 @@ ni_maschine_mk3_usb_read_cb(struct ctlra_dev_t *base,
 	}
 }
 
-static void ni_maschine_mk3_light_set(struct ctlra_dev_t *base,
+/* RGB to hue index, the device takes a H value instead of RGB. White is
+ * 0xff, of which the lower 6 bits survive shifting in the brightness */
+static struct ctlra_palette_t mk3_palette;
+
+static inline uint8_t
+ni_maschine_mk3_light_hue(uint32_t light_status)
+{
+	/* if the input was totally zero, set the LED off */
+	if(light_status == 0)
+		return 0;
+	return ctlra_palette_lookup(&mk3_palette, light_status);
+}
+
+static inline void ni_maschine_mk3_light_set(struct ctlra_dev_t *base,
                 uint32_t light_id,
                 uint32_t light_status)
 {
@@ -756,44 +845,8 @@ static void ni_maschine_mk3_light_set(struct ctlra_dev_t *base,
 		return;
 
 	int idx = light_id;
-	const uint8_t r = ((light_status >> 16) & 0xFF);
-	const uint8_t g = ((light_status >>  8) & 0xFF);
-	const uint8_t b = ((light_status >>  0) & 0xFF);
-
-	uint8_t max = r > g ? r : g;
-	max = b > max ? b : max;
-	uint8_t min = r < g ? r : g;
-	min = b < min ? b : min;
-
-	/* rgb to hsv: nasty, but the device requires a H value input,
-	 * so we have to calculate it here. Icky branchy divide-y... */
-	uint8_t v = max;
-	uint8_t h, s;
-	if (v == 0 || (max - min) == 0) {
-		h = 0;
-		s = 0;
-	} else {
-		s = 255 * (max - min) / v;
-		if (s == 0)
-			h = 0;
-		if (max == r)
-			h = 0 + 43 * (g - b) / (max - min);
-		else if (max == g)
-			h = 85 + 43 * (b - r) / (max - min);
-		else
-			h = 171 + 43 * (r - g) / (max - min);
-	}
-
 	uint32_t bright = light_status >> 27;
-	uint8_t hue = h / 16 + 1;
-
-	/* if equal components, then set white */
-	if(r == g && r == b)
-		hue = 0xff;
-
-	/* if the input was totally zero, set the LED off */
-	if(light_status == 0)
-		hue = 0;
+	uint8_t hue = ni_maschine_mk3_light_hue(light_status);
 
 	/* normal LEDs */
 	if(idx < LIGHTS_SIZE) {
@@ -824,6 +877,89 @@ static void ni_maschine_mk3_light_set(struct ctlra_dev_t *base,
 	}
 }
 
+static int32_t
+ni_maschine_mk3_grid_frame_set(struct ctlra_dev_t *base, uint32_t grid_id,
+			       const uint32_t *rgb, uint32_t count)
+{
+	if(grid_id != 0)
+		return -ENOTSUP;
+	count = count > NPADS ? NPADS : count;
+	for(uint32_t p = 0; p < count; p++) {
+		/* grid positions are rotated from the pad LED order, see
+		 * the pads decode. The pad LEDs start at light id 87 */
+		uint32_t hw = (3-(p/4))*4 + (p%4);
+		ni_maschine_mk3_light_set(base, LIGHTS_SIZE + 25 + hw, rgb[p]);
+	}
+	return 0;
+}
+
+static void
+ni_maschine_mk3_strip_set(struct ctlra_dev_t *base, uint32_t fb_id,
+			  float value, float peak)
+{
+	if(fb_id != MK3_FB_STRIP)
+		return;
+
+	for(uint32_t i = 0; i < 25; i++) {
+		int s = ctlra_dev_impl_strip_led(i, 25, value, peak);
+		ni_maschine_mk3_light_set(base, LIGHTS_SIZE + i,
+					  s == 1 ? 0xff00ff00 :
+					  s == 2 ? 0xffff0000 : 0);
+	}
+}
+
+static void
+ni_maschine_mk3_feedback_set(struct ctlra_dev_t *base, uint32_t fb_id,
+			     float value)
+{
+	ni_maschine_mk3_strip_set(base, fb_id, value, 0.f);
+}
+
+static void
+ni_maschine_mk3_lights_set_frame(struct ctlra_dev_t *base,
+		   const uint32_t *ids, const uint32_t *values,
+		   uint32_t count)
+{
+	struct ni_maschine_mk3_t *dev = (struct ni_maschine_mk3_t *)base;
+
+	if(ids) {
+		for(uint32_t i = 0; i < count; i++)
+			ni_maschine_mk3_light_set(base, ids[i], values[i]);
+		return;
+	}
+
+	/* dense: ids 0 .. LIGHTS_SIZE-1 are lights[] as is, followed by
+	 * 25 strip + 16 pad LEDs in lights_pads[] */
+	uint32_t n = count < LIGHTS_SIZE ? count : LIGHTS_SIZE;
+	for(uint32_t i = 0; i < n; i++)
+		dev->lights[i] = values[i] >> 27;
+
+	/* buttons with a hue: Sampling, ABCDEFGH, encoder directions */
+	static const uint8_t hue_ids[] = {
+		5, 29, 30, 31, 32, 33, 34, 35, 36, 58, 59, 60, 61,
+	};
+	for(uint32_t i = 0; i < sizeof(hue_ids); i++) {
+		uint32_t id = hue_ids[i];
+		if(id >= n)
+			break;
+		uint8_t hue = ni_maschine_mk3_light_hue(values[id]);
+		dev->lights[id] = (hue << 2) | ((values[id] >> 29) & 0x3);
+	}
+	if(n)
+		dev->lights_dirty = 1;
+
+	uint32_t end = LIGHTS_SIZE + 25 + 16;
+	if(count < end)
+		end = count;
+	for(uint32_t i = LIGHTS_SIZE; i < end; i++) {
+		uint8_t hue = ni_maschine_mk3_light_hue(values[i]);
+		uint32_t bright = values[i] >> 27;
+		dev->lights_pads[i - LIGHTS_SIZE] = (hue << 2) | (bright & 0x3);
+	}
+	if(end > LIGHTS_SIZE)
+		dev->lights_pads_dirty = 1;
+}
+
 void
 ni_maschine_mk3_light_flush(struct ctlra_dev_t *base, uint32_t force)
 {
@@ -835,77 +971,73 @@ ni_maschine_mk3_light_flush(struct ctlra_dev_t *base, uint32_t force)
 	dev->lights_endpoint = 0x80;
 
 	/* error handling in USB subsystem */
-	ctlra_dev_impl_usb_interrupt_write(base,
-					   USB_HANDLE_IDX,
-					   USB_ENDPOINT_WRITE,
-					   data,
-					   LIGHTS_SIZE + 1);
+	ctlra_dev_impl_lights_write(base, &dev->lights_shadow,
+				    USB_HANDLE_IDX,
+				    USB_ENDPOINT_WRITE,
+				    data,
+				    LIGHTS_SIZE + 1, force);
 
 	data = &dev->lights_pads_endpoint;
 	dev->lights_pads_endpoint = 0x81;
-	ctlra_dev_impl_usb_interrupt_write(base,
-					   USB_HANDLE_IDX,
-					   USB_ENDPOINT_WRITE,
-					   data,
-					   LIGHTS_SIZE + 1);
+	ctlra_dev_impl_lights_write(base, &dev->lights_pads_shadow,
+				    USB_HANDLE_IDX,
+				    USB_ENDPOINT_WRITE,
+				    data,
+				    LIGHTS_SIZE + 1, force);
+}
+
+static struct ni_maschine_mk3_screens_t *
+maschine_mk3_screens_get(struct ni_maschine_mk3_t *dev)
+{
+	if(dev->screens)
+		return dev->screens;
+
+	struct ni_maschine_mk3_screens_t *screens =
+		calloc(1, sizeof(struct ni_maschine_mk3_screens_t));
+	if(!screens)
+		return 0;
+
+	/* initialize blit mem, the splash colour is sent with the first
+	 * frame */
+	uint8_t col_1 = 0b00010000;
+	uint8_t col_2 = 0b11000011;
+	uint16_t col = (col_2 << 8) | col_1;
+
+	for(int i = 0; i < 2; i++) {
+		struct ni_screen_t *s = &screens->scr[i];
+		memcpy(s->header, i ? header_right : header_left,
+		       sizeof(s->header));
+		memcpy(s->command, command, sizeof(s->command));
+		memcpy(s->footer, footer, sizeof(s->footer));
+		for(int p = 0; p < NUM_PX; p++)
+			s->pixels[p] = col;
+	}
+
+	dev->screens = screens;
+	dev->base.mem_bytes += sizeof(*screens);
+	return screens;
 }
 
 static void
 maschine_mk3_blit_to_screen(struct ni_maschine_mk3_t *dev, int scr)
 {
-	void *data = (scr == 1) ? &dev->screen_right : &dev->screen_left;
+	struct ni_screen_t *s = &dev->screens->scr[scr];
+	void *data = s;
+	uint32_t size = sizeof(*s);
+	if(dev->screen_ext[scr]) {
+		data = dev->screens->cmd;
+		size = ni_screen_encode_full(dev->screens->cmd, s->header,
+					     s->footer, dev->screen_ext[scr]);
+	}
 
 	int ret = ctlra_dev_impl_usb_bulk_write(&dev->base,
 						USB_HANDLE_SCREEN_IDX,
 						USB_ENDPOINT_SCREEN_WRITE,
-						data,
-						sizeof(dev->screen_left));
+						data, size);
 	if(ret < 0)
 		printf("%s screen write failed!\n", __func__);
 }
 
-/** Skip forward in the screen by *num_px* amount of pixels. */
-static inline void
-ni_screen_skip(uint8_t *data, uint32_t *idx, uint32_t num_px)
-{
-	uint32_t skip = num_px / 2;
-	data[(*idx)++] = 0x2;
-	data[(*idx)++] = 0x0;
-	data[(*idx)++] = (skip & 0xff00) >> 8;
-	data[(*idx)++] = (skip & 0x00ff);
-}
-
-static inline void
-ni_screen_line(uint8_t *data, uint32_t *idx, uint32_t length_px,
-	       uint16_t px1_col, uint16_t px2_col)
-{
-	uint32_t len = length_px / 2;
-	data[(*idx)++] = 0x1;
-	data[(*idx)++] = 0x0;
-	data[(*idx)++] = (len & 0xff00) >> 8;
-	data[(*idx)++] = (len & 0x00ff);
-	/* px 1 colour */
-	data[(*idx)++] = px1_col >> 8;
-	data[(*idx)++] = px1_col;
-	/* px2 colour */
-	data[(*idx)++] = px2_col >> 8;
-	data[(*idx)++] = px2_col;
-}
-
-static inline void
-ni_screen_var_px(uint8_t *data, uint32_t *idx, uint32_t num_px,
-		 uint8_t *px_data)
-{
-	uint32_t len = num_px;
-	data[(*idx)++] = 0x0;
-	data[(*idx)++] = 0x0;
-	data[(*idx)++] = (len & 0xff00) >> 8;
-	data[(*idx)++] = (len & 0x00ff);
-	/* iterate provided pixels: 565 has 2 bpp, hence *2 */
-	for(int i = 0; i < num_px * 2; i++)
-		data[(*idx)++] = px_data[i];
-}
-
 int32_t
 ni_maschine_mk3_screen_get_data(struct ctlra_dev_t *base,
 				uint32_t screen_idx,
@@ -919,130 +1051,83 @@ ni_maschine_mk3_screen_get_data(struct ctlra_dev_t *base,
 	if(screen_idx > 1)
 		return -1;
 
-	if(flush == 3)
-		flush = 1;
+	struct ni_maschine_mk3_screens_t *screens =
+		maschine_mk3_screens_get(dev);
+	if(!screens)
+		return -ENOMEM;
 
-	if(flush == 2) {
-		printf("partial redraw %d %d %d %d -  experimental!\n",
-		       zone->x, zone->y, zone->w, zone->h);
-		/* create a new buffer on the stack, to build up the
-		 * required commands to do a partial update */
-		uint8_t cmd[1024*1024];
+	struct ni_screen_t *scr = &screens->scr[screen_idx];
+	struct ni_screen_diff_t *diff = &screens->diff[screen_idx];
+	uint8_t *px = dev->screen_ext[screen_idx];
+	if(!px)
+		px = (uint8_t *)scr->pixels;
+	uint32_t size = 0;
 
-		uint32_t idx = 0;
-		for(; idx < sizeof(dev->screen_left.header); idx++)
-			cmd[idx] = dev->screen_left.header[idx];
+	if(flush > 3)
+		flush = 3;
 
-#if 1
+	if(flush == 2) {
+		struct ctlra_screen_zone_t z = *zone;
+		if(!ni_screen_zone_clip(&z))
+			return 0;
 
-#if 1
-		int hack_redraw = 0;
-		if(hack_redraw) {
-			ni_screen_line(cmd, &idx, 480 * 272,
-				       0b11,
-				       0b11);
-			hack_redraw = 0;
+		/* large zones are cheaper to send as a full frame */
+		if(ni_screen_zone_size(&z) >= sizeof(*scr)) {
+			flush = 3;
 		} else {
-#if 1
-			/* skip foward the required amount from zero */
-			int skip_px = ((480 * zone->y) + zone->x) & (~0x1);
-			ni_screen_skip(cmd, &idx, skip_px);
-
-			int width = zone->w & (~1);
-
-			uint8_t test_px[480];
-			(void)test_px; // keep GCC7 happy
-			for(int i = 0; i < 480; i++)
-				test_px[i] = 0xf;
-
-			uint32_t px_idx = ((zone->y + 0) * 480) + zone->x;
-			printf("px idx = %d\n", px_idx);
-			uint8_t *px_in_data = (uint8_t *)&dev->screen_left.pixels[px_idx];
-
-			//ni_screen_var_px(cmd, &idx, 12, px_in_data);
-			ni_screen_line(cmd, &idx, 12, 0b11111100000, 0b11111100000);
-			//ni_screen_var_px(cmd, &idx, 12, px_in_data);
-			//ni_screen_var_px(cmd, &idx, 12, test_px);
-
-			for(int i = 0; i < zone->h; i++) {
-				ni_screen_line(cmd, &idx, width,
-					       0b1111100000000000,
-					       0b1111100000000000);
-				//printf("i = %d, idx = %d, zone w %d\n", i, idx, zone->w);
-				ni_screen_skip(cmd, &idx, 480 - width);
-			}
-			/* for each horizontal line, plot X pixels, and re-skip */
-#else
-			for(int i = 0; i < zone->h; i++) {
-				uint32_t px_idx = ((zone->y + i) * 480) + zone->x;
-				printf("i %d, px_idx = %d\n", i, px_idx);
-				ni_screen_var_px(cmd, &idx, zone->w, cmd);
-				ni_screen_line(cmd, &idx, zone->w,
-					       0b11111,
-					       0b11111);
-				ni_screen_skip(cmd, &idx, 480 - zone->w);
-			}
-#endif
+			size = ni_screen_encode_zone(screens->cmd,
+						     scr->header, scr->footer,
+						     px, &z);
+			ni_screen_diff_zone(diff, px, &z);
 		}
-#endif
-
-#else
-		ni_screen_skip(cmd, &idx, 480 * 20);
-
-		uint8_t test[] = {
-			0xf8, 0x00, 0xf8, 0x00,
-			0xf8, 0x00, 0xf8, 0x00,
-			0xf8, 0x00, 0xf8, 0x00,
-			0xf8, 0x00, 0xf8, 0x00,
-		};
-		ni_screen_var_px(cmd, &idx, 8, test);
-		ni_screen_var_px(cmd, &idx, 8, test);
-		ni_screen_var_px(cmd, &idx, 8, test);
-		ni_screen_var_px(cmd, &idx, 8, test);
-
-		ni_screen_skip(cmd, &idx, 480 * 20);
-
-		ni_screen_line(cmd, &idx, 480 * 20,
-			       0b1111100000000000,
-			       0b1111100000000000);
-
-		ni_screen_skip(cmd, &idx, 480 * 20);
-
-		ni_screen_line(cmd, &idx, 480 * 20,
-			       0b11111100000,
-			       0b11111100000);
-
-		ni_screen_skip(cmd, &idx, 480 * 20);
-
-		ni_screen_line(cmd, &idx, 480 * 20,
-			       0b11111,
-			       0b11111);
-#endif
-
-		for(int i = 0; i < sizeof(dev->screen_left.footer); i++, idx++)
-			cmd[idx] = dev->screen_left.footer[i];
-
-		ctlra_dev_impl_usb_bulk_write(&dev->base, USB_HANDLE_SCREEN_IDX,
-							USB_ENDPOINT_SCREEN_WRITE,
-							cmd, idx);
-
-		return 0;
 	}
 
 	if(flush == 1) {
+		size = ni_screen_encode_diff(screens->cmd, diff,
+					     scr->header, scr->footer, px);
+		if(size == 0)
+			return 0;
+		if(size >= sizeof(*scr)) {
+			maschine_mk3_blit_to_screen(dev, screen_idx);
+			return 0;
+		}
+	}
+
+	if(flush == 3) {
+		ni_screen_diff_full(diff, px);
 		maschine_mk3_blit_to_screen(dev, screen_idx);
 		return 0;
 	}
 
-	*pixels = (uint8_t *)&dev->screen_left.pixels;
-	if(screen_idx == 1)
-		*pixels = (uint8_t *)&dev->screen_right.pixels;
+	if(flush) {
+		int ret = ctlra_dev_impl_usb_bulk_write(&dev->base,
+						USB_HANDLE_SCREEN_IDX,
+						USB_ENDPOINT_SCREEN_WRITE,
+						screens->cmd, size);
+		if(ret < 0)
+			printf("%s screen write failed!\n", __func__);
+		return 0;
+	}
 
+	*pixels = px;
 	*bytes = NUM_PX * 2;
 
 	return 0;
 }
 
+static int32_t
+ni_maschine_mk3_screen_set_pixels(struct ctlra_dev_t *base,
+				  uint32_t screen_idx, uint8_t *pixels)
+{
+	struct ni_maschine_mk3_t *dev = (struct ni_maschine_mk3_t *)base;
+	if(screen_idx > 1)
+		return -EINVAL;
+	if(!maschine_mk3_screens_get(dev))
+		return -ENOMEM;
+	dev->screen_ext[screen_idx] = pixels;
+	return 0;
+}
+
 static int32_t
 ni_maschine_mk3_disconnect(struct ctlra_dev_t *base)
 {
@@ -1053,17 +1138,22 @@ ni_maschine_mk3_disconnect(struct ctlra_dev_t *base)
 	memset(dev->lights_pads, 0x0, LIGHTS_PADS_SIZE);
 	dev->lights_pads_dirty = 1;
 
-	if(!base->banished) {
+	if(!base->banished)
 		ni_maschine_mk3_light_flush(base, 1);
-		memset(dev->screen_left.pixels, 0x0,
-		       sizeof(dev->screen_left.pixels));
-		memset(dev->screen_right.pixels, 0x0,
-		       sizeof(dev->screen_right.pixels));
-		maschine_mk3_blit_to_screen(dev, 0);
-		maschine_mk3_blit_to_screen(dev, 1);
+
+	/* screens that were never drawn show the device's own display */
+	if(!base->banished && dev->screens) {
+		dev->screen_ext[0] = 0;
+		dev->screen_ext[1] = 0;
+		for(int i = 0; i < 2; i++) {
+			memset(dev->screens->scr[i].pixels, 0x0,
+			       sizeof(dev->screens->scr[i].pixels));
+			maschine_mk3_blit_to_screen(dev, i);
+		}
 	}
 
 	ctlra_dev_impl_usb_close(base);
+	free(dev->screens);
 	free(dev);
 	return 0;
 }
@@ -1104,29 +1194,7 @@ ctlra_ni_maschine_mk3_connect(ctlra_event_func event_func,
 		goto fail;
 	}
 
-	/* initialize blit mem in driver */
-	memcpy(dev->screen_left.header , header_left, sizeof(dev->screen_left.header));
-	memcpy(dev->screen_left.command, command, sizeof(dev->screen_left.command));
-	memcpy(dev->screen_left.footer , footer , sizeof(dev->screen_left.footer));
-	/* right */
-	memcpy(dev->screen_right.header , header_right, sizeof(dev->screen_right.header));
-	memcpy(dev->screen_right.command, command, sizeof(dev->screen_right.command));
-	memcpy(dev->screen_right.footer , footer , sizeof(dev->screen_right.footer));
-
-	/* blit stuff to screen */
-	uint8_t col_1 = 0b00010000;
-	uint8_t col_2 = 0b11000011;
-	uint16_t col = (col_2 << 8) | col_1;
-
-	uint16_t *sl = dev->screen_left.pixels;
-	uint16_t *sr = dev->screen_right.pixels;
-
-	for(int i = 0; i < NUM_PX; i++) {
-		*sl++ = col;
-		*sr++ = col;
-	}
-	maschine_mk3_blit_to_screen(dev, 0);
-	maschine_mk3_blit_to_screen(dev, 1);
+	dev->base.mem_bytes = sizeof(*dev);
 
 	dev->pad_colour = pad_cols[0];
 	dev->lights_dirty = 1;
@@ -1137,8 +1205,16 @@ ctlra_ni_maschine_mk3_connect(ctlra_event_func event_func,
 	dev->base.usb_read_cb = ni_maschine_mk3_usb_read_cb;
 	dev->base.disconnect = ni_maschine_mk3_disconnect;
 	dev->base.light_set = ni_maschine_mk3_light_set;
+	dev->base.lights_set_frame = ni_maschine_mk3_lights_set_frame;
+	dev->base.grid_frame_set = ni_maschine_mk3_grid_frame_set;
+	dev->base.strip_set = ni_maschine_mk3_strip_set;
+	dev->base.feedback_set = ni_maschine_mk3_feedback_set;
 	dev->base.light_flush = ni_maschine_mk3_light_flush;
 	dev->base.screen_get_data = ni_maschine_mk3_screen_get_data;
+	dev->base.screen_set_pixels = ni_maschine_mk3_screen_set_pixels;
+	dev->base.grid_pressure_caps = 1 << 0;
+	ctlra_palette_init(&mk3_palette, ctlra_palette_ni_hue,
+			   (void *)(uintptr_t)0xff);
 
 	dev->base.event_func = event_func;
 	dev->base.event_func_userdata = userdata;
@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string.h>
+
+#include "ni_screen.h"
+
+int ni_screen_zone_clip(struct ctlra_screen_zone_t *zone)
+{
+	if(zone->x >= NI_SCREEN_W || zone->y >= NI_SCREEN_H ||
+	   zone->w == 0 || zone->h == 0)
+		return 0;
+
+	/* clamp by subtraction, x + w can wrap for hostile zones */
+	if(zone->w > NI_SCREEN_W - zone->x)
+		zone->w = NI_SCREEN_W - zone->x;
+	if(zone->h > NI_SCREEN_H - zone->y)
+		zone->h = NI_SCREEN_H - zone->y;
+	uint32_t x2 = zone->x + zone->w;
+	uint32_t y2 = zone->y + zone->h;
+
+	/* round out to pixel pairs, the screen width is even */
+	zone->x &= ~1;
+	x2 = (x2 + 1) & ~1;
+
+	zone->w = x2 - zone->x;
+	zone->h = y2 - zone->y;
+	return 1;
+}
+
+uint32_t ni_screen_encode_zone(uint8_t *cmd, const uint8_t *header,
+			       const uint8_t *footer, const uint8_t *pixels,
+			       const struct ctlra_screen_zone_t *zone)
+{
+	uint32_t idx = NI_SCREEN_HEADER_SIZE;
+	memcpy(cmd, header, NI_SCREEN_HEADER_SIZE);
+
+	uint32_t start = zone->y * NI_SCREEN_W + zone->x;
+	if(start)
+		ni_screen_skip(cmd, &idx, start);
+
+	for(uint32_t r = 0; r < zone->h; r++) {
+		if(r && zone->w != NI_SCREEN_W)
+			ni_screen_skip(cmd, &idx, NI_SCREEN_W - zone->w);
+		const uint8_t *row = &pixels[(start + r * NI_SCREEN_W) * 2];
+		ni_screen_var_px(cmd, &idx, zone->w, row);
+	}
+
+	memcpy(&cmd[idx], footer, NI_SCREEN_FOOTER_SIZE);
+	return idx + NI_SCREEN_FOOTER_SIZE;
+}
+
+uint32_t ni_screen_encode_full(uint8_t *cmd, const uint8_t *header,
+			       const uint8_t *footer, const uint8_t *pixels)
+{
+	uint32_t idx = NI_SCREEN_HEADER_SIZE;
+	memcpy(cmd, header, NI_SCREEN_HEADER_SIZE);
+	ni_screen_var_px(cmd, &idx, NI_SCREEN_W * NI_SCREEN_H, pixels);
+	memcpy(&cmd[idx], footer, NI_SCREEN_FOOTER_SIZE);
+	return idx + NI_SCREEN_FOOTER_SIZE;
+}
+
+#define ROW_BYTES (NI_SCREEN_W * 2)
+#define ROW_PAIRS (NI_SCREEN_W / 2)
+
+static inline uint32_t
+px_pair(const uint8_t *row, uint32_t i)
+{
+	uint32_t v;
+	memcpy(&v, &row[i * 4], sizeof(v));
+	return v;
+}
+
+static inline int
+pair_same(const uint8_t *row, const uint8_t *last, uint32_t i)
+{
+	return memcmp(&row[i * 4], &last[i * 4], 4) == 0;
+}
+
+static uint64_t
+row_hash(const uint8_t *row)
+{
+	/* multiply-xorshift over 8 byte words, in four independent lanes
+	 * so the multiplies overlap. A collision leaves a stale row on
+	 * screen until it changes again, at 64 bits that is rare enough
+	 * not to be worth comparing every row */
+	const uint64_t k = 0xff51afd7ed558ccdULL;
+	uint64_t h[4] = {
+		0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL,
+		0x165667b19e3779f9ULL, 0x27d4eb2f165667c5ULL,
+	};
+	for(uint32_t i = 0; i < ROW_BYTES; i += 32) {
+		for(int l = 0; l < 4; l++) {
+			uint64_t w;
+			memcpy(&w, &row[i + l * 8], sizeof(w));
+			h[l] = (h[l] ^ w) * k;
+			h[l] ^= h[l] >> 32;
+		}
+	}
+	return (h[0] ^ (h[1] * k)) + ((h[2] ^ (h[3] * k)) * k);
+}
+
+/* Emits pairs [a, b) of *row* as pixel and line commands */
+static void
+encode_span(uint8_t *cmd, uint32_t *idx, const uint8_t *row,
+	    uint32_t a, uint32_t b)
+{
+	uint32_t var = a;
+	uint32_t i = a;
+	while(i < b) {
+		uint32_t p = px_pair(row, i);
+		uint32_t j = i + 1;
+		while(j < b && px_pair(row, j) == p)
+			j++;
+
+		if(j - i >= NI_SCREEN_DIFF_MIN_LINE) {
+			if(i > var)
+				ni_screen_var_px(cmd, idx, (i - var) * 2,
+						 &row[var * 4]);
+			const uint8_t *px = &row[i * 4];
+			ni_screen_line(cmd, idx, (j - i) * 2,
+				       (px[0] << 8) | px[1],
+				       (px[2] << 8) | px[3]);
+			var = j;
+		}
+		i = j;
+	}
+	if(b > var)
+		ni_screen_var_px(cmd, idx, (b - var) * 2, &row[var * 4]);
+}
+
+uint32_t ni_screen_encode_diff(uint8_t *cmd, struct ni_screen_diff_t *diff,
+			       const uint8_t *header, const uint8_t *footer,
+			       const uint8_t *pixels)
+{
+	const int valid = diff->valid;
+	uint32_t idx = NI_SCREEN_HEADER_SIZE;
+	uint32_t skip = 0;
+	int full = 0;
+
+	memcpy(cmd, header, NI_SCREEN_HEADER_SIZE);
+
+	for(uint32_t r = 0; r < NI_SCREEN_H; r++) {
+		const uint8_t *row = &pixels[r * ROW_BYTES];
+		const uint8_t *last = &diff->last[r * ROW_BYTES];
+		uint64_t h = row_hash(row);
+		if(valid && h == diff->row_hash[r]) {
+			skip += ROW_PAIRS;
+			continue;
+		}
+		diff->row_hash[r] = h;
+
+		/* once over budget only the hashes are kept up to date */
+		if(full)
+			continue;
+
+		uint32_t p = 0;
+		while(p < ROW_PAIRS) {
+			while(valid && p < ROW_PAIRS &&
+			      pair_same(row, last, p)) {
+				skip++;
+				p++;
+			}
+			if(p == ROW_PAIRS)
+				break;
+
+			/* extend the changed span over short unchanged gaps */
+			uint32_t a = p;
+			uint32_t b = p + 1;
+			uint32_t gap = 0;
+			for(uint32_t q = b; q < ROW_PAIRS; q++) {
+				if(valid && pair_same(row, last, q)) {
+					if(++gap >= NI_SCREEN_DIFF_MIN_SKIP)
+						break;
+				} else {
+					gap = 0;
+					b = q + 1;
+				}
+			}
+
+			if(skip)
+				ni_screen_skip(cmd, &idx, skip * 2);
+			skip = 0;
+			encode_span(cmd, &idx, row, a, b);
+			p = b;
+		}
+
+		/* a span writes less than a row, so stopping here keeps
+		 * within the NI_SCREEN_PARTIAL_MAX sized buffer */
+		if(idx >= NI_SCREEN_FULL_SIZE)
+			full = 1;
+	}
+
+	diff->valid = 1;
+	memcpy(diff->last, pixels, sizeof(diff->last));
+
+	if(full)
+		return idx;
+	if(idx == NI_SCREEN_HEADER_SIZE)
+		return 0;
+
+	memcpy(&cmd[idx], footer, NI_SCREEN_FOOTER_SIZE);
+	return idx + NI_SCREEN_FOOTER_SIZE;
+}
+
+void ni_screen_diff_zone(struct ni_screen_diff_t *diff,
+			 const uint8_t *pixels,
+			 const struct ctlra_screen_zone_t *zone)
+{
+	if(!diff->valid)
+		return;
+
+	for(uint32_t r = zone->y; r < zone->y + zone->h; r++) {
+		uint32_t off = r * ROW_BYTES + zone->x * 2;
+		memcpy(&diff->last[off], &pixels[off], zone->w * 2);
+		diff->row_hash[r] = row_hash(&diff->last[r * ROW_BYTES]);
+	}
+}
+
+void ni_screen_diff_full(struct ni_screen_diff_t *diff,
+			 const uint8_t *pixels)
+{
+	for(uint32_t r = 0; r < NI_SCREEN_H; r++)
+		diff->row_hash[r] = row_hash(&pixels[r * ROW_BYTES]);
+	memcpy(diff->last, pixels, sizeof(diff->last));
+	diff->valid = 1;
+}
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef OPENAV_CTLRA_NI_SCREEN_H
+#define OPENAV_CTLRA_NI_SCREEN_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "ctlra.h"
+
+/* Screen protocol of the Maschine MK3 and Kontrol D2. A transfer is a
+ * 16 byte header, a stream of commands, and an 8 byte footer. Command
+ * lengths count pixel pairs, so all runs are an even number of pixels.
+ * Pixels are 565, 2 bytes each, sent in framebuffer byte order.
+ */
+#define NI_SCREEN_W 480
+#define NI_SCREEN_H 272
+#define NI_SCREEN_HEADER_SIZE 16
+#define NI_SCREEN_FOOTER_SIZE 8
+#define NI_SCREEN_CMD_SIZE 4
+
+/* Worst case size of a partial transfer: one skip, then a pixel
+ * command and a skip for each row */
+#define NI_SCREEN_PARTIAL_MAX (NI_SCREEN_HEADER_SIZE +			\
+			       NI_SCREEN_CMD_SIZE +			\
+			       NI_SCREEN_H * (2 * NI_SCREEN_CMD_SIZE +	\
+					      NI_SCREEN_W * 2) +	\
+			       NI_SCREEN_FOOTER_SIZE)
+
+static inline void
+ni_screen_cmd(uint8_t *data, uint32_t *idx, uint8_t cmd, uint32_t len)
+{
+	data[(*idx)++] = cmd;
+	data[(*idx)++] = (len >> 16) & 0xff;
+	data[(*idx)++] = (len >>  8) & 0xff;
+	data[(*idx)++] = (len & 0x00ff);
+}
+
+/** Skip forward in the screen by *num_px* amount of pixels. */
+static inline void
+ni_screen_skip(uint8_t *data, uint32_t *idx, uint32_t num_px)
+{
+	ni_screen_cmd(data, idx, 0x2, num_px / 2);
+}
+
+/** Repeat the pixel pair *px1_col*, *px2_col* for *length_px* pixels */
+static inline void
+ni_screen_line(uint8_t *data, uint32_t *idx, uint32_t length_px,
+	       uint16_t px1_col, uint16_t px2_col)
+{
+	ni_screen_cmd(data, idx, 0x1, length_px / 2);
+	/* px 1 colour */
+	data[(*idx)++] = px1_col >> 8;
+	data[(*idx)++] = px1_col;
+	/* px2 colour */
+	data[(*idx)++] = px2_col >> 8;
+	data[(*idx)++] = px2_col;
+}
+
+/** Write *num_px* pixels from *px_data* */
+static inline void
+ni_screen_var_px(uint8_t *data, uint32_t *idx, uint32_t num_px,
+		 const uint8_t *px_data)
+{
+	ni_screen_cmd(data, idx, 0x0, num_px / 2);
+	/* 565 has 2 bytes per pixel */
+	memcpy(&data[*idx], px_data, num_px * 2);
+	*idx += num_px * 2;
+}
+
+/* Clips *zone* to the screen and widens it to whole pixel pairs.
+ * Returns 0 if nothing of the zone is on screen */
+int ni_screen_zone_clip(struct ctlra_screen_zone_t *zone);
+
+/* Bytes ni_screen_encode_zone() writes for the clipped *zone* */
+static inline uint32_t
+ni_screen_zone_size(const struct ctlra_screen_zone_t *zone)
+{
+	uint32_t skips = zone->h - 1 + (zone->x || zone->y);
+	if(zone->w == NI_SCREEN_W)
+		skips = zone->y != 0;
+	return NI_SCREEN_HEADER_SIZE + NI_SCREEN_FOOTER_SIZE +
+	       skips * NI_SCREEN_CMD_SIZE +
+	       zone->h * (NI_SCREEN_CMD_SIZE + zone->w * 2);
+}
+
+/* Encodes a transfer of only the pixels in *zone* into *cmd*, which
+ * must hold NI_SCREEN_PARTIAL_MAX bytes. *header* and *footer* are the
+ * ones used for full frames of the screen, *pixels* is the framebuffer.
+ * The zone must be clipped. Returns the number of bytes written */
+uint32_t ni_screen_encode_zone(uint8_t *cmd, const uint8_t *header,
+			       const uint8_t *footer, const uint8_t *pixels,
+			       const struct ctlra_screen_zone_t *zone);
+
+/* Size of a full frame transfer: header, one pixel command and footer */
+#define NI_SCREEN_FULL_SIZE (NI_SCREEN_HEADER_SIZE + NI_SCREEN_CMD_SIZE + \
+			     NI_SCREEN_W * NI_SCREEN_H * 2 +		\
+			     NI_SCREEN_FOOTER_SIZE)
+
+/* Encodes a full frame of *pixels* into *cmd*, for framebuffers that are
+ * not laid out as a transfer. Returns NI_SCREEN_FULL_SIZE */
+uint32_t ni_screen_encode_full(uint8_t *cmd, const uint8_t *header,
+			       const uint8_t *footer, const uint8_t *pixels);
+
+/* Unchanged runs shorter than this many pixel pairs are resent inside
+ * the pixel command, as a skip would split it into two commands. Uniform
+ * runs of at least NI_SCREEN_DIFF_MIN_LINE pairs become line commands */
+#define NI_SCREEN_DIFF_MIN_SKIP 3
+#define NI_SCREEN_DIFF_MIN_LINE 4
+
+/* The frame last sent to a screen, which new frames are diffed against.
+ * Rows whose hash matches are skipped without comparing pixels, changed
+ * rows are compared pair by pair against *last*. */
+struct ni_screen_diff_t {
+	uint8_t valid;
+	uint64_t row_hash[NI_SCREEN_H];
+	uint8_t last[NI_SCREEN_W * NI_SCREEN_H * 2];
+};
+
+/* Encodes the difference between *pixels* and the last sent frame into
+ * *cmd*, which must hold NI_SCREEN_PARTIAL_MAX bytes. The diff state is
+ * updated to *pixels*, as the caller sends either the diff or a full
+ * frame. Returns 0 if the frame is unchanged, the number of bytes written,
+ * or a size of at least NI_SCREEN_FULL_SIZE if a full frame is smaller,
+ * in which case the contents of *cmd* are not usable */
+uint32_t ni_screen_encode_diff(uint8_t *cmd, struct ni_screen_diff_t *diff,
+			       const uint8_t *header, const uint8_t *footer,
+			       const uint8_t *pixels);
+
+/* Records that the clipped *zone* of *pixels* was sent to the screen */
+void ni_screen_diff_zone(struct ni_screen_diff_t *diff,
+			 const uint8_t *pixels,
+			 const struct ctlra_screen_zone_t *zone);
+
+/* Records that all of *pixels* was sent to the screen */
+void ni_screen_diff_full(struct ni_screen_diff_t *diff,
+			 const uint8_t *pixels);
+
+#endif /* OPENAV_CTLRA_NI_SCREEN_H */
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "impl.h"
+#include "evdev.h"
+
+#define EVDEV_DIR "/dev/input"
+#define EVDEV_PATH_MAX 64
+
+CTLRA_DEVICE_DECL(evdev);
+
+static int
+ctlra_evdev_impl_is_event_node(const char *name)
+{
+	return strncmp(name, "event", 5) == 0;
+}
+
+/* bit of eventN in ctlra->evdev_rejected, or -1 if not tracked */
+static int
+ctlra_evdev_impl_node_num(const char *name)
+{
+	char *end;
+	unsigned long n = strtoul(name + 5, &end, 10);
+	if(end == name + 5 || *end || n >= 64 * 4)
+		return -1;
+	return n;
+}
+
+static void
+ctlra_evdev_impl_rejected_set(struct ctlra_t *ctlra, const char *name,
+			      int rejected)
+{
+	int n = ctlra_evdev_impl_node_num(name);
+	if(n < 0)
+		return;
+	uint64_t bit = 1ull << (n % 64);
+	if(rejected)
+		ctlra->evdev_rejected[n / 64] |= bit;
+	else
+		ctlra->evdev_rejected[n / 64] &= ~bit;
+}
+
+static int
+ctlra_evdev_impl_rejected(struct ctlra_t *ctlra, const char *name)
+{
+	int n = ctlra_evdev_impl_node_num(name);
+	return n >= 0 && (ctlra->evdev_rejected[n / 64] >> (n % 64)) & 1;
+}
+
+static int
+ctlra_evdev_impl_accept(struct ctlra_t *ctlra, const char *name)
+{
+	char path[EVDEV_PATH_MAX];
+	snprintf(path, sizeof(path), EVDEV_DIR "/%s", name);
+
+	/* udev fires IN_ATTRIB after IN_CREATE, so a node can be seen
+	 * twice: don't open a device that is already in use */
+	struct ctlra_dev_t *dev_iter = ctlra->dev_list;
+	while(dev_iter) {
+		const char *p = ctlra_evdev_dev_get_path(dev_iter);
+		if(p && strcmp(p, path) == 0)
+			return 0;
+		dev_iter = dev_iter->dev_list_next;
+	}
+
+	struct ctlra_dev_t *dev = ctlra_dev_connect(ctlra,
+						    CTLRA_DEVICE_FUNC(evdev),
+						    0x0, 0x0, path);
+	if(!dev)
+		return 0;
+
+	int accepted = ctlra->accept_dev_func(ctlra, &dev->info, dev,
+					      ctlra->accept_dev_func_userdata);
+
+	CTLRA_INFO(ctlra, "%s %s (%s) %s accepted\n", dev->info.vendor,
+		   dev->info.device, path, accepted ? "" : "not");
+
+	ctlra_evdev_impl_rejected_set(ctlra, name, !accepted);
+	if(!accepted) {
+		ctlra_dev_disconnect(dev);
+		return 0;
+	}
+	return 1;
+}
+
+int ctlra_impl_evdev_init(struct ctlra_t *ctlra)
+{
+	if(ctlra->evdev_initialized)
+		return -1;
+
+	ctlra->evdev_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(ctlra->evdev_inotify_fd < 0) {
+		CTLRA_ERROR(ctlra, "inotify init failed: %s\n",
+			    strerror(errno));
+		return -1;
+	}
+	ctlra->evdev_initialized = 1;
+
+	/* IN_ATTRIB: nodes are usually created root-only, and become
+	 * readable once udev has applied the permissions. IN_DELETE
+	 * forgets a rejected node, as its name is reused by the kernel */
+	int ret = inotify_add_watch(ctlra->evdev_inotify_fd, EVDEV_DIR,
+				    IN_CREATE | IN_ATTRIB | IN_DELETE);
+	if(ret < 0) {
+		CTLRA_WARN(ctlra, "evdev hotplug unavailable: %s\n",
+			   strerror(errno));
+		return -2;
+	}
+
+	return 0;
+}
+
+int ctlra_impl_evdev_probe(struct ctlra_t *ctlra)
+{
+	DIR *dir = opendir(EVDEV_DIR);
+	if(!dir)
+		return 0;
+
+	int num_accepted = 0;
+	struct dirent *ent;
+	while((ent = readdir(dir))) {
+		if(ctlra_evdev_impl_is_event_node(ent->d_name))
+			num_accepted += ctlra_evdev_impl_accept(ctlra,
+								ent->d_name);
+	}
+	closedir(dir);
+
+	return num_accepted;
+}
+
+void ctlra_impl_evdev_idle_iter(struct ctlra_t *ctlra)
+{
+	/* hotplug is only useful once the app has provided accept() */
+	if(!ctlra->evdev_initialized || !ctlra->accept_dev_func)
+		return;
+
+	char buf[4096]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+
+	for(;;) {
+		ssize_t len = read(ctlra->evdev_inotify_fd, buf, sizeof(buf));
+		if(len <= 0)
+			break;
+
+		char *ptr = buf;
+		while(ptr < buf + len) {
+			const struct inotify_event *ev = (void *)ptr;
+			ptr += sizeof(struct inotify_event) + ev->len;
+
+			if(!ev->len ||
+			   !ctlra_evdev_impl_is_event_node(ev->name))
+				continue;
+			if(ev->mask & IN_DELETE)
+				ctlra_evdev_impl_rejected_set(ctlra, ev->name,
+							      0);
+			else if(!ctlra_evdev_impl_rejected(ctlra, ev->name))
+				ctlra_evdev_impl_accept(ctlra, ev->name);
+		}
+	}
+}
+
+void ctlra_impl_evdev_shutdown(struct ctlra_t *ctlra)
+{
+	if(ctlra->evdev_initialized)
+		close(ctlra->evdev_inotify_fd);
+	ctlra->evdev_initialized = 0;
+}
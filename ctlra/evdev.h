@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CTLRA_EVDEV_H
+#define CTLRA_EVDEV_H
+
+#include <stdint.h>
+
+struct ctlra_t;
+struct ctlra_dev_t;
+
+/* For evdev initialization: sets up inotify on /dev/input */
+int ctlra_impl_evdev_init(struct ctlra_t *ctlra);
+/* Opens all /dev/input/eventX nodes, returns the number accepted */
+int ctlra_impl_evdev_probe(struct ctlra_t *ctlra);
+/* For polling hotplug events */
+void ctlra_impl_evdev_idle_iter(struct ctlra_t *ctlra);
+/* For cleaning up the evdev subsystem */
+void ctlra_impl_evdev_shutdown(struct ctlra_t *ctlra);
+
+/* From devices/linux_evdev.c: returns the /dev/input path if the device
+ * is an evdev device, or NULL otherwise */
+const char *ctlra_evdev_dev_get_path(struct ctlra_dev_t *dev);
+
+/* From ctlra.c */
+extern int ctlra_impl_get_id_by_vid_pid(uint32_t vid, uint32_t pid);
+extern struct ctlra_dev_t *ctlra_dev_connect(struct ctlra_t *ctlra,
+					     ctlra_dev_connect_func connect,
+					     ctlra_event_func event_func,
+					     void *userdata, void *future);
+
+#endif /* CTLRA_EVDEV_H */
@@ -125,7 +125,8 @@ struct ctlra_event_grid_t {
 	float pressure;
 	/** The state of the button component of the square. Pressed
 	 * should only be set once when the state is considered changed.
-	 * This makes handling note-events from a grid easier */
+	 * This makes handling note-events from a grid easier. Events with
+	 * only the pressure flag set leave pressed at the held state */
 	uint32_t pressed;
 };
 
@@ -79,12 +79,25 @@ typedef int32_t (*ctlra_dev_impl_disconnect)(struct ctlra_dev_t *dev);
 typedef void (*ctlra_dev_impl_light_set)(struct ctlra_dev_t *dev,
 					   uint32_t light_id,
 					   uint32_t light_status);
+/* Sets lights ids[i] to values[i]. If ids is NULL, light i is set to
+ * values[i] instead. Optional: only drivers that can write a dense frame
+ * faster than a light_set loop should implement it */
+typedef void (*ctlra_dev_impl_lights_set_frame)(struct ctlra_dev_t *dev,
+						const uint32_t *ids,
+						const uint32_t *values,
+						uint32_t count);
 typedef void (*ctlra_dev_impl_feedback_set)(struct ctlra_dev_t *dev,
 					    uint32_t fb_id,
 					    float value);
 typedef void (*ctlra_dev_impl_feedback_digits)(struct ctlra_dev_t *dev,
 					    uint32_t fb_id,
 					    float value);
+/* Renders a bar up to *value* onto LED strip *fb_id*, and lights the
+ * single LED at *peak* if it is above the bar. Both range 0 to 1 */
+typedef void (*ctlra_dev_impl_strip_set)(struct ctlra_dev_t *dev,
+					 uint32_t fb_id,
+					 float value,
+					 float peak);
 typedef void (*ctlra_dev_impl_light_flush)(struct ctlra_dev_t *dev,
 					  uint32_t force);
 typedef void (*ctlra_dev_impl_usb_read_cb)(struct ctlra_dev_t *dev,
@@ -97,10 +110,22 @@ typedef int32_t (*ctlra_dev_impl_screen_get_data)(struct ctlra_dev_t *dev,
 						  uint32_t *bytes,
 						  struct ctlra_screen_zone_t *redraw,
 						  uint8_t flush);
+/* Optional: makes the driver read the pixels of screen *screen_idx* from
+ * *pixels* instead of its own framebuffer, until called again. *pixels*
+ * has the size and format of the driver's framebuffer, NULL returns to
+ * it. Flushes encode straight from *pixels*, avoiding a copy */
+typedef int32_t (*ctlra_dev_impl_screen_set_pixels)(struct ctlra_dev_t *dev,
+						    uint32_t screen_idx,
+						    uint8_t *pixels);
 typedef int32_t (*ctlra_dev_impl_grid_light_set)(struct ctlra_dev_t *dev,
 						uint32_t grid_id,
 						uint32_t light_id,
 						uint32_t light_status);
+/* Sets all lights of a grid, rgb[i] is the status of grid position i */
+typedef int32_t (*ctlra_dev_impl_grid_frame_set)(struct ctlra_dev_t *dev,
+						 uint32_t grid_id,
+						 const uint32_t *rgb,
+						 uint32_t count);
 typedef const char* (*ctlra_dev_impl_control_get_name)
 						(const struct ctlra_dev_t *dev,
 						enum ctlra_event_type_t type,
@@ -146,7 +171,9 @@ struct ctlra_dev_t {
 #define USB_XFER_INFLIGHT_READ 7
 #define USB_XFER_INFLIGHT_WRITE 8
 #define USB_XFER_INFLIGHT_CANCEL 9
-#define USB_XFER_COUNT 10
+/* light reports not written as they matched the last sent copy */
+#define USB_XFER_LIGHTS_SUPPRESSED 10
+#define USB_XFER_COUNT 11
 	uint32_t usb_xfer_counts[USB_XFER_COUNT];
 
 
@@ -173,17 +200,27 @@ struct ctlra_dev_t {
 
 	/* Function pointers to write feedback to device */
 	ctlra_dev_impl_light_set light_set;
+	ctlra_dev_impl_lights_set_frame lights_set_frame;
 	ctlra_dev_impl_feedback_set feedback_set;
 	ctlra_dev_impl_feedback_digits feedback_digits;
+	ctlra_dev_impl_strip_set strip_set;
 	ctlra_dev_impl_grid_light_set grid_light_set;
+	ctlra_dev_impl_grid_frame_set grid_frame_set;
 	ctlra_dev_impl_light_flush light_flush;
 	ctlra_dev_impl_usb_read_cb usb_read_cb;
 
 	/* Screen related functions */
 	ctlra_dev_impl_screen_get_data screen_get_data;
+	ctlra_dev_impl_screen_set_pixels screen_set_pixels;
 	ctlra_screen_redraw_cb screen_redraw_cb;
 	void *screen_redraw_ud;
 	struct timespec screen_last_redraw;
+	/* Bytes the driver allocated for the device, including screens
+	 * allocated on first use. Reported on disconnect */
+	uint32_t mem_bytes;
+	/* 1 bit screen reduction, see ctlra_dev_screen_dither() */
+	uint8_t screen_dither;
+	uint8_t screen_threshold;
 
 	/* Function pointer to retrive info about a particular control */
 	ctlra_dev_impl_control_get_name control_get_name;
@@ -191,6 +228,39 @@ struct ctlra_dev_t {
 	/* Function pointer to call just before the device is removed */
 	ctlra_remove_dev_func remove_func;
 
+	/* LED animations, allocated on first use. See anim.c */
+	struct ctlra_light_anims_t *light_anims;
+	/* Level meters, allocated by ctlra_dev_meter_enable(). See meter.c */
+	struct ctlra_meters_t *meters;
+	/* Screen render buffers, allocated by ctlra_dev_screen_async().
+	 * See render.c */
+	struct ctlra_render_t *render;
+	/* Glyph caches of each screen, allocated by ctlra_screen_text().
+	 * See text.c */
+	struct ctlra_text_cache_t *text[CTLRA_NUM_SCREENS_MAX];
+	/* Sprites of each screen, allocated by ctlra_screen_sprite_add().
+	 * See sprite.c */
+	struct ctlra_sprites_t *sprites[CTLRA_NUM_SCREENS_MAX];
+	/* Screens shared with other processes by ctlra_dev_screen_share().
+	 * See share.c */
+	struct ctlra_share_t *share;
+
+	/* Lights written from any thread by ctlra_dev_light_set_rt(). The
+	 * status is stored before its dirty bit is set, and the LED tick
+	 * swaps out each dirty word before reading the statuses */
+#define CTLRA_RT_LIGHTS_MAX 256
+	uint32_t rt_lights[CTLRA_RT_LIGHTS_MAX];
+	uint32_t rt_lights_dirty[CTLRA_RT_LIGHTS_MAX / 32];
+
+	/* Opt-in continuous grid pressure, see ctlra_dev_grid_pressure_stream().
+	 * Drivers set a bit in the caps mask for each grid they can stream
+	 * pressure from. An interval of zero means the stream is disabled */
+	uint8_t grid_pressure_caps;
+	struct {
+		uint64_t interval_ns;
+		float delta;
+	} grid_pressure[CTLRA_NUM_GRIDS_MAX];
+
 	/* Internal representation of the controller info */
 	struct ctlra_dev_info_t info;
 };
@@ -227,6 +297,15 @@ int ctlra_dev_impl_usb_interrupt_write(struct ctlra_dev_t *dev, uint32_t idx,
 				       uint32_t endpoint, uint8_t *data,
 				       uint32_t size);
 
+struct ctlra_lights_shadow_t;
+/** As ctlra_dev_impl_usb_interrupt_write(), and if the async transfer
+ * fails after it was submitted, *shadow* is invalidated */
+int
+ctlra_dev_impl_usb_interrupt_write_shadow(struct ctlra_dev_t *dev,
+					  uint32_t idx, uint32_t endpoint,
+					  uint8_t *data, uint32_t size,
+					  struct ctlra_lights_shadow_t *shadow);
+
 /** Writes bytes to the device using a bulk USB transfer*/
 int ctlra_dev_impl_usb_bulk_write(struct ctlra_dev_t *dev, uint32_t idx,
 				  uint32_t endpoint, uint8_t *data,
@@ -235,6 +314,30 @@ int ctlra_dev_impl_usb_bulk_write(struct ctlra_dev_t *dev, uint32_t idx,
 /** Close the USB device handles, returning them to the kernel */
 void ctlra_dev_impl_usb_close(struct ctlra_dev_t *dev);
 
+/* Last sent copy of one LED report, owned by the driver. A driver keeps
+ * one shadow per report it writes, zero initialized */
+#define CTLRA_LIGHTS_SHADOW_MAX 256
+struct ctlra_lights_shadow_t {
+	uint16_t size;
+	uint8_t valid;
+	uint8_t data[CTLRA_LIGHTS_SHADOW_MAX];
+};
+
+/** Writes an LED report with an interrupt transfer, unless *force* is
+ * zero and the *data* is identical to the last report written through
+ * *shadow*. Skipped writes are counted in USB_XFER_LIGHTS_SUPPRESSED.
+ * If the transfer fails once submitted, the shadow is invalidated, so
+ * the report is sent again by the next flush.
+ * @retval 0 if the write was suppressed or could not be submitted
+ * @retval >0 bytes written, the shadow is updated
+ * @retval <0 on error
+ */
+int ctlra_dev_impl_lights_write(struct ctlra_dev_t *dev,
+				struct ctlra_lights_shadow_t *shadow,
+				uint32_t idx, uint32_t endpoint,
+				uint8_t *data, uint32_t size,
+				uint32_t force);
+
 /* Marks a device as failed, and adds it to the disconnect list. After
  * having been banished, the device instance will not function again */
 void ctlra_dev_impl_banish(struct ctlra_dev_t *dev);
@@ -254,6 +357,21 @@ struct ctlra_t
 	/* USB backend context */
 	struct libusb_context *ctx;
 	uint8_t usb_initialized;
+	/* USB traffic capture / replay, see capture.h */
+	struct ctlra_capture_t *usb_capture;
+	struct ctlra_replay_t *usb_replay;
+
+	/* evdev backend: inotify on /dev/input for hotplug */
+	int evdev_inotify_fd;
+	uint8_t evdev_initialized;
+	/* eventN nodes the app did not accept, bit N. Not reopened on
+	 * hotplug events until the node is removed */
+	uint64_t evdev_rejected[4];
+
+	/* Next LED animation and meter tick, see anim.c and meter.c */
+	uint64_t light_tick_next_ns;
+	/* Screen render workers, started on first use. See render.c */
+	struct ctlra_render_pool_t *render_pool;
 
 	/* Linked list of devices currently in use */
 	struct ctlra_dev_t *dev_list;
@@ -307,6 +425,86 @@ static void ctlra_ ## name ## _register() {			\
 
 
 
+/* Per-pad state of the grid pressure stream, owned by the driver */
+struct ctlra_grid_pressure_t {
+	uint64_t last_ns;
+	float last;
+};
+
+/* The *screen_idx* th CTLRA_ITEM_FB_SCREEN feedback item of *dev*, or
+ * NULL if it has no such screen */
+const struct ctlra_item_info_t *
+ctlra_impl_screen_item(const struct ctlra_dev_t *dev, uint32_t screen_idx);
+
+/* Grows *zone* to include the pixels from x0, y0 up to x1, y1. A zone
+ * with no width or height is empty, and is set to the rectangle */
+static inline void
+ctlra_impl_zone_grow(struct ctlra_screen_zone_t *zone, int32_t x0,
+		     int32_t y0, int32_t x1, int32_t y1)
+{
+	if(x0 >= x1 || y0 >= y1)
+		return;
+	if(zone->w && zone->h) {
+		int32_t zx1 = zone->x + zone->w;
+		int32_t zy1 = zone->y + zone->h;
+		if((int32_t)zone->x < x0) x0 = zone->x;
+		if((int32_t)zone->y < y0) y0 = zone->y;
+		if(zx1 > x1) x1 = zx1;
+		if(zy1 > y1) y1 = zy1;
+	}
+	zone->x = x0;
+	zone->y = y0;
+	zone->w = x1 - x0;
+	zone->h = y1 - y0;
+}
+
+static inline uint64_t ctlra_impl_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Resets the stream state of a pad, call on every pad press */
+static inline void
+ctlra_dev_impl_grid_pressure_reset(struct ctlra_grid_pressure_t *pad,
+				   uint64_t now_ns, float value)
+{
+	pad->last_ns = now_ns;
+	pad->last = value;
+}
+
+/* Returns 1 if a pressure event for a held pad with a new *value*,
+ * sampled at *now_ns*, passes the rate limit and delta threshold the
+ * application requested for *grid_id*. Updates the pad state if so */
+static inline int
+ctlra_dev_impl_grid_pressure_due(const struct ctlra_dev_t *dev,
+				 uint32_t grid_id,
+				 struct ctlra_grid_pressure_t *pad,
+				 uint64_t now_ns, float value)
+{
+	uint64_t interval = dev->grid_pressure[grid_id].interval_ns;
+	float delta = dev->grid_pressure[grid_id].delta;
+	if(!interval || now_ns - pad->last_ns < interval)
+		return 0;
+	float d = value - pad->last;
+	if(d < delta && d > -delta)
+		return 0;
+	ctlra_dev_impl_grid_pressure_reset(pad, now_ns, value);
+	return 1;
+}
+
+/* Helper for strip_set() implementations: returns the state of LED *i*
+ * of an *n* LED strip, 0 for off, 1 for part of the bar, 2 for peak */
+static inline int
+ctlra_dev_impl_strip_led(uint32_t i, uint32_t n, float value, float peak)
+{
+	if(i < value * n)
+		return 1;
+	float top = peak * n;
+	return (i < top && i + 1 >= top) ? 2 : 0;
+}
+
 /* Helper function for dealing with wrapped encoders */
 static inline int8_t ctlra_dev_encoder_wrap_16(uint8_t newer, uint8_t older)
 {
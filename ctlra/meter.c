@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "impl.h"
+#include "meter.h"
+
+struct ctlra_meter_t {
+	/* float bits of the latest level, stored by the application */
+	uint32_t level;
+
+	/* state below is only touched by the LED tick */
+	uint8_t enabled;
+	uint32_t hold_ms;
+	float fall;
+	float value;
+	float peak;
+	uint64_t peak_ns;
+	uint64_t last_ns;
+	/* last values handed to the driver */
+	float drawn_value;
+	float drawn_peak;
+};
+
+struct ctlra_meters_t {
+	struct ctlra_meter_t meters[CTLRA_METERS_MAX];
+};
+
+/* 1 if feedback item *fb_id* is an LED strip. With fb_id ~0, 1 if the
+ * device has any LED strip */
+static int
+meter_item_is_strip(const struct ctlra_dev_t *dev, uint32_t fb_id)
+{
+	const struct ctlra_dev_info_t *info = &dev->info;
+	const struct ctlra_item_info_t *items =
+		info->control_info[CTLRA_FEEDBACK_ITEM];
+	if(!items)
+		return 0;
+
+	for(uint32_t i = 0; i < info->control_count[CTLRA_FEEDBACK_ITEM]; i++)
+		if((fb_id == ~0u || fb_id == i) &&
+		   (items[i].flags & CTLRA_ITEM_FB_LED_STRIP))
+			return 1;
+	return 0;
+}
+
+int32_t ctlra_dev_meter_enable(struct ctlra_dev_t *dev, uint32_t fb_id,
+			       uint32_t hold_ms, float fall_per_sec)
+{
+	if(!dev || (!dev->strip_set && !dev->feedback_set) ||
+	   !meter_item_is_strip(dev, ~0u))
+		return -ENOTSUP;
+	if(fb_id >= CTLRA_METERS_MAX || fall_per_sec < 0.f ||
+	   !meter_item_is_strip(dev, fb_id))
+		return -EINVAL;
+
+	/* published with release, as ctlra_dev_meter_set() may read it
+	 * from a realtime thread */
+	struct ctlra_meters_t *meters = dev->meters;
+	if(!meters) {
+		meters = calloc(1, sizeof(*meters));
+		if(!meters)
+			return -ENOMEM;
+		__atomic_store_n(&dev->meters, meters, __ATOMIC_RELEASE);
+	}
+
+	struct ctlra_meter_t *m = &meters->meters[fb_id];
+	memset(m, 0, sizeof(*m));
+	m->hold_ms = hold_ms;
+	m->fall = fall_per_sec;
+	/* force the first tick to draw the empty meter */
+	m->drawn_value = -1.f;
+	m->enabled = 1;
+	return 0;
+}
+
+void ctlra_dev_meter_disable(struct ctlra_dev_t *dev, uint32_t fb_id)
+{
+	if(!dev || !dev->meters || fb_id >= CTLRA_METERS_MAX)
+		return;
+	dev->meters->meters[fb_id].enabled = 0;
+}
+
+void ctlra_dev_meter_set(struct ctlra_dev_t *dev, uint32_t fb_id,
+			 float level)
+{
+	if(!dev || fb_id >= CTLRA_METERS_MAX)
+		return;
+	struct ctlra_meters_t *meters =
+		__atomic_load_n(&dev->meters, __ATOMIC_ACQUIRE);
+	if(!meters)
+		return;
+
+	union { float f; uint32_t u; } v = { .f = level };
+	__atomic_store_n(&meters->meters[fb_id].level, v.u, __ATOMIC_RELAXED);
+}
+
+static int
+meter_eval(struct ctlra_dev_t *dev, uint32_t fb_id,
+	   struct ctlra_meter_t *m, uint64_t now_ns)
+{
+	union { float f; uint32_t u; } v;
+	v.u = __atomic_load_n(&m->level, __ATOMIC_RELAXED);
+	float level = v.f;
+	/* NaN fails both compares and is treated as silence */
+	if(!(level > 0.f))
+		level = 0.f;
+	if(level > 1.f)
+		level = 1.f;
+
+	float fall = m->last_ns ? m->fall * (now_ns - m->last_ns) / 1e9f : 0;
+	m->last_ns = now_ns;
+
+	/* bar jumps up to the level, and falls back at the decay rate */
+	m->value -= fall;
+	if(m->value < level)
+		m->value = level;
+
+	/* peak holds for hold_ms, then falls until it meets the bar */
+	if(level >= m->peak) {
+		m->peak = level;
+		m->peak_ns = now_ns;
+	} else if(now_ns - m->peak_ns >= m->hold_ms * 1000000ull) {
+		m->peak -= fall;
+	}
+	if(m->peak < m->value)
+		m->peak = m->value;
+
+	float peak = m->hold_ms ? m->peak : 0.f;
+	if(m->value == m->drawn_value && peak == m->drawn_peak)
+		return 0;
+	m->drawn_value = m->value;
+	m->drawn_peak = peak;
+
+	if(dev->strip_set)
+		dev->strip_set(dev, fb_id, m->value, peak);
+	else
+		dev->feedback_set(dev, fb_id, m->value);
+	return 1;
+}
+
+int ctlra_impl_meter_tick(struct ctlra_dev_t *dev, uint64_t now_ns)
+{
+	if(!dev->meters)
+		return 0;
+
+	int written = 0;
+	for(uint32_t i = 0; i < CTLRA_METERS_MAX; i++) {
+		struct ctlra_meter_t *m = &dev->meters->meters[i];
+		if(m->enabled)
+			written |= meter_eval(dev, i, m, now_ns);
+	}
+	return written;
+}
+
+void ctlra_impl_meter_free(struct ctlra_dev_t *dev)
+{
+	struct ctlra_meters_t *meters = dev->meters;
+	__atomic_store_n(&dev->meters, 0, __ATOMIC_RELEASE);
+	free(meters);
+}
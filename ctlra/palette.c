@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdint.h>
+
+#include "palette.h"
+
+void
+ctlra_palette_init(struct ctlra_palette_t *pal,
+		   ctlra_palette_quantise_func quantise,
+		   void *userdata)
+{
+	if(pal->initialized)
+		return;
+
+	for(uint32_t i = 0; i < CTLRA_PALETTE_SIZE; i++) {
+		uint8_t r5 = (i >> 10) & 0x1f;
+		uint8_t g5 = (i >>  5) & 0x1f;
+		uint8_t b5 = (i >>  0) & 0x1f;
+		/* replicate high bits, so 0x1f expands to 0xff */
+		uint8_t r = (r5 << 3) | (r5 >> 2);
+		uint8_t g = (g5 << 3) | (g5 >> 2);
+		uint8_t b = (b5 << 3) | (b5 >> 2);
+		pal->table[i] = quantise(r, g, b, userdata);
+	}
+
+	pal->initialized = 1;
+}
+
+uint8_t
+ctlra_palette_ni_hue(uint8_t r, uint8_t g, uint8_t b, void *userdata)
+{
+	/* if equal components, then set white */
+	if(r == g && r == b)
+		return (uint8_t)(uintptr_t)userdata;
+
+	uint8_t max = r > g ? r : g;
+	max = b > max ? b : max;
+	uint8_t min = r < g ? r : g;
+	min = b < min ? b : min;
+
+	/* rgb to hsv, only the hue is used by the device */
+	uint8_t h;
+	if (max == r)
+		h = 0 + 43 * (g - b) / (max - min);
+	else if (max == g)
+		h = 85 + 43 * (b - r) / (max - min);
+	else
+		h = 171 + 43 * (r - g) / (max - min);
+
+	return h / 16 + 1;
+}
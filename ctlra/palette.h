@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CTLRA_PALETTE_H
+#define CTLRA_PALETTE_H
+
+#include <stdint.h>
+
+/* Colour quantisation for devices that take a palette index instead of
+ * RGB values. The 0xRRGGBB part of a light_status is reduced to 15 bits,
+ * which indexes a table precomputed once per palette. Drivers keep a
+ * static palette, initialize it on connect, and replace per-call colour
+ * maths with ctlra_palette_lookup().
+ */
+#define CTLRA_PALETTE_BITS 15
+#define CTLRA_PALETTE_SIZE (1 << CTLRA_PALETTE_BITS)
+
+/* 0xRRGGBB to 0bRRRRRGGGGGBBBBB */
+#define CTLRA_PALETTE_RGB15(status) ((((status) >> 9) & 0x7c00) | \
+				     (((status) >> 6) & 0x03e0) | \
+				     (((status) >> 3) & 0x001f))
+
+/* Quantises one colour, called once for each table entry. The 5 bit
+ * channels are expanded back to 8 bits before being passed in */
+typedef uint8_t (*ctlra_palette_quantise_func)(uint8_t r, uint8_t g,
+					       uint8_t b, void *userdata);
+
+struct ctlra_palette_t {
+	uint8_t initialized;
+	uint8_t table[CTLRA_PALETTE_SIZE];
+};
+
+/* Fills *pal* by calling *quantise* for each 15 bit colour. Initialized
+ * palettes are not recomputed, so this may be called on every connect */
+void ctlra_palette_init(struct ctlra_palette_t *pal,
+			ctlra_palette_quantise_func quantise,
+			void *userdata);
+
+static inline uint8_t
+ctlra_palette_lookup(const struct ctlra_palette_t *pal, uint32_t light_status)
+{
+	return pal->table[CTLRA_PALETTE_RGB15(light_status)];
+}
+
+/* Quantiser for the Native Instruments 16 hue palette used by the
+ * Maschine MK3 and Jam. Returns 0 for black, 1 to 16 for hues, and the
+ * white index passed as (uintptr_t)*userdata* for grey colours */
+uint8_t ctlra_palette_ni_hue(uint8_t r, uint8_t g, uint8_t b,
+			     void *userdata);
+
+#endif /* CTLRA_PALETTE_H */
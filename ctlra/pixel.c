@@ -0,0 +1,747 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <string.h>
+
+#include "ctlra.h"
+#include "pixel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PIXEL_X86 1
+#include <immintrin.h>
+#endif
+
+/* Scalar kernels. 565 channels are truncated from 8 bits, and the 565
+ * value is written high byte first for the big endian formats */
+
+static inline void
+store_565_be(uint8_t *dst, uint16_t v)
+{
+	dst[0] = v >> 8;
+	dst[1] = v;
+}
+
+static void
+argb32_to_565be_scalar(uint8_t *dst, const uint8_t *src, uint32_t num_px)
+{
+	for(uint32_t i = 0; i < num_px; i++) {
+		uint32_t p;
+		memcpy(&p, &src[i * 4], sizeof(p));
+		uint16_t v = ((p >> 8) & 0xf800) |
+			     ((p >> 5) & 0x07e0) |
+			     ((p >> 3) & 0x001f);
+		store_565_be(&dst[i * 2], v);
+	}
+}
+
+static void
+rgb565_to_565be_scalar(uint8_t *dst, const uint8_t *src, uint32_t num_px)
+{
+	for(uint32_t i = 0; i < num_px; i++) {
+		uint16_t v;
+		memcpy(&v, &src[i * 2], sizeof(v));
+		store_565_be(&dst[i * 2], v);
+	}
+}
+
+static void
+grey8_to_565be_scalar(uint8_t *dst, const uint8_t *src, uint32_t num_px)
+{
+	for(uint32_t i = 0; i < num_px; i++) {
+		uint16_t g = src[i];
+		uint16_t v = ((g << 8) & 0xf800) |
+			     ((g << 3) & 0x07e0) |
+			     (g >> 3);
+		store_565_be(&dst[i * 2], v);
+	}
+}
+
+/* Luma with weights summing to 256: 0.30 red, 0.59 green, 0.11 blue */
+#define LUMA_R 77
+#define LUMA_G 150
+#define LUMA_B 29
+
+static void
+argb32_to_grey8_scalar(uint8_t *dst, const uint8_t *src, uint32_t num_px)
+{
+	for(uint32_t i = 0; i < num_px; i++) {
+		uint32_t p;
+		memcpy(&p, &src[i * 4], sizeof(p));
+		dst[i] = (((p >> 16) & 0xff) * LUMA_R +
+			  ((p >>  8) & 0xff) * LUMA_G +
+			  ( p        & 0xff) * LUMA_B) >> 8;
+	}
+}
+
+static void
+rgb565_to_grey8_scalar(uint8_t *dst, const uint8_t *src, uint32_t num_px)
+{
+	for(uint32_t i = 0; i < num_px; i++) {
+		uint16_t v;
+		memcpy(&v, &src[i * 2], sizeof(v));
+		uint32_t r = (v >> 8) & 0xf8;
+		uint32_t g = (v >> 3) & 0xfc;
+		uint32_t b = (v << 3) & 0xf8;
+		dst[i] = (r * LUMA_R + g * LUMA_G + b * LUMA_B) >> 8;
+	}
+}
+
+static void
+page_pack_scalar(uint8_t *dst, const uint8_t *const *rows,
+		 const uint8_t (*pattern)[16], uint32_t w)
+{
+	for(uint32_t x = 0; x < w; x++) {
+		uint8_t v = 0;
+		for(int r = 0; r < 8; r++)
+			v |= (rows[r][x] > pattern[r][x & 15]) << r;
+		dst[x] = v;
+	}
+}
+
+/* Blend kernels composite premultiplied pixels: dst = src + dst * (255 -
+ * alpha) / 255 per channel, with the division rounded */
+static inline uint32_t
+div255(uint32_t t)
+{
+	t += 128;
+	return (t + (t >> 8)) >> 8;
+}
+
+static inline uint32_t
+blend_channel(uint32_t s, uint32_t d, uint32_t ia, uint32_t max)
+{
+	uint32_t v = s + div255(d * ia);
+	return v > max ? max : v;
+}
+
+static void
+blend_565be_scalar(uint8_t *dst, const uint8_t *src, const uint8_t *alpha,
+		   uint32_t num_px)
+{
+	for(uint32_t i = 0; i < num_px; i++) {
+		const uint32_t ia = 255 - alpha[i];
+		uint16_t s = (src[i * 2] << 8) | src[i * 2 + 1];
+		uint16_t d = (dst[i * 2] << 8) | dst[i * 2 + 1];
+		uint16_t v = blend_channel(s >> 11, d >> 11, ia, 31) << 11 |
+			     blend_channel((s >> 5) & 63, (d >> 5) & 63, ia,
+					   63) << 5 |
+			     blend_channel(s & 31, d & 31, ia, 31);
+		store_565_be(&dst[i * 2], v);
+	}
+}
+
+static void
+blend_grey8_scalar(uint8_t *dst, const uint8_t *src, const uint8_t *alpha,
+		   uint32_t num_px)
+{
+	for(uint32_t i = 0; i < num_px; i++)
+		dst[i] = blend_channel(src[i], dst[i], 255 - alpha[i], 255);
+}
+
+#ifdef PIXEL_X86
+/* 0xRRGGBB in each 32 bit lane to 565 in the low 16 bits */
+#define ARGB_TO_565(p, srli, and, or, set1)			\
+	or(or(and(srli(p, 8), set1(0xf800)),			\
+	      and(srli(p, 5), set1(0x07e0))),			\
+	   and(srli(p, 3), set1(0x001f)))
+
+/* 8 bit grey in each 16 bit lane to 565 */
+#define GREY_TO_565(g, slli, srli, and, or, set1)		\
+	or(or(and(slli(g, 8), set1(0xf800)),			\
+	      and(slli(g, 3), set1(0x07e0))),			\
+	   srli(g, 3))
+
+#define BSWAP16(v, slli, srli, or) or(slli(v, 8), srli(v, 8))
+
+__attribute__((target("sse2")))
+static void
+argb32_to_565be_sse2(uint8_t *dst, const uint8_t *src, uint32_t num_px)
+{
+	uint32_t i = 0;
+	for(; i + 8 <= num_px; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *)&src[i * 4]);
+		__m128i b = _mm_loadu_si128((const __m128i *)&src[i * 4 + 16]);
+		a = ARGB_TO_565(a, _mm_srli_epi32, _mm_and_si128,
+				_mm_or_si128, _mm_set1_epi32);
+		b = ARGB_TO_565(b, _mm_srli_epi32, _mm_and_si128,
+				_mm_or_si128, _mm_set1_epi32);
+		/* sign extend so the signed saturating pack is exact */
+		a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+		b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+		__m128i v = _mm_packs_epi32(a, b);
+		v = BSWAP16(v, _mm_slli_epi16, _mm_srli_epi16, _mm_or_si128);
+		_mm_storeu_si128((__m128i *)&dst[i * 2], v);
+	}
+	argb32_to_565be_scalar(&dst[i * 2], &src[i * 4], num_px - i);
+}
+
+__attribute__((target("sse2")))
+static void
+rgb565_to_565be_sse2(uint8_t *dst, const uint8_t *src, uint32_t num_px)
+{
+	uint32_t i = 0;
+	for(; i + 8 <= num_px; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *)&src[i * 2]);
+		v = BSWAP16(v, _mm_slli_epi16, _mm_srli_epi16, _mm_or_si128);
+		_mm_storeu_si128((__m128i *)&dst[i * 2], v);
+	}
+	rgb565_to_565be_scalar(&dst[i * 2], &src[i * 2], num_px - i);
+}
+
+__attribute__((target("sse2")))
+static void
+grey8_to_565be_sse2(uint8_t *dst, const uint8_t *src, uint32_t num_px)
+{
+	const __m128i zero = _mm_setzero_si128();
+	uint32_t i = 0;
+	for(; i + 16 <= num_px; i += 16) {
+		__m128i g = _mm_loadu_si128((const __m128i *)&src[i]);
+		__m128i lo = _mm_unpacklo_epi8(g, zero);
+		__m128i hi = _mm_unpackhi_epi8(g, zero);
+		lo = GREY_TO_565(lo, _mm_slli_epi16, _mm_srli_epi16,
+				 _mm_and_si128, _mm_or_si128, _mm_set1_epi16);
+		hi = GREY_TO_565(hi, _mm_slli_epi16, _mm_srli_epi16,
+				 _mm_and_si128, _mm_or_si128, _mm_set1_epi16);
+		lo = BSWAP16(lo, _mm_slli_epi16, _mm_srli_epi16, _mm_or_si128);
+		hi = BSWAP16(hi, _mm_slli_epi16, _mm_srli_epi16, _mm_or_si128);
+		_mm_storeu_si128((__m128i *)&dst[i * 2], lo);
+		_mm_storeu_si128((__m128i *)&dst[i * 2 + 16], hi);
+	}
+	grey8_to_565be_scalar(&dst[i * 2], &src[i], num_px - i);
+}
+
+__attribute__((target("sse2")))
+static void
+argb32_to_grey8_sse2(uint8_t *dst, const uint8_t *src, uint32_t num_px)
+{
+	const __m128i rb_mask = _mm_set1_epi32(0x00ff00ff);
+	const __m128i g_mask = _mm_set1_epi32(0xff);
+	const __m128i rb_w = _mm_set1_epi32((LUMA_R << 16) | LUMA_B);
+	const __m128i g_w = _mm_set1_epi32(LUMA_G);
+	uint32_t i = 0;
+	for(; i + 16 <= num_px; i += 16) {
+		__m128i l[4];
+		for(int j = 0; j < 4; j++) {
+			__m128i p = _mm_loadu_si128(
+				(const __m128i *)&src[(i + j * 4) * 4]);
+			/* 16 bit lanes [b, r] and [g, 0], summed by madd */
+			__m128i rb = _mm_and_si128(p, rb_mask);
+			__m128i g = _mm_and_si128(_mm_srli_epi32(p, 8), g_mask);
+			l[j] = _mm_add_epi32(_mm_madd_epi16(rb, rb_w),
+					     _mm_madd_epi16(g, g_w));
+			l[j] = _mm_srli_epi32(l[j], 8);
+		}
+		__m128i lo = _mm_packs_epi32(l[0], l[1]);
+		__m128i hi = _mm_packs_epi32(l[2], l[3]);
+		_mm_storeu_si128((__m128i *)&dst[i], _mm_packus_epi16(lo, hi));
+	}
+	argb32_to_grey8_scalar(&dst[i], &src[i * 4], num_px - i);
+}
+
+/* unsigned bytes a > b, as a mask of 0xff bytes */
+#define CMPGT_U8(a, b, cmpgt, xor, set1) \
+	cmpgt(xor(a, set1(0x80)), xor(b, set1(0x80)))
+
+__attribute__((target("sse2")))
+static void
+page_pack_sse2(uint8_t *dst, const uint8_t *const *rows,
+	       const uint8_t (*pattern)[16], uint32_t w)
+{
+	__m128i pat[8];
+	for(int r = 0; r < 8; r++)
+		pat[r] = _mm_loadu_si128((const __m128i *)pattern[r]);
+
+	uint32_t x = 0;
+	for(; x + 16 <= w; x += 16) {
+		__m128i v = _mm_setzero_si128();
+		for(int r = 0; r < 8; r++) {
+			__m128i g = _mm_loadu_si128(
+				(const __m128i *)&rows[r][x]);
+			__m128i m = CMPGT_U8(g, pat[r], _mm_cmpgt_epi8,
+					     _mm_xor_si128, _mm_set1_epi8);
+			v = _mm_or_si128(v, _mm_and_si128(m,
+						_mm_set1_epi8(1 << r)));
+		}
+		_mm_storeu_si128((__m128i *)&dst[x], v);
+	}
+	if(x < w) {
+		const uint8_t *tail[8];
+		for(int r = 0; r < 8; r++)
+			tail[r] = &rows[r][x];
+		/* x is a multiple of 16, so the pattern stays aligned */
+		page_pack_scalar(&dst[x], tail, pattern, w - x);
+	}
+}
+
+/* one 565 channel of 16 bit lanes, blended as blend_channel() does */
+#define BLEND_CH(s, d, ia, max, mullo, add, srli, min, set1)		\
+	min(add(s, srli(add(add(mullo(d, ia), set1(128)),		\
+			   srli(add(mullo(d, ia), set1(128)), 8)), 8)),	\
+	    set1(max))
+
+#define BLEND_565(s, d, ia, mullo, add, srli, slli, and, or, min, set1)	\
+	or(or(slli(BLEND_CH(srli(s, 11), srli(d, 11), ia, 31,		\
+			    mullo, add, srli, min, set1), 11),		\
+	      slli(BLEND_CH(and(srli(s, 5), set1(63)),			\
+			    and(srli(d, 5), set1(63)), ia, 63,		\
+			    mullo, add, srli, min, set1), 5)),		\
+	   BLEND_CH(and(s, set1(31)), and(d, set1(31)), ia, 31,		\
+		    mullo, add, srli, min, set1))
+
+__attribute__((target("sse2")))
+static void
+blend_565be_sse2(uint8_t *dst, const uint8_t *src, const uint8_t *alpha,
+		 uint32_t num_px)
+{
+	const __m128i zero = _mm_setzero_si128();
+	uint32_t i = 0;
+	for(; i + 8 <= num_px; i += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i *)&src[i * 2]);
+		__m128i d = _mm_loadu_si128((const __m128i *)&dst[i * 2]);
+		__m128i a = _mm_loadl_epi64((const __m128i *)&alpha[i]);
+		__m128i ia = _mm_sub_epi16(_mm_set1_epi16(255),
+					   _mm_unpacklo_epi8(a, zero));
+		s = BSWAP16(s, _mm_slli_epi16, _mm_srli_epi16, _mm_or_si128);
+		d = BSWAP16(d, _mm_slli_epi16, _mm_srli_epi16, _mm_or_si128);
+		__m128i v = BLEND_565(s, d, ia, _mm_mullo_epi16, _mm_add_epi16,
+				      _mm_srli_epi16, _mm_slli_epi16,
+				      _mm_and_si128, _mm_or_si128,
+				      _mm_min_epi16, _mm_set1_epi16);
+		v = BSWAP16(v, _mm_slli_epi16, _mm_srli_epi16, _mm_or_si128);
+		_mm_storeu_si128((__m128i *)&dst[i * 2], v);
+	}
+	blend_565be_scalar(&dst[i * 2], &src[i * 2], &alpha[i], num_px - i);
+}
+
+__attribute__((target("avx2")))
+static void
+argb32_to_565be_avx2(uint8_t *dst, const uint8_t *src, uint32_t num_px)
+{
+	uint32_t i = 0;
+	for(; i + 16 <= num_px; i += 16) {
+		const __m256i *p = (const __m256i *)&src[i * 4];
+		__m256i a = _mm256_loadu_si256(p);
+		__m256i b = _mm256_loadu_si256(p + 1);
+		a = ARGB_TO_565(a, _mm256_srli_epi32, _mm256_and_si256,
+				_mm256_or_si256, _mm256_set1_epi32);
+		b = ARGB_TO_565(b, _mm256_srli_epi32, _mm256_and_si256,
+				_mm256_or_si256, _mm256_set1_epi32);
+		a = _mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16);
+		b = _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16);
+		/* the pack works per 128 bit lane, restore pixel order */
+		__m256i v = _mm256_packs_epi32(a, b);
+		v = _mm256_permute4x64_epi64(v, 0xd8);
+		v = BSWAP16(v, _mm256_slli_epi16, _mm256_srli_epi16,
+			    _mm256_or_si256);
+		_mm256_storeu_si256((__m256i *)&dst[i * 2], v);
+	}
+	argb32_to_565be_scalar(&dst[i * 2], &src[i * 4], num_px - i);
+}
+
+__attribute__((target("avx2")))
+static void
+rgb565_to_565be_avx2(uint8_t *dst, const uint8_t *src, uint32_t num_px)
+{
+	uint32_t i = 0;
+	for(; i + 16 <= num_px; i += 16) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)&src[i * 2]);
+		v = BSWAP16(v, _mm256_slli_epi16, _mm256_srli_epi16,
+			    _mm256_or_si256);
+		_mm256_storeu_si256((__m256i *)&dst[i * 2], v);
+	}
+	rgb565_to_565be_scalar(&dst[i * 2], &src[i * 2], num_px - i);
+}
+
+__attribute__((target("avx2")))
+static void
+grey8_to_565be_avx2(uint8_t *dst, const uint8_t *src, uint32_t num_px)
+{
+	uint32_t i = 0;
+	for(; i + 16 <= num_px; i += 16) {
+		__m128i g8 = _mm_loadu_si128((const __m128i *)&src[i]);
+		__m256i g = _mm256_cvtepu8_epi16(g8);
+		g = GREY_TO_565(g, _mm256_slli_epi16, _mm256_srli_epi16,
+				_mm256_and_si256, _mm256_or_si256,
+				_mm256_set1_epi16);
+		g = BSWAP16(g, _mm256_slli_epi16, _mm256_srli_epi16,
+			    _mm256_or_si256);
+		_mm256_storeu_si256((__m256i *)&dst[i * 2], g);
+	}
+	grey8_to_565be_scalar(&dst[i * 2], &src[i], num_px - i);
+}
+__attribute__((target("avx2")))
+static void
+argb32_to_grey8_avx2(uint8_t *dst, const uint8_t *src, uint32_t num_px)
+{
+	const __m256i rb_mask = _mm256_set1_epi32(0x00ff00ff);
+	const __m256i g_mask = _mm256_set1_epi32(0xff);
+	const __m256i rb_w = _mm256_set1_epi32((LUMA_R << 16) | LUMA_B);
+	const __m256i g_w = _mm256_set1_epi32(LUMA_G);
+	/* the packs work per 128 bit lane, this restores pixel order */
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	uint32_t i = 0;
+	for(; i + 32 <= num_px; i += 32) {
+		__m256i l[4];
+		for(int j = 0; j < 4; j++) {
+			__m256i p = _mm256_loadu_si256(
+				(const __m256i *)&src[(i + j * 8) * 4]);
+			__m256i rb = _mm256_and_si256(p, rb_mask);
+			__m256i g = _mm256_and_si256(_mm256_srli_epi32(p, 8),
+						     g_mask);
+			l[j] = _mm256_add_epi32(_mm256_madd_epi16(rb, rb_w),
+						_mm256_madd_epi16(g, g_w));
+			l[j] = _mm256_srli_epi32(l[j], 8);
+		}
+		__m256i lo = _mm256_packs_epi32(l[0], l[1]);
+		__m256i hi = _mm256_packs_epi32(l[2], l[3]);
+		__m256i v = _mm256_packus_epi16(lo, hi);
+		v = _mm256_permutevar8x32_epi32(v, order);
+		_mm256_storeu_si256((__m256i *)&dst[i], v);
+	}
+	argb32_to_grey8_scalar(&dst[i], &src[i * 4], num_px - i);
+}
+
+__attribute__((target("avx2")))
+static void
+page_pack_avx2(uint8_t *dst, const uint8_t *const *rows,
+	       const uint8_t (*pattern)[16], uint32_t w)
+{
+	__m256i pat[8];
+	for(int r = 0; r < 8; r++) {
+		__m128i p = _mm_loadu_si128((const __m128i *)pattern[r]);
+		pat[r] = _mm256_broadcastsi128_si256(p);
+	}
+
+	uint32_t x = 0;
+	for(; x + 32 <= w; x += 32) {
+		__m256i v = _mm256_setzero_si256();
+		for(int r = 0; r < 8; r++) {
+			__m256i g = _mm256_loadu_si256(
+				(const __m256i *)&rows[r][x]);
+			__m256i m = CMPGT_U8(g, pat[r], _mm256_cmpgt_epi8,
+					     _mm256_xor_si256,
+					     _mm256_set1_epi8);
+			v = _mm256_or_si256(v, _mm256_and_si256(m,
+						_mm256_set1_epi8(1 << r)));
+		}
+		_mm256_storeu_si256((__m256i *)&dst[x], v);
+	}
+	if(x < w) {
+		const uint8_t *tail[8];
+		for(int r = 0; r < 8; r++)
+			tail[r] = &rows[r][x];
+		page_pack_scalar(&dst[x], tail, pattern, w - x);
+	}
+}
+
+__attribute__((target("avx2")))
+static void
+blend_565be_avx2(uint8_t *dst, const uint8_t *src, const uint8_t *alpha,
+		 uint32_t num_px)
+{
+	uint32_t i = 0;
+	for(; i + 16 <= num_px; i += 16) {
+		__m256i s = _mm256_loadu_si256((const __m256i *)&src[i * 2]);
+		__m256i d = _mm256_loadu_si256((const __m256i *)&dst[i * 2]);
+		__m128i a = _mm_loadu_si128((const __m128i *)&alpha[i]);
+		__m256i ia = _mm256_sub_epi16(_mm256_set1_epi16(255),
+					      _mm256_cvtepu8_epi16(a));
+		s = BSWAP16(s, _mm256_slli_epi16, _mm256_srli_epi16,
+			    _mm256_or_si256);
+		d = BSWAP16(d, _mm256_slli_epi16, _mm256_srli_epi16,
+			    _mm256_or_si256);
+		__m256i v = BLEND_565(s, d, ia, _mm256_mullo_epi16,
+				      _mm256_add_epi16, _mm256_srli_epi16,
+				      _mm256_slli_epi16, _mm256_and_si256,
+				      _mm256_or_si256, _mm256_min_epi16,
+				      _mm256_set1_epi16);
+		v = BSWAP16(v, _mm256_slli_epi16, _mm256_srli_epi16,
+			    _mm256_or_si256);
+		_mm256_storeu_si256((__m256i *)&dst[i * 2], v);
+	}
+	blend_565be_scalar(&dst[i * 2], &src[i * 2], &alpha[i], num_px - i);
+}
+#endif /* PIXEL_X86 */
+
+#define KERNEL(src, dst, func, isa, name)				\
+	{ name, CTLRA_PIXEL_ISA_##isa, CTLRA_PIXEL_FORMAT_##src,	\
+	  CTLRA_PIXEL_FORMAT_##dst, func }
+
+/* ordered slowest to fastest for each conversion */
+const struct ctlra_pixel_kernel_t ctlra_pixel_kernels[] = {
+	KERNEL(ARGB32, RGB565_BE, argb32_to_565be_scalar, SCALAR,
+	       "argb32_to_rgb565_be_scalar"),
+	KERNEL(RGB565, RGB565_BE, rgb565_to_565be_scalar, SCALAR,
+	       "rgb565_to_rgb565_be_scalar"),
+	KERNEL(GREY8,  RGB565_BE, grey8_to_565be_scalar, SCALAR,
+	       "grey8_to_rgb565_be_scalar"),
+	KERNEL(ARGB32, GREY8, argb32_to_grey8_scalar, SCALAR,
+	       "argb32_to_grey8_scalar"),
+	KERNEL(RGB565, GREY8, rgb565_to_grey8_scalar, SCALAR,
+	       "rgb565_to_grey8_scalar"),
+#ifdef PIXEL_X86
+	KERNEL(ARGB32, RGB565_BE, argb32_to_565be_sse2, SSE2,
+	       "argb32_to_rgb565_be_sse2"),
+	KERNEL(RGB565, RGB565_BE, rgb565_to_565be_sse2, SSE2,
+	       "rgb565_to_rgb565_be_sse2"),
+	KERNEL(GREY8,  RGB565_BE, grey8_to_565be_sse2, SSE2,
+	       "grey8_to_rgb565_be_sse2"),
+	KERNEL(ARGB32, GREY8, argb32_to_grey8_sse2, SSE2,
+	       "argb32_to_grey8_sse2"),
+	KERNEL(ARGB32, RGB565_BE, argb32_to_565be_avx2, AVX2,
+	       "argb32_to_rgb565_be_avx2"),
+	KERNEL(RGB565, RGB565_BE, rgb565_to_565be_avx2, AVX2,
+	       "rgb565_to_rgb565_be_avx2"),
+	KERNEL(GREY8,  RGB565_BE, grey8_to_565be_avx2, AVX2,
+	       "grey8_to_rgb565_be_avx2"),
+	KERNEL(ARGB32, GREY8, argb32_to_grey8_avx2, AVX2,
+	       "argb32_to_grey8_avx2"),
+#endif
+};
+const uint32_t ctlra_pixel_kernels_count =
+	sizeof(ctlra_pixel_kernels) / sizeof(ctlra_pixel_kernels[0]);
+
+const struct ctlra_pixel_page_kernel_t ctlra_pixel_page_kernels[] = {
+	{ "page_pack_scalar", CTLRA_PIXEL_ISA_SCALAR, page_pack_scalar },
+#ifdef PIXEL_X86
+	{ "page_pack_sse2", CTLRA_PIXEL_ISA_SSE2, page_pack_sse2 },
+	{ "page_pack_avx2", CTLRA_PIXEL_ISA_AVX2, page_pack_avx2 },
+#endif
+};
+const uint32_t ctlra_pixel_page_kernels_count =
+	sizeof(ctlra_pixel_page_kernels) / sizeof(ctlra_pixel_page_kernels[0]);
+
+const struct ctlra_pixel_blend_kernel_t ctlra_pixel_blend_kernels[] = {
+	{ "blend_rgb565_be_scalar", CTLRA_PIXEL_ISA_SCALAR,
+	  CTLRA_PIXEL_FORMAT_RGB565_BE, blend_565be_scalar },
+	{ "blend_grey8_scalar", CTLRA_PIXEL_ISA_SCALAR,
+	  CTLRA_PIXEL_FORMAT_GREY8, blend_grey8_scalar },
+#ifdef PIXEL_X86
+	{ "blend_rgb565_be_sse2", CTLRA_PIXEL_ISA_SSE2,
+	  CTLRA_PIXEL_FORMAT_RGB565_BE, blend_565be_sse2 },
+	{ "blend_rgb565_be_avx2", CTLRA_PIXEL_ISA_AVX2,
+	  CTLRA_PIXEL_FORMAT_RGB565_BE, blend_565be_avx2 },
+#endif
+};
+const uint32_t ctlra_pixel_blend_kernels_count =
+	sizeof(ctlra_pixel_blend_kernels) /
+	sizeof(ctlra_pixel_blend_kernels[0]);
+
+int ctlra_pixel_isa_supported(uint32_t isa)
+{
+	switch(isa) {
+	case CTLRA_PIXEL_ISA_SCALAR:
+		return 1;
+#ifdef PIXEL_X86
+	case CTLRA_PIXEL_ISA_SSE2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("sse2");
+	case CTLRA_PIXEL_ISA_AVX2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+	return 0;
+}
+
+static void copy8(uint8_t *dst, const uint8_t *src, uint32_t num_px)
+{
+	memcpy(dst, src, num_px);
+}
+
+static void copy16(uint8_t *dst, const uint8_t *src, uint32_t num_px)
+{
+	memcpy(dst, src, num_px * 2);
+}
+
+static void copy32(uint8_t *dst, const uint8_t *src, uint32_t num_px)
+{
+	memcpy(dst, src, num_px * 4);
+}
+
+ctlra_pixel_row_func ctlra_pixel_kernel_get(uint32_t src_format,
+					    uint32_t dst_format)
+{
+	if(src_format == dst_format) {
+		switch(ctlra_pixel_format_bpp(src_format)) {
+		case  8: return copy8;
+		case 16: return copy16;
+		case 32: return copy32;
+		}
+		return 0;
+	}
+
+	ctlra_pixel_row_func func = 0;
+	for(uint32_t i = 0; i < ctlra_pixel_kernels_count; i++) {
+		const struct ctlra_pixel_kernel_t *k = &ctlra_pixel_kernels[i];
+		if(k->src_format == src_format &&
+		   k->dst_format == dst_format &&
+		   ctlra_pixel_isa_supported(k->isa))
+			func = k->convert;
+	}
+	return func;
+}
+
+uint32_t ctlra_pixel_format_bpp(uint32_t format)
+{
+	switch(format) {
+	case CTLRA_PIXEL_FORMAT_ARGB32:    return 32;
+	case CTLRA_PIXEL_FORMAT_RGB565:    return 16;
+	case CTLRA_PIXEL_FORMAT_GREY8:     return 8;
+	case CTLRA_PIXEL_FORMAT_RGB565_BE: return 16;
+	case CTLRA_PIXEL_FORMAT_MONO1:     return 1;
+	}
+	return 0;
+}
+
+ctlra_pixel_page_func ctlra_pixel_page_kernel_get(void)
+{
+	ctlra_pixel_page_func func = 0;
+	for(uint32_t i = 0; i < ctlra_pixel_page_kernels_count; i++) {
+		const struct ctlra_pixel_page_kernel_t *k =
+			&ctlra_pixel_page_kernels[i];
+		if(ctlra_pixel_isa_supported(k->isa))
+			func = k->pack;
+	}
+	return func;
+}
+
+int ctlra_pixel_colour_get(uint32_t format, uint32_t colour, uint8_t out[4])
+{
+	const uint32_t src = colour | 0xff000000;
+	memset(out, 0, 4);
+	if(format == CTLRA_PIXEL_FORMAT_MONO1) {
+		argb32_to_grey8_scalar(out, (const uint8_t *)&src, 1);
+		out[0] = out[0] >= 128;
+		return 0;
+	}
+	ctlra_pixel_row_func conv =
+		ctlra_pixel_kernel_get(CTLRA_PIXEL_FORMAT_ARGB32, format);
+	if(!conv)
+		return -ENOTSUP;
+	conv(out, (const uint8_t *)&src, 1);
+	return 0;
+}
+
+ctlra_pixel_blend_func ctlra_pixel_blend_kernel_get(uint32_t format)
+{
+	ctlra_pixel_blend_func func = 0;
+	for(uint32_t i = 0; i < ctlra_pixel_blend_kernels_count; i++) {
+		const struct ctlra_pixel_blend_kernel_t *k =
+			&ctlra_pixel_blend_kernels[i];
+		if(k->format == format && ctlra_pixel_isa_supported(k->isa))
+			func = k->blend;
+	}
+	return func;
+}
+
+/* 8x8 Bayer matrix, thresholds are 4 * value + 2 */
+static const uint8_t bayer8[8][8] = {
+	{  0, 32,  8, 40,  2, 34, 10, 42 },
+	{ 48, 16, 56, 24, 50, 18, 58, 26 },
+	{ 12, 44,  4, 36, 14, 46,  6, 38 },
+	{ 60, 28, 52, 20, 62, 30, 54, 22 },
+	{  3, 35, 11, 43,  1, 33,  9, 41 },
+	{ 51, 19, 59, 27, 49, 17, 57, 25 },
+	{ 15, 47,  7, 39, 13, 45,  5, 37 },
+	{ 63, 31, 55, 23, 61, 29, 53, 21 },
+};
+
+/* Floyd-Steinberg: quantises *row* to 0 or 255 in place, carrying the
+ * error of each pixel in *err* (this row) and *err_next* (next row),
+ * both w + 2 long with a guard either side */
+static void
+fs_dither_row(uint8_t *row, int16_t *err, int16_t *err_next, uint32_t w,
+	      uint8_t threshold)
+{
+	memset(err_next, 0, (w + 2) * sizeof(*err_next));
+	for(uint32_t x = 0; x < w; x++) {
+		int32_t v = row[x] + err[x + 1];
+		int32_t out = v >= threshold ? 255 : 0;
+		int32_t e = v - out;
+		row[x] = out;
+		err[x + 2]      += e * 7 / 16;
+		err_next[x]     += e * 3 / 16;
+		err_next[x + 1] += e * 5 / 16;
+		err_next[x + 2] += e * 1 / 16;
+	}
+}
+
+int32_t ctlra_pixel_mono1_convert(uint8_t *dst, uint32_t w, uint32_t h,
+				  uint32_t src_format, const uint8_t *src,
+				  uint32_t src_stride, uint32_t dither,
+				  uint8_t threshold)
+{
+	const uint32_t src_bpp = ctlra_pixel_format_bpp(src_format);
+	ctlra_pixel_row_func grey =
+		ctlra_pixel_kernel_get(src_format, CTLRA_PIXEL_FORMAT_GREY8);
+	ctlra_pixel_page_func pack = ctlra_pixel_page_kernel_get();
+	if(!grey || !pack || src_bpp % 8 || w > CTLRA_PIXEL_MONO_W_MAX ||
+	   h % 8)
+		return -ENOTSUP;
+
+	if(!threshold)
+		threshold = 128;
+
+	/* pixels are set if grey > pattern, ie: grey >= threshold */
+	uint8_t pattern[8][16];
+	for(int r = 0; r < 8; r++) {
+		for(int x = 0; x < 16; x++) {
+			int32_t t = threshold;
+			if(dither == CTLRA_DITHER_ORDERED)
+				t += bayer8[r][x & 7] * 4 + 2 - 128;
+			else if(dither == CTLRA_DITHER_FLOYD_STEINBERG)
+				t = 128;
+			t = t < 1 ? 1 : (t > 255 ? 255 : t);
+			pattern[r][x] = t - 1;
+		}
+	}
+
+	uint8_t rows[8][CTLRA_PIXEL_MONO_W_MAX];
+	int16_t err[2][CTLRA_PIXEL_MONO_W_MAX + 2];
+	memset(err, 0, sizeof(err));
+	const uint8_t *row_ptrs[8];
+	for(int r = 0; r < 8; r++)
+		row_ptrs[r] = rows[r];
+
+	for(uint32_t page = 0; page < h / 8; page++) {
+		for(int r = 0; r < 8; r++) {
+			uint32_t y = page * 8 + r;
+			grey(rows[r], &src[y * src_stride], w);
+			if(dither == CTLRA_DITHER_FLOYD_STEINBERG)
+				fs_dither_row(rows[r], err[y & 1],
+					      err[(y + 1) & 1], w, threshold);
+		}
+		pack(&dst[page * w], row_ptrs, pattern, w);
+	}
+	return 0;
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CTLRA_PIXEL_H
+#define CTLRA_PIXEL_H
+
+#include <stdint.h>
+
+/* Pixel format conversion for screens. Each kernel converts one row of
+ * pixels from an application format into a device format, and is
+ * provided as scalar C and, on x86, SSE2 and AVX2 versions. The best
+ * version the CPU supports is picked at runtime by
+ * ctlra_pixel_kernel_get(). Formats are the CTLRA_PIXEL_FORMAT_* values
+ * from ctlra.h.
+ */
+#define CTLRA_PIXEL_ISA_SCALAR 0
+#define CTLRA_PIXEL_ISA_SSE2   1
+#define CTLRA_PIXEL_ISA_AVX2   2
+
+typedef void (*ctlra_pixel_row_func)(uint8_t *dst, const uint8_t *src,
+				     uint32_t num_px);
+
+struct ctlra_pixel_kernel_t {
+	const char *name;
+	uint32_t isa;
+	uint32_t src_format;
+	uint32_t dst_format;
+	ctlra_pixel_row_func convert;
+};
+
+/* All kernels built in, including ones the CPU may not support */
+extern const struct ctlra_pixel_kernel_t ctlra_pixel_kernels[];
+extern const uint32_t ctlra_pixel_kernels_count;
+
+/* Returns non-zero if the CPU running this code supports *isa* */
+int ctlra_pixel_isa_supported(uint32_t isa);
+
+/* Returns the fastest supported kernel from *src_format* to
+ * *dst_format*, or 0 if there is no such conversion */
+ctlra_pixel_row_func ctlra_pixel_kernel_get(uint32_t src_format,
+					    uint32_t dst_format);
+
+/* Bits per pixel of *format*, 0 for unknown formats */
+uint32_t ctlra_pixel_format_bpp(uint32_t format);
+
+/* Writes *colour*, 0xRRGGBB, to *out* as a pixel of *format*. For MONO1
+ * *out* is 1 if the colour is at least half bright, else 0. Returns
+ * -ENOTSUP if there is no conversion to *format* */
+int ctlra_pixel_colour_get(uint32_t format, uint32_t colour, uint8_t out[4]);
+
+/* Blend kernels composite a row of premultiplied pixels onto *dst*, both
+ * in the same format: dst = src + dst * (255 - alpha) / 255 for each
+ * channel, with one byte of *alpha* per pixel */
+typedef void (*ctlra_pixel_blend_func)(uint8_t *dst, const uint8_t *src,
+				       const uint8_t *alpha,
+				       uint32_t num_px);
+
+struct ctlra_pixel_blend_kernel_t {
+	const char *name;
+	uint32_t isa;
+	uint32_t format;
+	ctlra_pixel_blend_func blend;
+};
+
+extern const struct ctlra_pixel_blend_kernel_t ctlra_pixel_blend_kernels[];
+extern const uint32_t ctlra_pixel_blend_kernels_count;
+
+/* Returns the fastest supported blend kernel for *format*, or 0 */
+ctlra_pixel_blend_func ctlra_pixel_blend_kernel_get(uint32_t format);
+
+/* 1 bit screens are converted through 8 bit grey rows. MONO1 is stored
+ * in pages of 8 rows: byte x of page p holds column x of rows 8p to
+ * 8p + 7, with the top row in bit 0. A page kernel sets bit r of dst[x]
+ * when rows[r][x] > pattern[r][x % 16], so a single kernel does both a
+ * fixed threshold and ordered dithering.
+ */
+#define CTLRA_PIXEL_MONO_W_MAX 256
+
+typedef void (*ctlra_pixel_page_func)(uint8_t *dst,
+				      const uint8_t *const *rows,
+				      const uint8_t (*pattern)[16],
+				      uint32_t w);
+
+struct ctlra_pixel_page_kernel_t {
+	const char *name;
+	uint32_t isa;
+	ctlra_pixel_page_func pack;
+};
+
+extern const struct ctlra_pixel_page_kernel_t ctlra_pixel_page_kernels[];
+extern const uint32_t ctlra_pixel_page_kernels_count;
+
+/* Returns the fastest supported page kernel */
+ctlra_pixel_page_func ctlra_pixel_page_kernel_get(void);
+
+/* Converts a *w* x *h* image in *src_format* to MONO1 in *dst*, reduced
+ * with *dither* (CTLRA_DITHER_*) around *threshold*. The height must be
+ * a multiple of 8. Returns -ENOTSUP if the conversion isn't supported */
+int32_t ctlra_pixel_mono1_convert(uint8_t *dst, uint32_t w, uint32_t h,
+				  uint32_t src_format, const uint8_t *src,
+				  uint32_t src_stride, uint32_t dither,
+				  uint8_t threshold);
+
+#endif /* CTLRA_PIXEL_H */
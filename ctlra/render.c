@@ -0,0 +1,379 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "impl.h"
+#include "render.h"
+#include "share.h"
+
+#define RENDER_BUFFERS 3
+/* set in the middle index when it holds a frame not yet sent */
+#define RENDER_NEW (1u << 31)
+#define RENDER_QUEUE_MAX (CTLRA_RENDER_WORKERS * CTLRA_NUM_SCREENS_MAX * 8)
+
+struct ctlra_render_screen_t {
+	uint32_t bytes;
+	uint8_t *buf[RENDER_BUFFERS];
+	/* redraw callback result for the frame in each buffer */
+	int32_t flush[RENDER_BUFFERS];
+	struct ctlra_screen_zone_t zone[RENDER_BUFFERS];
+
+	/* owned by the worker running this screen's job */
+	uint32_t back;
+	int32_t last;
+	/* owned by ctlra_idle_iter() */
+	uint32_t front;
+	/* exchanged between both, with RENDER_NEW */
+	uint32_t middle;
+
+	/* a job for this screen is queued or running, under pool lock */
+	uint8_t busy;
+};
+
+struct ctlra_render_t {
+	uint32_t num_screens;
+	struct ctlra_render_screen_t screens[CTLRA_NUM_SCREENS_MAX];
+};
+
+struct ctlra_render_job_t {
+	struct ctlra_dev_t *dev;
+	uint32_t screen_idx;
+	ctlra_screen_redraw_cb func;
+	void *userdata;
+};
+
+struct ctlra_render_pool_t {
+	pthread_t threads[CTLRA_RENDER_WORKERS];
+	uint32_t num_threads;
+	pthread_mutex_t lock;
+	/* signalled when a job is queued, or on quit */
+	pthread_cond_t work;
+	/* signalled when a job is done */
+	pthread_cond_t done;
+	uint8_t quit;
+
+	uint32_t head;
+	uint32_t count;
+	struct ctlra_render_job_t queue[RENDER_QUEUE_MAX];
+};
+
+/* Combines the redraw request of an unsent frame *o* into *b*, which
+ * replaces it. Full redraws win over zones, zones are joined */
+static void
+render_merge(struct ctlra_render_screen_t *s, uint32_t b, uint32_t o)
+{
+	if(s->flush[b] == 3 || s->flush[o] == 3) {
+		s->flush[b] = 3;
+		return;
+	}
+	if(s->flush[b] == 1 || s->flush[o] == 1) {
+		s->flush[b] = 1;
+		return;
+	}
+
+	struct ctlra_screen_zone_t *z = &s->zone[b];
+	const struct ctlra_screen_zone_t *oz = &s->zone[o];
+	uint32_t x2 = z->x + z->w;
+	uint32_t y2 = z->y + z->h;
+	if(oz->x + oz->w > x2)
+		x2 = oz->x + oz->w;
+	if(oz->y + oz->h > y2)
+		y2 = oz->y + oz->h;
+	z->x = oz->x < z->x ? oz->x : z->x;
+	z->y = oz->y < z->y ? oz->y : z->y;
+	z->w = x2 - z->x;
+	z->h = y2 - z->y;
+}
+
+static void
+render_job_run(const struct ctlra_render_job_t *job)
+{
+	struct ctlra_render_screen_t *s =
+		&job->dev->render->screens[job->screen_idx];
+	uint32_t b = s->back;
+
+	/* the back buffer may be frames behind, apps can redraw only a
+	 * zone so bring it up to date with the last published frame */
+	if(s->last >= 0 && (uint32_t)s->last != b)
+		memcpy(s->buf[b], s->buf[s->last], s->bytes);
+	s->last = b;
+
+	struct ctlra_screen_zone_t zone = {0};
+	int32_t flush = job->func(job->dev, job->screen_idx, s->buf[b],
+				  s->bytes, &zone, job->userdata);
+	if(flush <= 0)
+		return;
+
+	s->flush[b] = flush;
+	s->zone[b] = zone;
+
+	uint32_t mid = __atomic_load_n(&s->middle, __ATOMIC_ACQUIRE);
+	do {
+		/* a frame that was never sent is replaced by this one */
+		if(mid & RENDER_NEW)
+			render_merge(s, b, mid & ~RENDER_NEW);
+	} while(!__atomic_compare_exchange_n(&s->middle, &mid,
+					     b | RENDER_NEW, 0,
+					     __ATOMIC_ACQ_REL,
+					     __ATOMIC_ACQUIRE));
+	s->back = mid & ~RENDER_NEW;
+}
+
+static void *
+render_worker(void *data)
+{
+	struct ctlra_render_pool_t *pool = data;
+
+	pthread_mutex_lock(&pool->lock);
+	for(;;) {
+		while(!pool->quit && pool->count == 0)
+			pthread_cond_wait(&pool->work, &pool->lock);
+		if(pool->quit)
+			break;
+
+		struct ctlra_render_job_t job = pool->queue[pool->head];
+		pool->head = (pool->head + 1) % RENDER_QUEUE_MAX;
+		pool->count--;
+
+		pthread_mutex_unlock(&pool->lock);
+		render_job_run(&job);
+		pthread_mutex_lock(&pool->lock);
+
+		job.dev->render->screens[job.screen_idx].busy = 0;
+		pthread_cond_broadcast(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return 0;
+}
+
+static struct ctlra_render_pool_t *
+render_pool_get(struct ctlra_t *ctlra)
+{
+	if(ctlra->render_pool)
+		return ctlra->render_pool;
+
+	struct ctlra_render_pool_t *pool = calloc(1, sizeof(*pool));
+	if(!pool)
+		return 0;
+
+	pthread_mutex_init(&pool->lock, 0);
+	pthread_cond_init(&pool->work, 0);
+	pthread_cond_init(&pool->done, 0);
+
+	for(uint32_t i = 0; i < CTLRA_RENDER_WORKERS; i++) {
+		if(pthread_create(&pool->threads[i], 0, render_worker, pool))
+			break;
+		pool->num_threads++;
+	}
+
+	ctlra->render_pool = pool;
+	if(!pool->num_threads) {
+		ctlra_impl_render_pool_free(ctlra);
+		return 0;
+	}
+	return pool;
+}
+
+int32_t ctlra_dev_screen_async(struct ctlra_dev_t *dev, uint32_t enable)
+{
+	if(!dev || !dev->screen_get_data)
+		return -ENOTSUP;
+
+	if(!enable) {
+		ctlra_impl_render_free(dev);
+		return 0;
+	}
+	if(dev->render)
+		return 0;
+	if(dev->share) {
+		for(uint32_t i = 0; i < CTLRA_NUM_SCREENS_MAX; i++)
+			if(ctlra_impl_share_active(dev, i))
+				return -EBUSY;
+	}
+
+	if(!render_pool_get(dev->ctlra_context))
+		return -ENOMEM;
+
+	struct ctlra_render_t *r = calloc(1, sizeof(*r));
+	if(!r)
+		return -ENOMEM;
+
+	while(r->num_screens < CTLRA_NUM_SCREENS_MAX &&
+	      ctlra_impl_screen_item(dev, r->num_screens))
+		r->num_screens++;
+	if(!r->num_screens) {
+		free(r);
+		return -ENOTSUP;
+	}
+
+	for(uint32_t i = 0; i < r->num_screens; i++) {
+		struct ctlra_render_screen_t *s = &r->screens[i];
+		struct ctlra_screen_zone_t zone = {0};
+		uint8_t *pixels = 0;
+		uint32_t bytes = 0;
+		if(dev->screen_get_data(dev, i, &pixels, &bytes, &zone, 0) ||
+		   !pixels || !bytes)
+			goto fail;
+
+		/* all buffers start as the current screen contents */
+		s->bytes = bytes;
+		for(int b = 0; b < RENDER_BUFFERS; b++) {
+			s->buf[b] = malloc(bytes);
+			if(!s->buf[b])
+				goto fail;
+			memcpy(s->buf[b], pixels, bytes);
+		}
+		s->front = 0;
+		s->back = 1;
+		s->middle = 2;
+		s->last = -1;
+	}
+
+	dev->render = r;
+	return 0;
+
+fail:
+	for(uint32_t i = 0; i < r->num_screens; i++)
+		for(int b = 0; b < RENDER_BUFFERS; b++)
+			free(r->screens[i].buf[b]);
+	free(r);
+	return -ENOMEM;
+}
+
+void ctlra_impl_render_tick(struct ctlra_dev_t *dev, int redraw)
+{
+	struct ctlra_render_t *r = dev->render;
+	struct ctlra_render_pool_t *pool = dev->ctlra_context->render_pool;
+
+	if(redraw && dev->screen_redraw_cb) {
+		pthread_mutex_lock(&pool->lock);
+		for(uint32_t i = 0; i < r->num_screens; i++) {
+			struct ctlra_render_screen_t *s = &r->screens[i];
+			/* a slow screen skips redraws, it doesn't queue up */
+			if(s->busy || pool->count == RENDER_QUEUE_MAX)
+				continue;
+			uint32_t tail = (pool->head + pool->count) %
+					RENDER_QUEUE_MAX;
+			pool->queue[tail] = (struct ctlra_render_job_t) {
+				.dev = dev,
+				.screen_idx = i,
+				.func = dev->screen_redraw_cb,
+				.userdata = dev->screen_redraw_ud,
+			};
+			pool->count++;
+			s->busy = 1;
+		}
+		pthread_cond_broadcast(&pool->work);
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	for(uint32_t i = 0; i < r->num_screens; i++) {
+		struct ctlra_render_screen_t *s = &r->screens[i];
+		uint32_t mid = __atomic_load_n(&s->middle, __ATOMIC_ACQUIRE);
+		if(!(mid & RENDER_NEW))
+			continue;
+
+		uint32_t f = __atomic_exchange_n(&s->middle, s->front,
+						 __ATOMIC_ACQ_REL);
+		f &= ~RENDER_NEW;
+		s->front = f;
+
+		struct ctlra_screen_zone_t zone = s->zone[f];
+		uint8_t *pixels = 0;
+		uint32_t bytes = 0;
+		if(dev->screen_get_data(dev, i, &pixels, &bytes, &zone, 0) ||
+		   !pixels)
+			continue;
+		memcpy(pixels, s->buf[f], bytes < s->bytes ? bytes : s->bytes);
+		dev->screen_get_data(dev, i, &pixels, &bytes, &zone,
+				     s->flush[f]);
+	}
+}
+
+void ctlra_impl_render_free(struct ctlra_dev_t *dev)
+{
+	struct ctlra_render_t *r = dev->render;
+	if(!r)
+		return;
+
+	struct ctlra_render_pool_t *pool = dev->ctlra_context->render_pool;
+	pthread_mutex_lock(&pool->lock);
+
+	/* drop queued jobs of this device, then wait for running ones */
+	uint32_t kept = 0;
+	for(uint32_t i = 0; i < pool->count; i++) {
+		struct ctlra_render_job_t *job =
+			&pool->queue[(pool->head + i) % RENDER_QUEUE_MAX];
+		if(job->dev == dev) {
+			r->screens[job->screen_idx].busy = 0;
+			continue;
+		}
+		pool->queue[(pool->head + kept) % RENDER_QUEUE_MAX] = *job;
+		kept++;
+	}
+	pool->count = kept;
+
+	for(uint32_t i = 0; i < r->num_screens; i++)
+		while(r->screens[i].busy)
+			pthread_cond_wait(&pool->done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+
+	for(uint32_t i = 0; i < r->num_screens; i++)
+		for(int b = 0; b < RENDER_BUFFERS; b++)
+			free(r->screens[i].buf[b]);
+	free(r);
+	dev->render = 0;
+}
+
+void ctlra_impl_render_pool_free(struct ctlra_t *ctlra)
+{
+	struct ctlra_render_pool_t *pool = ctlra->render_pool;
+	if(!pool)
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = 1;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	for(uint32_t i = 0; i < pool->num_threads; i++)
+		pthread_join(pool->threads[i], 0);
+
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->work);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+	ctlra->render_pool = 0;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CTLRA_RENDER_H
+#define CTLRA_RENDER_H
+
+#include <stdint.h>
+
+struct ctlra_t;
+struct ctlra_dev_t;
+
+/* Asynchronous screen rendering, enabled per device with
+ * ctlra_dev_screen_async(). ctlra_idle_iter() queues a redraw job for
+ * each screen on the context's worker pool instead of calling the redraw
+ * callback itself. Each screen is triple buffered: a worker draws into
+ * the back buffer and publishes it by atomically swapping it with the
+ * middle buffer, and ctlra_idle_iter() swaps the middle buffer to the
+ * front when a new frame is there, and hands it to the driver.
+ */
+#define CTLRA_RENDER_WORKERS 2
+
+/* Queues redraws of the screens of *dev* if *redraw* is set, and sends
+ * frames the workers finished to the driver */
+void ctlra_impl_render_tick(struct ctlra_dev_t *dev, int redraw);
+/* Waits for the jobs of *dev* and frees its buffers */
+void ctlra_impl_render_free(struct ctlra_dev_t *dev);
+/* Stops the worker pool of *ctlra*, all devices must be freed */
+void ctlra_impl_render_pool_free(struct ctlra_t *ctlra);
+
+#endif /* CTLRA_RENDER_H */
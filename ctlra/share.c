@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "impl.h"
+#include "pixel.h"
+#include "share.h"
+
+#if defined(__linux__) && defined(MFD_CLOEXEC) && defined(F_SEAL_SEAL)
+#define SHARE_MEMFD 1
+#endif
+
+struct ctlra_share_screen_t {
+	int fd;
+	/* private copies of the layout, the control page is writable by
+	 * the other process */
+	uint32_t size;
+	uint32_t bytes;
+	uint32_t width;
+	uint32_t height;
+	struct ctlra_screen_share_t *ctl;
+	uint8_t *buf[CTLRA_SCREEN_SHARE_BUFFERS];
+	/* last frame handed to the driver */
+	uint32_t seq;
+	uint8_t *last;
+};
+
+struct ctlra_share_t {
+	struct ctlra_share_screen_t screens[CTLRA_NUM_SCREENS_MAX];
+};
+
+int ctlra_impl_share_active(const struct ctlra_dev_t *dev,
+			    uint32_t screen_idx)
+{
+	return dev->share && screen_idx < CTLRA_NUM_SCREENS_MAX &&
+	       dev->share->screens[screen_idx].ctl;
+}
+
+/* Hands *buf* to the driver of *screen_idx* and flushes it. Drivers
+ * with screen_set_pixels read it in place, others get a copy */
+static void
+share_send(struct ctlra_dev_t *dev, uint32_t screen_idx,
+	   struct ctlra_share_screen_t *s, uint8_t *buf,
+	   struct ctlra_screen_zone_t *zone, uint8_t flush)
+{
+	uint8_t *pixels = 0;
+	uint32_t bytes = 0;
+
+	if(dev->screen_set_pixels &&
+	   !dev->screen_set_pixels(dev, screen_idx, buf)) {
+		dev->screen_get_data(dev, screen_idx, &pixels, &bytes, zone,
+				     flush);
+		return;
+	}
+	if(dev->screen_get_data(dev, screen_idx, &pixels, &bytes, zone, 0) ||
+	   !pixels)
+		return;
+	memcpy(pixels, buf, bytes < s->bytes ? bytes : s->bytes);
+	dev->screen_get_data(dev, screen_idx, &pixels, &bytes, zone, flush);
+}
+
+/* Clamps *zone* to the screen, returns 0 if nothing is left of it */
+static int
+share_zone_clamp(const struct ctlra_share_screen_t *s,
+		 struct ctlra_screen_zone_t *zone)
+{
+	if(zone->x >= s->width || zone->y >= s->height ||
+	   !zone->w || !zone->h)
+		return 0;
+	if(zone->w > s->width - zone->x)
+		zone->w = s->width - zone->x;
+	if(zone->h > s->height - zone->y)
+		zone->h = s->height - zone->y;
+	return 1;
+}
+
+void ctlra_impl_share_tick(struct ctlra_dev_t *dev)
+{
+	struct ctlra_share_t *sh = dev->share;
+	if(!sh)
+		return;
+
+	for(uint32_t i = 0; i < CTLRA_NUM_SCREENS_MAX; i++) {
+		struct ctlra_share_screen_t *s = &sh->screens[i];
+		if(!s->ctl)
+			continue;
+		uint32_t seq = __atomic_load_n(&s->ctl->seq, __ATOMIC_ACQUIRE);
+		if(seq == s->seq)
+			continue;
+
+		const uint32_t b = seq % CTLRA_SCREEN_SHARE_BUFFERS;
+		struct ctlra_screen_share_frame_t frame = s->ctl->frame[b];
+		uint8_t flush = frame.flush > 3 ? 3 : frame.flush;
+		if(!flush)
+			flush = 1;
+		/* the zones of skipped frames are lost, and a zone off the
+		 * screen says nothing, so diff the frame instead */
+		if(flush == 2 && (seq != s->seq + 1 ||
+				  !share_zone_clamp(s, &frame.zone)))
+			flush = 1;
+		if(flush != 2)
+			frame.zone = (struct ctlra_screen_zone_t){0};
+
+		share_send(dev, i, s, s->buf[b], &frame.zone, flush);
+		s->seq = seq;
+		s->last = s->buf[b];
+		__atomic_store_n(&s->ctl->acked, seq, __ATOMIC_RELEASE);
+	}
+}
+
+int32_t ctlra_dev_screen_share(struct ctlra_dev_t *dev, uint32_t screen_idx,
+			       int *fd)
+{
+	if(!dev || !fd || !dev->screen_get_data ||
+	   screen_idx >= CTLRA_NUM_SCREENS_MAX)
+		return -ENOTSUP;
+	const struct ctlra_item_info_t *item =
+		ctlra_impl_screen_item(dev, screen_idx);
+	if(!item)
+		return -ENOTSUP;
+	if(dev->render)
+		return -EBUSY;
+	if(ctlra_impl_share_active(dev, screen_idx)) {
+		*fd = dev->share->screens[screen_idx].fd;
+		return 0;
+	}
+#ifdef SHARE_MEMFD
+	uint8_t *pixels = 0;
+	uint32_t bytes = 0;
+	struct ctlra_screen_zone_t zone = {0};
+	if(dev->screen_get_data(dev, screen_idx, &pixels, &bytes, &zone, 0) ||
+	   !pixels || !bytes)
+		return -ENOTSUP;
+
+	if(!dev->share) {
+		dev->share = calloc(1, sizeof(struct ctlra_share_t));
+		if(!dev->share)
+			return -ENOMEM;
+	}
+	struct ctlra_share_screen_t *s = &dev->share->screens[screen_idx];
+
+	const uint32_t page = sysconf(_SC_PAGESIZE);
+	const uint32_t frame = (bytes + page - 1) / page * page;
+	const uint32_t size = page + frame * CTLRA_SCREEN_SHARE_BUFFERS;
+
+	int f = memfd_create("ctlra-screen", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if(f < 0)
+		return -errno;
+	/* the other process must not shrink the memory under our mapping */
+	if(ftruncate(f, size) ||
+	   fcntl(f, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)) {
+		int ret = -errno;
+		close(f);
+		return ret;
+	}
+	void *map = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, f, 0);
+	if(map == MAP_FAILED) {
+		int ret = -errno;
+		close(f);
+		return ret;
+	}
+
+	const uint32_t w = item->params[0];
+	const uint32_t format = item->params[3];
+	struct ctlra_screen_share_t *ctl = map;
+	ctl->magic = CTLRA_SCREEN_SHARE_MAGIC;
+	ctl->version = CTLRA_SCREEN_SHARE_VERSION;
+	ctl->size = size;
+	ctl->width = w;
+	ctl->height = item->params[1];
+	ctl->stride = format == CTLRA_PIXEL_FORMAT_MONO1 ? w :
+		      w * ctlra_pixel_format_bpp(format) / 8;
+	ctl->format = format;
+	ctl->bytes = bytes;
+
+	s->fd = f;
+	s->size = size;
+	s->bytes = bytes;
+	s->width = w;
+	s->height = item->params[1];
+	s->ctl = ctl;
+	s->seq = 0;
+	for(uint32_t i = 0; i < CTLRA_SCREEN_SHARE_BUFFERS; i++) {
+		ctl->buffer_offset[i] = page + frame * i;
+		s->buf[i] = (uint8_t *)map + page + frame * i;
+		/* start from what is on the screen */
+		memcpy(s->buf[i], pixels, bytes);
+	}
+	s->last = s->buf[0];
+
+	*fd = f;
+	return 0;
+#else
+	return -ENOTSUP;
+#endif
+}
+
+int32_t ctlra_dev_screen_unshare(struct ctlra_dev_t *dev,
+				 uint32_t screen_idx)
+{
+	if(!dev || !ctlra_impl_share_active(dev, screen_idx))
+		return -EINVAL;
+	struct ctlra_share_screen_t *s = &dev->share->screens[screen_idx];
+
+	/* give the driver its own framebuffer back, holding the last frame
+	 * so the next redraw diffs against what is on the screen */
+	if(dev->screen_set_pixels) {
+		uint8_t *pixels = 0;
+		uint32_t bytes = 0;
+		struct ctlra_screen_zone_t zone = {0};
+		dev->screen_set_pixels(dev, screen_idx, 0);
+		if(!dev->screen_get_data(dev, screen_idx, &pixels, &bytes,
+					 &zone, 0) && pixels)
+			memcpy(pixels, s->last,
+			       bytes < s->bytes ? bytes : s->bytes);
+	}
+
+	munmap(s->ctl, s->size);
+	close(s->fd);
+	memset(s, 0, sizeof(*s));
+	return 0;
+}
+
+void ctlra_impl_share_free(struct ctlra_dev_t *dev)
+{
+	if(!dev->share)
+		return;
+	for(uint32_t i = 0; i < CTLRA_NUM_SCREENS_MAX; i++)
+		ctlra_dev_screen_unshare(dev, i);
+	free(dev->share);
+	dev->share = 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CTLRA_SHARE_H
+#define CTLRA_SHARE_H
+
+#include <stdint.h>
+
+struct ctlra_dev_t;
+struct ctlra_share_t;
+
+/* Screens shared with another process, see ctlra_dev_screen_share().
+ * Each shared screen is a sealed memfd holding the control page and
+ * CTLRA_SCREEN_SHARE_BUFFERS frame buffers. The other process
+ * publishes a frame by bumping the sequence counter in the control
+ * page; ctlra_idle_iter() picks up the newest frame, hands its buffer
+ * to the driver, and acks it so the buffer can be drawn again. Nothing
+ * in the control page is trusted: the layout is kept privately, and
+ * the flush and zone are clamped before use.
+ */
+
+/* Sends the newest frame of each shared screen of *dev* */
+void ctlra_impl_share_tick(struct ctlra_dev_t *dev);
+/* Returns non-zero if *screen_idx* of *dev* is shared, so the redraw
+ * callback must not draw it */
+int ctlra_impl_share_active(const struct ctlra_dev_t *dev,
+			    uint32_t screen_idx);
+/* Unshares all screens of *dev*, called on disconnect */
+void ctlra_impl_share_free(struct ctlra_dev_t *dev);
+
+#endif /* CTLRA_SHARE_H */
@@ -0,0 +1,337 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "impl.h"
+#include "pixel.h"
+#include "sprite.h"
+
+#define RUN_COPY  0
+#define RUN_BLEND 1
+
+struct ctlra_sprite_run_t {
+	uint16_t x;
+	uint16_t len;
+	uint8_t op;
+};
+
+struct ctlra_sprite_t {
+	uint32_t w;
+	uint32_t h;
+	/* native pixels, premultiplied if the sprite has alpha */
+	uint8_t *px;
+	/* alpha of each pixel, NULL for opaque sprites */
+	uint8_t *alpha;
+	/* runs of row y are runs[row_runs[y]] up to runs[row_runs[y + 1]] */
+	uint32_t *row_runs;
+	struct ctlra_sprite_run_t *runs;
+};
+
+struct ctlra_sprites_t {
+	uint32_t bytes;
+	ctlra_pixel_blend_func blend;
+	struct ctlra_sprite_t *sprites[CTLRA_SPRITES_MAX];
+};
+
+static void
+sprite_destroy(struct ctlra_sprite_t *s)
+{
+	if(!s)
+		return;
+	free(s->px);
+	free(s->alpha);
+	free(s->row_runs);
+	free(s->runs);
+	free(s);
+}
+
+void ctlra_impl_sprite_free(struct ctlra_dev_t *dev)
+{
+	for(int i = 0; i < CTLRA_NUM_SCREENS_MAX; i++) {
+		struct ctlra_sprites_t *sp = dev->sprites[i];
+		if(!sp)
+			continue;
+		for(int j = 0; j < CTLRA_SPRITES_MAX; j++)
+			sprite_destroy(sp->sprites[j]);
+		free(sp);
+		dev->sprites[i] = 0;
+	}
+}
+
+static inline uint8_t
+sprite_run_op(uint8_t a)
+{
+	return a == 255 ? RUN_COPY : RUN_BLEND;
+}
+
+/* Splits the rows of *s* into runs, leaving out transparent pixels */
+static int
+sprite_build_runs(struct ctlra_sprite_t *s)
+{
+	uint32_t count = 0;
+	uint32_t size = s->h * 2;
+	s->runs = malloc(size * sizeof(struct ctlra_sprite_run_t));
+	s->row_runs = malloc((s->h + 1) * sizeof(uint32_t));
+	if(!s->runs || !s->row_runs)
+		return -ENOMEM;
+
+	for(uint32_t y = 0; y < s->h; y++) {
+		const uint8_t *a = &s->alpha[y * s->w];
+		s->row_runs[y] = count;
+		uint32_t x = 0;
+		while(x < s->w) {
+			if(a[x] == 0) {
+				x++;
+				continue;
+			}
+			const uint8_t op = sprite_run_op(a[x]);
+			uint32_t end = x + 1;
+			while(end < s->w && a[end] &&
+			      sprite_run_op(a[end]) == op)
+				end++;
+
+			if(count == size) {
+				size *= 2;
+				void *r = realloc(s->runs, size *
+					sizeof(struct ctlra_sprite_run_t));
+				if(!r)
+					return -ENOMEM;
+				s->runs = r;
+			}
+			s->runs[count++] = (struct ctlra_sprite_run_t) {
+				.x = x, .len = end - x, .op = op,
+			};
+			x = end;
+		}
+	}
+	s->row_runs[s->h] = count;
+	return 0;
+}
+
+static inline uint32_t
+sprite_premultiply_channel(uint32_t c, uint32_t a)
+{
+	c = c * a + 128;
+	return (c + (c >> 8)) >> 8;
+}
+
+static inline uint32_t
+sprite_premultiply(uint32_t p)
+{
+	const uint32_t a = p >> 24;
+	return a << 24 |
+	       sprite_premultiply_channel((p >> 16) & 0xff, a) << 16 |
+	       sprite_premultiply_channel((p >>  8) & 0xff, a) << 8 |
+	       sprite_premultiply_channel( p        & 0xff, a);
+}
+
+int32_t ctlra_screen_sprite_add(struct ctlra_dev_t *dev,
+				uint32_t screen_idx,
+				uint32_t src_format,
+				const uint8_t *src,
+				uint32_t w, uint32_t h,
+				uint32_t src_stride,
+				uint32_t flags)
+{
+	if(!dev || !src || screen_idx >= CTLRA_NUM_SCREENS_MAX)
+		return -ENOTSUP;
+	if(!w || !h)
+		return -EINVAL;
+	/* only ARGB32 images carry alpha */
+	const int blend = flags & CTLRA_SPRITE_BLEND;
+	if(blend && src_format != CTLRA_PIXEL_FORMAT_ARGB32)
+		return -EINVAL;
+
+	const struct ctlra_item_info_t *item =
+		ctlra_impl_screen_item(dev, screen_idx);
+	if(!item)
+		return -ENOTSUP;
+	/* nothing larger than the screen can be shown, and this bounds
+	 * the buffer sizes below */
+	if(w > item->params[0] || h > item->params[1])
+		return -EINVAL;
+	const uint32_t format = item->params[3];
+	const uint32_t bpp = ctlra_pixel_format_bpp(format);
+	ctlra_pixel_row_func convert =
+		ctlra_pixel_kernel_get(src_format, format);
+	ctlra_pixel_blend_func blend_func =
+		ctlra_pixel_blend_kernel_get(format);
+	if(!convert || bpp % 8 || (blend && !blend_func))
+		return -ENOTSUP;
+
+	struct ctlra_sprites_t *sp = dev->sprites[screen_idx];
+	if(!sp) {
+		sp = calloc(1, sizeof(struct ctlra_sprites_t));
+		if(!sp)
+			return -ENOMEM;
+		sp->bytes = bpp / 8;
+		sp->blend = blend_func;
+		dev->sprites[screen_idx] = sp;
+	}
+
+	int32_t id = 0;
+	while(id < CTLRA_SPRITES_MAX && sp->sprites[id])
+		id++;
+	if(id == CTLRA_SPRITES_MAX)
+		return -ENOSPC;
+
+	int32_t ret = -ENOMEM;
+	uint32_t *tmp = 0;
+	struct ctlra_sprite_t *s = calloc(1, sizeof(struct ctlra_sprite_t));
+	if(!s)
+		goto fail;
+	s->w = w;
+	s->h = h;
+	s->px = malloc((size_t)w * h * sp->bytes);
+	if(!s->px)
+		goto fail;
+	if(blend) {
+		s->alpha = malloc((size_t)w * h);
+		tmp = malloc(w * sizeof(uint32_t));
+		if(!s->alpha || !tmp)
+			goto fail;
+	}
+
+	for(uint32_t y = 0; y < h; y++) {
+		const uint8_t *row = &src[(size_t)y * src_stride];
+		if(blend) {
+			/* keep alpha, premultiplying the colour if asked */
+			memcpy(tmp, row, w * sizeof(uint32_t));
+			for(uint32_t x = 0; x < w; x++) {
+				const uint32_t p = tmp[x];
+				const uint32_t a = p >> 24;
+				s->alpha[(size_t)y * w + x] = a;
+				if(flags & CTLRA_SPRITE_PREMULTIPLY)
+					tmp[x] = sprite_premultiply(p);
+			}
+			row = (const uint8_t *)tmp;
+		}
+		convert(&s->px[(size_t)y * w * sp->bytes], row, w);
+	}
+
+	if(blend) {
+		ret = sprite_build_runs(s);
+		if(ret)
+			goto fail;
+	}
+
+	free(tmp);
+	sp->sprites[id] = s;
+	return id;
+fail:
+	free(tmp);
+	sprite_destroy(s);
+	return ret;
+}
+
+int32_t ctlra_screen_sprite_remove(struct ctlra_dev_t *dev,
+				   uint32_t screen_idx, uint32_t sprite_id)
+{
+	if(!dev || screen_idx >= CTLRA_NUM_SCREENS_MAX ||
+	   sprite_id >= CTLRA_SPRITES_MAX || !dev->sprites[screen_idx] ||
+	   !dev->sprites[screen_idx]->sprites[sprite_id])
+		return -EINVAL;
+
+	struct ctlra_sprites_t *sp = dev->sprites[screen_idx];
+	sprite_destroy(sp->sprites[sprite_id]);
+	sp->sprites[sprite_id] = 0;
+	return 0;
+}
+
+int32_t ctlra_screen_sprite_draw(struct ctlra_dev_t *dev,
+				 uint32_t screen_idx,
+				 uint8_t *pixel_data,
+				 uint32_t sprite_id,
+				 int32_t x, int32_t y,
+				 struct ctlra_screen_zone_t *damage)
+{
+	if(!dev || !pixel_data || screen_idx >= CTLRA_NUM_SCREENS_MAX ||
+	   sprite_id >= CTLRA_SPRITES_MAX || !dev->sprites[screen_idx] ||
+	   !dev->sprites[screen_idx]->sprites[sprite_id])
+		return -EINVAL;
+
+	const struct ctlra_item_info_t *item =
+		ctlra_impl_screen_item(dev, screen_idx);
+	if(!item)
+		return -ENOTSUP;
+	const int32_t sw = item->params[0];
+	const int32_t sh = item->params[1];
+
+	const struct ctlra_sprites_t *sp = dev->sprites[screen_idx];
+	const struct ctlra_sprite_t *s = sp->sprites[sprite_id];
+	const uint32_t bytes = sp->bytes;
+
+	/* clip to the screen, in screen coordinates */
+	const int32_t x0 = x < 0 ? 0 : x;
+	const int32_t y0 = y < 0 ? 0 : y;
+	const int32_t x1 = x + (int32_t)s->w > sw ? sw : x + (int32_t)s->w;
+	const int32_t y1 = y + (int32_t)s->h > sh ? sh : y + (int32_t)s->h;
+	if(x0 >= x1 || y0 >= y1)
+		return 0;
+
+	for(int32_t dy = y0; dy < y1; dy++) {
+		const uint32_t sy = dy - y;
+		uint8_t *dst = &pixel_data[dy * sw * bytes];
+		const uint8_t *src = &s->px[sy * s->w * bytes];
+
+		if(!s->alpha) {
+			memcpy(&dst[x0 * bytes], &src[(x0 - x) * bytes],
+			       (x1 - x0) * bytes);
+			continue;
+		}
+
+		for(uint32_t r = s->row_runs[sy]; r < s->row_runs[sy + 1];
+		    r++) {
+			const struct ctlra_sprite_run_t *run = &s->runs[r];
+			int32_t rx0 = x + run->x;
+			int32_t rx1 = rx0 + run->len;
+			if(rx0 < x0) rx0 = x0;
+			if(rx1 > x1) rx1 = x1;
+			if(rx0 >= rx1)
+				continue;
+			const uint32_t sx = rx0 - x;
+			if(run->op == RUN_COPY)
+				memcpy(&dst[rx0 * bytes], &src[sx * bytes],
+				       (rx1 - rx0) * bytes);
+			else
+				sp->blend(&dst[rx0 * bytes], &src[sx * bytes],
+					  &s->alpha[sy * s->w + sx],
+					  rx1 - rx0);
+		}
+	}
+
+	if(damage)
+		ctlra_impl_zone_grow(damage, x0, y0, x1, y1);
+	return 0;
+}
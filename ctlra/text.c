@@ -0,0 +1,373 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "impl.h"
+#include "pixel.h"
+#include "text.h"
+
+/* 5x7 glyphs of printable ASCII, one byte per column from the left with
+ * the top row in bit 0. Glyph cells are 6x8, leaving a column and a row
+ * of background as spacing */
+#define FONT_FIRST 32
+#define FONT_LAST  126
+#define FONT_COLS  5
+#define FONT_ROWS  7
+
+static const uint8_t font_5x7[][FONT_COLS] = {
+	{0x00, 0x00, 0x00, 0x00, 0x00}, /* space */
+	{0x00, 0x00, 0x5f, 0x00, 0x00}, /* ! */
+	{0x00, 0x07, 0x00, 0x07, 0x00}, /* " */
+	{0x14, 0x7f, 0x14, 0x7f, 0x14}, /* # */
+	{0x24, 0x2a, 0x7f, 0x2a, 0x12}, /* $ */
+	{0x23, 0x13, 0x08, 0x64, 0x62}, /* % */
+	{0x36, 0x49, 0x55, 0x22, 0x50}, /* & */
+	{0x00, 0x05, 0x03, 0x00, 0x00}, /* ' */
+	{0x00, 0x1c, 0x22, 0x41, 0x00}, /* ( */
+	{0x00, 0x41, 0x22, 0x1c, 0x00}, /* ) */
+	{0x14, 0x08, 0x3e, 0x08, 0x14}, /* * */
+	{0x08, 0x08, 0x3e, 0x08, 0x08}, /* + */
+	{0x00, 0x50, 0x30, 0x00, 0x00}, /* , */
+	{0x08, 0x08, 0x08, 0x08, 0x08}, /* - */
+	{0x00, 0x60, 0x60, 0x00, 0x00}, /* . */
+	{0x20, 0x10, 0x08, 0x04, 0x02}, /* / */
+	{0x3e, 0x51, 0x49, 0x45, 0x3e}, /* 0 */
+	{0x00, 0x42, 0x7f, 0x40, 0x00}, /* 1 */
+	{0x42, 0x61, 0x51, 0x49, 0x46}, /* 2 */
+	{0x21, 0x41, 0x45, 0x4b, 0x31}, /* 3 */
+	{0x18, 0x14, 0x12, 0x7f, 0x10}, /* 4 */
+	{0x27, 0x45, 0x45, 0x45, 0x39}, /* 5 */
+	{0x3c, 0x4a, 0x49, 0x49, 0x30}, /* 6 */
+	{0x01, 0x71, 0x09, 0x05, 0x03}, /* 7 */
+	{0x36, 0x49, 0x49, 0x49, 0x36}, /* 8 */
+	{0x06, 0x49, 0x49, 0x29, 0x1e}, /* 9 */
+	{0x00, 0x36, 0x36, 0x00, 0x00}, /* : */
+	{0x00, 0x56, 0x36, 0x00, 0x00}, /* ; */
+	{0x08, 0x14, 0x22, 0x41, 0x00}, /* < */
+	{0x14, 0x14, 0x14, 0x14, 0x14}, /* = */
+	{0x00, 0x41, 0x22, 0x14, 0x08}, /* > */
+	{0x02, 0x01, 0x51, 0x09, 0x06}, /* ? */
+	{0x32, 0x49, 0x79, 0x41, 0x3e}, /* @ */
+	{0x7e, 0x11, 0x11, 0x11, 0x7e}, /* A */
+	{0x7f, 0x49, 0x49, 0x49, 0x36}, /* B */
+	{0x3e, 0x41, 0x41, 0x41, 0x22}, /* C */
+	{0x7f, 0x41, 0x41, 0x22, 0x1c}, /* D */
+	{0x7f, 0x49, 0x49, 0x49, 0x41}, /* E */
+	{0x7f, 0x09, 0x09, 0x09, 0x01}, /* F */
+	{0x3e, 0x41, 0x49, 0x49, 0x7a}, /* G */
+	{0x7f, 0x08, 0x08, 0x08, 0x7f}, /* H */
+	{0x00, 0x41, 0x7f, 0x41, 0x00}, /* I */
+	{0x20, 0x40, 0x41, 0x3f, 0x01}, /* J */
+	{0x7f, 0x08, 0x14, 0x22, 0x41}, /* K */
+	{0x7f, 0x40, 0x40, 0x40, 0x40}, /* L */
+	{0x7f, 0x02, 0x0c, 0x02, 0x7f}, /* M */
+	{0x7f, 0x04, 0x08, 0x10, 0x7f}, /* N */
+	{0x3e, 0x41, 0x41, 0x41, 0x3e}, /* O */
+	{0x7f, 0x09, 0x09, 0x09, 0x06}, /* P */
+	{0x3e, 0x41, 0x51, 0x21, 0x5e}, /* Q */
+	{0x7f, 0x09, 0x19, 0x29, 0x46}, /* R */
+	{0x46, 0x49, 0x49, 0x49, 0x31}, /* S */
+	{0x01, 0x01, 0x7f, 0x01, 0x01}, /* T */
+	{0x3f, 0x40, 0x40, 0x40, 0x3f}, /* U */
+	{0x1f, 0x20, 0x40, 0x20, 0x1f}, /* V */
+	{0x3f, 0x40, 0x38, 0x40, 0x3f}, /* W */
+	{0x63, 0x14, 0x08, 0x14, 0x63}, /* X */
+	{0x07, 0x08, 0x70, 0x08, 0x07}, /* Y */
+	{0x61, 0x51, 0x49, 0x45, 0x43}, /* Z */
+	{0x00, 0x7f, 0x41, 0x41, 0x00}, /* [ */
+	{0x02, 0x04, 0x08, 0x10, 0x20}, /* \ */
+	{0x00, 0x41, 0x41, 0x7f, 0x00}, /* ] */
+	{0x04, 0x02, 0x01, 0x02, 0x04}, /* ^ */
+	{0x40, 0x40, 0x40, 0x40, 0x40}, /* _ */
+	{0x00, 0x01, 0x02, 0x04, 0x00}, /* ` */
+	{0x20, 0x54, 0x54, 0x54, 0x78}, /* a */
+	{0x7f, 0x48, 0x44, 0x44, 0x38}, /* b */
+	{0x38, 0x44, 0x44, 0x44, 0x20}, /* c */
+	{0x38, 0x44, 0x44, 0x48, 0x7f}, /* d */
+	{0x38, 0x54, 0x54, 0x54, 0x18}, /* e */
+	{0x08, 0x7e, 0x09, 0x01, 0x02}, /* f */
+	{0x0c, 0x52, 0x52, 0x52, 0x3e}, /* g */
+	{0x7f, 0x08, 0x04, 0x04, 0x78}, /* h */
+	{0x00, 0x44, 0x7d, 0x40, 0x00}, /* i */
+	{0x20, 0x40, 0x44, 0x3d, 0x00}, /* j */
+	{0x7f, 0x10, 0x28, 0x44, 0x00}, /* k */
+	{0x00, 0x41, 0x7f, 0x40, 0x00}, /* l */
+	{0x7c, 0x04, 0x18, 0x04, 0x78}, /* m */
+	{0x7c, 0x08, 0x04, 0x04, 0x78}, /* n */
+	{0x38, 0x44, 0x44, 0x44, 0x38}, /* o */
+	{0x7c, 0x14, 0x14, 0x14, 0x08}, /* p */
+	{0x08, 0x14, 0x14, 0x18, 0x7c}, /* q */
+	{0x7c, 0x08, 0x04, 0x04, 0x08}, /* r */
+	{0x48, 0x54, 0x54, 0x54, 0x20}, /* s */
+	{0x04, 0x3f, 0x44, 0x40, 0x20}, /* t */
+	{0x3c, 0x40, 0x40, 0x20, 0x7c}, /* u */
+	{0x1c, 0x20, 0x40, 0x20, 0x1c}, /* v */
+	{0x3c, 0x40, 0x30, 0x40, 0x3c}, /* w */
+	{0x44, 0x28, 0x10, 0x28, 0x44}, /* x */
+	{0x0c, 0x50, 0x50, 0x50, 0x3c}, /* y */
+	{0x44, 0x64, 0x54, 0x4c, 0x44}, /* z */
+	{0x00, 0x08, 0x36, 0x41, 0x00}, /* { */
+	{0x00, 0x00, 0x7f, 0x00, 0x00}, /* | */
+	{0x00, 0x41, 0x36, 0x08, 0x00}, /* } */
+	{0x08, 0x04, 0x08, 0x10, 0x08}, /* ~ */
+};
+
+struct ctlra_text_glyph_t {
+	/* key: character, scale, format and native colours */
+	uint8_t ch;
+	uint8_t scale;
+	uint8_t format;
+	uint8_t fg[4];
+	uint8_t bg[4];
+	/* glyph cell pixels, rasterised in the native format */
+	uint32_t size;
+	uint8_t *px;
+};
+
+struct ctlra_text_cache_t {
+	struct ctlra_text_glyph_t glyphs[CTLRA_TEXT_CACHE_SLOTS];
+};
+
+struct ctlra_text_cache_t *ctlra_impl_text_cache_new(void)
+{
+	return calloc(1, sizeof(struct ctlra_text_cache_t));
+}
+
+void ctlra_impl_text_cache_free(struct ctlra_text_cache_t *cache)
+{
+	if(!cache)
+		return;
+	for(int i = 0; i < CTLRA_TEXT_CACHE_SLOTS; i++)
+		free(cache->glyphs[i].px);
+	free(cache);
+}
+
+void ctlra_impl_text_free(struct ctlra_dev_t *dev)
+{
+	for(int i = 0; i < CTLRA_NUM_SCREENS_MAX; i++) {
+		ctlra_impl_text_cache_free(dev->text[i]);
+		dev->text[i] = 0;
+	}
+}
+
+static inline uint8_t
+text_font_char(uint8_t c)
+{
+	return (c < FONT_FIRST || c > FONT_LAST) ? '?' : c;
+}
+
+static void
+text_rasterise(uint8_t *dst, uint8_t ch, uint32_t scale, uint32_t bytes,
+	       const uint8_t *fg, const uint8_t *bg)
+{
+	const uint8_t *cols = font_5x7[ch - FONT_FIRST];
+	const uint32_t gw = CTLRA_FONT_W * scale;
+	const uint32_t gh = CTLRA_FONT_H * scale;
+	for(uint32_t y = 0; y < gh; y++) {
+		const uint32_t r = y / scale;
+		for(uint32_t x = 0; x < gw; x++) {
+			const uint32_t c = x / scale;
+			int on = c < FONT_COLS && r < FONT_ROWS &&
+				 ((cols[c] >> r) & 1);
+			memcpy(dst, on ? fg : bg, bytes);
+			dst += bytes;
+		}
+	}
+}
+
+static struct ctlra_text_glyph_t *
+text_glyph_get(struct ctlra_text_cache_t *cache, uint8_t ch,
+	       uint32_t scale, uint32_t format, uint32_t bytes,
+	       const uint8_t *fg, const uint8_t *bg, uint32_t colour_hash)
+{
+	const uint32_t slot = (ch + colour_hash) % CTLRA_TEXT_CACHE_SLOTS;
+	struct ctlra_text_glyph_t *g = &cache->glyphs[slot];
+	if(g->px && g->ch == ch && g->scale == scale &&
+	   g->format == format && memcmp(g->fg, fg, 4) == 0 &&
+	   memcmp(g->bg, bg, 4) == 0)
+		return g;
+
+	const uint32_t size = CTLRA_FONT_W * CTLRA_FONT_H * scale * scale *
+			      bytes;
+	if(size > g->size) {
+		uint8_t *px = realloc(g->px, size);
+		if(!px)
+			return 0;
+		g->px = px;
+		g->size = size;
+	}
+	g->ch = ch;
+	g->scale = scale;
+	g->format = format;
+	memcpy(g->fg, fg, 4);
+	memcpy(g->bg, bg, 4);
+	text_rasterise(g->px, ch, scale, bytes, fg, bg);
+	return g;
+}
+
+/* 1 bit screens in the page layout are cheap enough to plot directly */
+static void
+text_mono1_glyph(uint8_t *px, uint32_t w, uint8_t ch, uint32_t scale,
+		 int32_t gx, int32_t gy, int32_t x0, int32_t y0,
+		 int32_t x1, int32_t y1, int fg, int bg)
+{
+	const uint8_t *cols = font_5x7[ch - FONT_FIRST];
+	for(int32_t y = y0; y < y1; y++) {
+		const uint32_t r = (y - gy) / scale;
+		uint8_t *page = &px[(y >> 3) * w];
+		const uint8_t mask = 1 << (y & 7);
+		for(int32_t x = x0; x < x1; x++) {
+			const uint32_t c = (x - gx) / scale;
+			int on = c < FONT_COLS && r < FONT_ROWS &&
+				 ((cols[c] >> r) & 1);
+			if(on ? fg : bg)
+				page[x] |= mask;
+			else
+				page[x] &= ~mask;
+		}
+	}
+}
+
+int32_t ctlra_impl_text_draw(struct ctlra_text_cache_t *cache,
+			     uint8_t *px, uint32_t w, uint32_t h,
+			     uint32_t format, int32_t x, int32_t y,
+			     uint32_t scale, uint32_t fg, uint32_t bg,
+			     const char *text,
+			     struct ctlra_screen_zone_t *damage)
+{
+	if(scale == 0)
+		scale = 1;
+	if(scale > CTLRA_FONT_SCALE_MAX)
+		return -EINVAL;
+
+	const int mono = format == CTLRA_PIXEL_FORMAT_MONO1;
+	const uint32_t bytes = ctlra_pixel_format_bpp(format) / 8;
+	uint8_t fg_px[4];
+	uint8_t bg_px[4];
+	if((!mono && !bytes) || ctlra_pixel_colour_get(format, fg, fg_px) ||
+	   ctlra_pixel_colour_get(format, bg, bg_px))
+		return -ENOTSUP;
+	/* spreads the glyphs of each colour pair over the cache slots */
+	const uint32_t colour_hash = ((fg * 0x9e3779b1u) ^
+				      (bg * 0x85ebca77u) ^
+				      (scale * 0x27d4eb2fu)) >> 25;
+
+	const int32_t gw = CTLRA_FONT_W * scale;
+	const int32_t gh = CTLRA_FONT_H * scale;
+	int32_t pen_x = x;
+	int32_t pen_y = y;
+	int32_t width = 0;
+	/* bounds of the pixels written */
+	int32_t dx0 = w, dy0 = h, dx1 = 0, dy1 = 0;
+
+	for(const uint8_t *t = (const uint8_t *)text; *t; t++) {
+		if(*t == '\n') {
+			pen_x = x;
+			pen_y += gh;
+			continue;
+		}
+		/* one glyph per UTF-8 sequence, skip continuation bytes */
+		if((*t & 0xc0) == 0x80)
+			continue;
+		const uint8_t ch = text_font_char(*t);
+		const int32_t gx = pen_x;
+		pen_x += gw;
+		if(pen_x - x > width)
+			width = pen_x - x;
+
+		int32_t x0 = gx < 0 ? 0 : gx;
+		int32_t y0 = pen_y < 0 ? 0 : pen_y;
+		int32_t x1 = gx + gw > (int32_t)w ? (int32_t)w : gx + gw;
+		int32_t y1 = pen_y + gh > (int32_t)h ? (int32_t)h : pen_y + gh;
+		if(x0 >= x1 || y0 >= y1)
+			continue;
+
+		if(mono) {
+			text_mono1_glyph(px, w, ch, scale, gx, pen_y, x0, y0,
+					 x1, y1, fg_px[0], bg_px[0]);
+		} else {
+			struct ctlra_text_glyph_t *g =
+				text_glyph_get(cache, ch, scale, format, bytes,
+					       fg_px, bg_px, colour_hash);
+			if(!g)
+				return -ENOMEM;
+			const uint32_t row = (x1 - x0) * bytes;
+			const uint8_t *src = &g->px[((y0 - pen_y) * gw +
+						     (x0 - gx)) * bytes];
+			uint8_t *dst = &px[(y0 * w + x0) * bytes];
+			for(int32_t r = y0; r < y1; r++) {
+				memcpy(dst, src, row);
+				src += gw * bytes;
+				dst += w * bytes;
+			}
+		}
+
+		if(x0 < dx0) dx0 = x0;
+		if(y0 < dy0) dy0 = y0;
+		if(x1 > dx1) dx1 = x1;
+		if(y1 > dy1) dy1 = y1;
+	}
+
+	if(damage)
+		ctlra_impl_zone_grow(damage, dx0, dy0, dx1, dy1);
+
+	return width;
+}
+
+int32_t ctlra_screen_text(struct ctlra_dev_t *dev, uint32_t screen_idx,
+			  uint8_t *pixel_data, int32_t x, int32_t y,
+			  uint32_t scale, uint32_t fg, uint32_t bg,
+			  const char *text,
+			  struct ctlra_screen_zone_t *damage)
+{
+	if(!dev || !pixel_data || !text ||
+	   screen_idx >= CTLRA_NUM_SCREENS_MAX)
+		return -ENOTSUP;
+
+	const struct ctlra_item_info_t *item =
+		ctlra_impl_screen_item(dev, screen_idx);
+	if(!item)
+		return -ENOTSUP;
+
+	if(!dev->text[screen_idx]) {
+		dev->text[screen_idx] = ctlra_impl_text_cache_new();
+		if(!dev->text[screen_idx])
+			return -ENOMEM;
+	}
+
+	return ctlra_impl_text_draw(dev->text[screen_idx], pixel_data,
+				    item->params[0], item->params[1],
+				    item->params[3], x, y, scale, fg, bg,
+				    text, damage);
+}
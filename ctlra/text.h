@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CTLRA_TEXT_H
+#define CTLRA_TEXT_H
+
+#include <stdint.h>
+
+struct ctlra_dev_t;
+struct ctlra_screen_zone_t;
+struct ctlra_text_cache_t;
+
+/* Text rendering into screen framebuffers with the built-in 6x8 font.
+ * Glyphs are rasterised once into the screen's native pixel format at
+ * the requested scale and colours, and kept in a small direct mapped
+ * cache, so drawing a label is a clipped row copy per glyph row. Each
+ * screen of a device has its own cache, as screens may be drawn in
+ * parallel by the render workers. 1 bit screens are written directly.
+ */
+#define CTLRA_TEXT_CACHE_SLOTS 128
+
+/* Allocates an empty glyph cache */
+struct ctlra_text_cache_t *ctlra_impl_text_cache_new(void);
+void ctlra_impl_text_cache_free(struct ctlra_text_cache_t *cache);
+
+/* Draws *text* into a *w* x *h* framebuffer *px* of *format*, see
+ * ctlra_screen_text(). Returns the width of the widest line in pixels,
+ * or -ENOTSUP if *format* can't be drawn to */
+int32_t ctlra_impl_text_draw(struct ctlra_text_cache_t *cache,
+			     uint8_t *px, uint32_t w, uint32_t h,
+			     uint32_t format, int32_t x, int32_t y,
+			     uint32_t scale, uint32_t fg, uint32_t bg,
+			     const char *text,
+			     struct ctlra_screen_zone_t *damage);
+
+/* Frees the glyph caches of *dev*, called on disconnect */
+void ctlra_impl_text_free(struct ctlra_dev_t *dev);
+
+#endif /* CTLRA_TEXT_H */
@@ -6,6 +6,8 @@
 #include <unistd.h>
 
 #include "impl.h"
+#include "capture.h"
+#include "usb_mock.h"
 
 #include <libusb.h>
 
@@ -33,11 +35,19 @@ extern int ctlra_impl_accept_dev(struct ctlra_t *ctlra, int dev_id);
 extern int ctlra_impl_dev_get_by_vid_pid(struct ctlra_t *ctlra, int32_t vid,
 					 int32_t pid, struct ctlra_dev_t **out_dev);
 
+/* When replaying a capture, no libusb devices are opened: the driver
+ * connect() still calls the usb open functions, which must succeed for
+ * the devices in the capture. The connect() path does not have a ctlra
+ * context yet, hence this is global for the process */
+static struct ctlra_replay_t *usb_replay;
+
 /* struct to track async USB transfers */
 struct usb_async_t {
 	struct usb_async_t *next;
 	struct usb_async_t *prev;
 	struct libusb_transfer *xfer;
+	/* LED report shadow of a write, invalidated if it fails */
+	struct ctlra_lights_shadow_t *shadow;
 	char malloc_mem[0];
 };
 
@@ -237,6 +247,15 @@ static int ctlra_usb_impl_hotplug_cb(libusb_context *ctx,
 
 void ctlra_impl_usb_idle_iter(struct ctlra_t *ctlra)
 {
+	if(ctlra->usb_replay) {
+		ctlra_impl_replay_idle_iter(ctlra);
+		return;
+	}
+	if(ctlra_impl_usb_mock_active()) {
+		ctlra_impl_usb_mock_idle_iter(ctlra);
+		return;
+	}
+
 	struct timeval tv = {0};
 	/* 1st: NULL context
 	 * 2nd: timeval to wait - 0 returns as if non blocking
@@ -251,6 +270,13 @@ int ctlra_dev_impl_usb_init(struct ctlra_t *ctlra)
 	if(ctlra->usb_initialized)
 		return -1;
 
+	if(ctlra->usb_replay) {
+		usb_replay = ctlra->usb_replay;
+		return 0;
+	}
+	if(ctlra_impl_usb_mock_active())
+		return 0;
+
 	/* Do not create a new USB context if we're flagged not to */
 	if(ctlra->opts.flags_usb_no_own_context)
 		ret = libusb_init(NULL);
@@ -298,6 +324,16 @@ int ctlra_dev_impl_usb_open(struct ctlra_dev_t *ctlra_dev, int vid,
 	int i = 0, j = 0;
 	uint8_t path[USB_PATH_MAX];
 
+	if(usb_replay) {
+		if(!ctlra_impl_replay_has_device(usb_replay, vid, pid))
+			return -1;
+		ctlra_dev->info.vendor_id = vid;
+		ctlra_dev->info.device_id = pid;
+		return 0;
+	}
+	if(ctlra_impl_usb_mock_active())
+		return ctlra_impl_usb_mock_open(ctlra_dev, vid, pid);
+
 	int cnt = libusb_get_device_list(NULL, &devs);
 	if (cnt < 0)
 		goto fail;
@@ -361,6 +397,12 @@ int ctlra_dev_impl_usb_open_interface(struct ctlra_dev_t *ctlra_dev,
 			    handle_idx);
 		return -1;
 	}
+
+	if(usb_replay || ctlra_impl_usb_mock_active()) {
+		ctlra_dev->usb_interface[handle_idx] = interface;
+		return 0;
+	}
+
 	libusb_device *usb_dev = ctlra_dev->usb_device;
 	libusb_device_handle *handle = 0;
 
@@ -437,6 +479,10 @@ static void ctlra_usb_xfr_done_generic(struct libusb_transfer *xfr,
 				    "inflight xfers going negative %d\n",
 				    inflight_xfers);
 		}
+		if(read && ctlra->usb_capture)
+			ctlra_impl_capture_append(ctlra->usb_capture, dev,
+						  xfr->endpoint, xfr->buffer,
+						  xfr->actual_length);
 		dev->usb_read_cb(dev, xfr->endpoint, xfr->buffer,
 				 xfr->actual_length);
 		} break;
@@ -472,6 +518,13 @@ static void ctlra_usb_xfr_done_generic(struct libusb_transfer *xfr,
 	CTLRA_DRIVER(ctlra, "free %s async @ %p\n",
 		     read == 1 ? "read" : "write", async);
 
+	/* the LED report never arrived, so the next flush must send it
+	 * again instead of suppressing it as unchanged */
+	if(!read && async->shadow &&
+	   xfr->status != LIBUSB_TRANSFER_COMPLETED &&
+	   xfr->status != LIBUSB_TRANSFER_CANCELLED)
+		async->shadow->valid = 0;
+
 	XFER_VALIDATE(dev);
 
 	/* remove node from double linked list*/
@@ -513,6 +566,14 @@ int ctlra_dev_impl_usb_interrupt_read(struct ctlra_dev_t *dev, uint32_t idx,
 	int transferred;
 	struct ctlra_t *ctlra = dev->ctlra_context;
 
+	/* replayed data is pushed from the idle iter, nothing to read */
+	if(usb_replay)
+		return 0;
+	if(ctlra_impl_usb_mock_active()) {
+		ctlra_impl_usb_mock_read(dev);
+		return 0;
+	}
+
 /* we can use synchronous reads too, but the latency builds up of the
  * timeout. AKA: with 6 devices, at 100 ms each, 600ms between a re-poll
  * of the USB device - totally unacceptable.
@@ -562,6 +623,7 @@ int ctlra_dev_impl_usb_interrupt_read(struct ctlra_dev_t *dev, uint32_t idx,
 
 	/* back-pointer from async to xfer */
 	async->xfer = xfr;
+	async->shadow = 0;
 
 	void *usb_data = &async->malloc_mem;
 
@@ -630,6 +692,9 @@ int ctlra_dev_impl_usb_interrupt_read(struct ctlra_dev_t *dev, uint32_t idx,
 			    dev->usb_read_cb);
 		return 0;
 	}
+	if(ctlra->usb_capture)
+		ctlra_impl_capture_append(ctlra->usb_capture, dev, endpoint,
+					  data, transferred);
 	dev->usb_read_cb(dev, endpoint, data, transferred);
 	dev->usb_xfer_counts[USB_XFER_INT_READ]++;
 	return r;
@@ -640,17 +705,35 @@ int ctlra_dev_impl_usb_interrupt_read(struct ctlra_dev_t *dev, uint32_t idx,
 int ctlra_dev_impl_usb_interrupt_write(struct ctlra_dev_t *dev, uint32_t idx,
                                        uint32_t endpoint, uint8_t *data,
                                        uint32_t size)
+{
+	return ctlra_dev_impl_usb_interrupt_write_shadow(dev, idx, endpoint,
+							 data, size, 0);
+}
+
+int
+ctlra_dev_impl_usb_interrupt_write_shadow(struct ctlra_dev_t *dev,
+					  uint32_t idx, uint32_t endpoint,
+					  uint8_t *data, uint32_t size,
+					  struct ctlra_lights_shadow_t *shadow)
 {
 	int transferred;
 	struct ctlra_t *ctlra = dev->ctlra_context;
 	const uint32_t timeout = 0;
 
+	if(usb_replay) {
+		dev->usb_xfer_counts[USB_XFER_INT_WRITE]++;
+		return size;
+	}
+
 	int inf = dev->usb_xfer_counts[USB_XFER_INFLIGHT_WRITE];
 	if(inf >= CTLRA_ASYNC_READ_MAX) {
 		dev->usb_xfer_counts[USB_XFER_ERROR]++;
 		return 0;
 	}
 
+	if(ctlra_impl_usb_mock_active())
+		return ctlra_impl_usb_mock_write(dev, size, 0);
+
 #if CTLRA_USE_ASYNC_XFER
 	struct libusb_transfer *xfr;
 	xfr = libusb_alloc_transfer(0);
@@ -674,6 +757,7 @@ int ctlra_dev_impl_usb_interrupt_write(struct ctlra_dev_t *dev, uint32_t idx,
 
 	/* back-pointer from async to xfer */
 	async->xfer = xfr;
+	async->shadow = shadow;
 
 	void *usb_data = &async->malloc_mem;
 	memcpy(usb_data, data, size);
@@ -726,12 +810,20 @@ int ctlra_dev_impl_usb_bulk_write(struct ctlra_dev_t *dev, uint32_t idx,
 	struct ctlra_t *ctlra = dev->ctlra_context;
 	const uint32_t timeout = 0;
 
+	if(usb_replay) {
+		dev->usb_xfer_counts[USB_XFER_BULK_WRITE]++;
+		return size;
+	}
+
 	int inf = dev->usb_xfer_counts[USB_XFER_INFLIGHT_WRITE];
 	if(inf >= CTLRA_ASYNC_READ_MAX) {
 		dev->usb_xfer_counts[USB_XFER_BULK_ERROR]++;
 		return 0;
 	}
 
+	if(ctlra_impl_usb_mock_active())
+		return ctlra_impl_usb_mock_write(dev, size, 1);
+
 #if CTLRA_USE_ASYNC_XFER
 	struct libusb_transfer *xfr;
 	xfr = libusb_alloc_transfer(0);
@@ -755,6 +847,7 @@ int ctlra_dev_impl_usb_bulk_write(struct ctlra_dev_t *dev, uint32_t idx,
 
 	/* back-pointer from async to xfer */
 	async->xfer = xfr;
+	async->shadow = 0;
 
 	void *usb_data = &async->malloc_mem;
 	memcpy(usb_data, data, size);
@@ -816,6 +909,13 @@ void ctlra_dev_impl_usb_close(struct ctlra_dev_t *dev)
 {
 	struct ctlra_t *ctlra = dev->ctlra_context;
 
+	if(usb_replay)
+		return;
+	if(ctlra_impl_usb_mock_active()) {
+		ctlra_impl_usb_mock_close(dev);
+		return;
+	}
+
 	struct timeval tv;
 	tv.tv_sec = 0;
 	tv.tv_usec = 10;
@@ -885,6 +985,17 @@ void ctlra_dev_impl_usb_close(struct ctlra_dev_t *dev)
 
 void ctlra_impl_usb_shutdown(struct ctlra_t *ctlra)
 {
+	ctlra_impl_capture_close(ctlra->usb_capture);
+	ctlra->usb_capture = 0;
+
+	if(ctlra->usb_replay) {
+		ctlra_impl_replay_close(ctlra->usb_replay);
+		ctlra->usb_replay = 0;
+		usb_replay = 0;
+		return;
+	}
+	if(ctlra_impl_usb_mock_active())
+		return;
 
 	if(ctlra->opts.flags_usb_no_own_context)
 		libusb_exit(NULL);
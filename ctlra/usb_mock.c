@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "impl.h"
+#include "usb_mock.h"
+
+/* Matches the async read/write limit of the libusb backend */
+#define MOCK_INFLIGHT_MAX 10
+/* report_size is a uint8_t */
+#define MOCK_REPORT_MAX   256
+
+/* From cltra.c */
+extern int ctlra_impl_get_id_by_vid_pid(uint32_t vid, uint32_t pid);
+extern int ctlra_impl_accept_dev(struct ctlra_t *ctlra, int dev_id);
+
+struct usb_mock_t {
+	struct ctlra_usb_mock_dev_t cfg;
+	/* the driver instance that opened this mock, or NULL */
+	struct ctlra_dev_t *dev;
+
+	uint64_t period_ns;
+	uint64_t next_report_ns;
+	uint64_t report_idx;
+
+	/* completion times of inflight writes, as a ring */
+	uint64_t write_done_ns[MOCK_INFLIGHT_MAX];
+	uint8_t write_head;
+	uint8_t write_count;
+
+	uint8_t report[MOCK_REPORT_MAX];
+};
+
+static struct usb_mock_t *mocks;
+static uint32_t mock_count;
+static ctlra_usb_mock_fill_func mock_fill;
+static void *mock_fill_ud;
+static uint64_t mock_report_due;
+
+static uint64_t
+usb_mock_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int
+ctlra_usb_mock_enable(const struct ctlra_usb_mock_dev_t *devs,
+		      uint32_t count, ctlra_usb_mock_fill_func fill,
+		      void *userdata)
+{
+	if(mocks || !count)
+		return -1;
+
+	mocks = calloc(count, sizeof(struct usb_mock_t));
+	if(!mocks)
+		return -1;
+
+	for(uint32_t i = 0; i < count; i++) {
+		mocks[i].cfg = devs[i];
+		if(devs[i].report_rate_hz)
+			mocks[i].period_ns = 1000000000ull /
+					     devs[i].report_rate_hz;
+	}
+	mock_count = count;
+	mock_fill = fill;
+	mock_fill_ud = userdata;
+	return 0;
+}
+
+void
+ctlra_usb_mock_disable(void)
+{
+	free(mocks);
+	mocks = 0;
+	mock_count = 0;
+}
+
+uint64_t
+ctlra_usb_mock_report_due_ns(void)
+{
+	return mock_report_due;
+}
+
+int
+ctlra_impl_usb_mock_active(void)
+{
+	return mocks != 0;
+}
+
+int
+ctlra_impl_usb_mock_probe(struct ctlra_t *ctlra)
+{
+	int num_accepted = 0;
+	for(uint32_t i = 0; i < mock_count; i++) {
+		int id = ctlra_impl_get_id_by_vid_pid(mocks[i].cfg.vendor_id,
+						      mocks[i].cfg.device_id);
+		if(id < 0) {
+			CTLRA_WARN(ctlra, "no driver for mock %04x:%04x\n",
+				   mocks[i].cfg.vendor_id,
+				   mocks[i].cfg.device_id);
+			continue;
+		}
+		num_accepted += ctlra_impl_accept_dev(ctlra, id);
+	}
+	return num_accepted;
+}
+
+int
+ctlra_impl_usb_mock_open(struct ctlra_dev_t *dev, int vid, int pid)
+{
+	for(uint32_t i = 0; i < mock_count; i++) {
+		struct usb_mock_t *m = &mocks[i];
+		if(m->dev || m->cfg.vendor_id != vid ||
+		   m->cfg.device_id != pid)
+			continue;
+
+		m->dev = dev;
+		m->next_report_ns = usb_mock_now() + m->period_ns;
+		m->report_idx = 0;
+		m->write_count = 0;
+
+		dev->usb_device = m;
+		dev->info.vendor_id = vid;
+		dev->info.device_id = pid;
+		return 0;
+	}
+	return -1;
+}
+
+void
+ctlra_impl_usb_mock_close(struct ctlra_dev_t *dev)
+{
+	struct usb_mock_t *m = dev->usb_device;
+	if(m)
+		m->dev = 0;
+	dev->usb_device = 0;
+}
+
+void
+ctlra_impl_usb_mock_read(struct ctlra_dev_t *dev)
+{
+	if(dev->usb_xfer_counts[USB_XFER_INFLIGHT_READ] >= MOCK_INFLIGHT_MAX) {
+		dev->usb_xfer_counts[USB_XFER_ERROR]++;
+		return;
+	}
+	dev->usb_xfer_counts[USB_XFER_INFLIGHT_READ]++;
+	dev->usb_xfer_counts[USB_XFER_INT_READ]++;
+}
+
+int
+ctlra_impl_usb_mock_write(struct ctlra_dev_t *dev, uint32_t size, int bulk)
+{
+	struct usb_mock_t *m = dev->usb_device;
+	if(!m || m->write_count == MOCK_INFLIGHT_MAX) {
+		dev->usb_xfer_counts[USB_XFER_ERROR]++;
+		return 0;
+	}
+
+	uint32_t idx = (m->write_head + m->write_count) % MOCK_INFLIGHT_MAX;
+	m->write_done_ns[idx] = usb_mock_now() +
+				m->cfg.write_latency_us * 1000ull;
+	m->write_count++;
+
+	dev->usb_xfer_counts[bulk ? USB_XFER_BULK_WRITE :
+			     USB_XFER_INT_WRITE]++;
+	dev->usb_xfer_counts[USB_XFER_INFLIGHT_WRITE]++;
+	return size;
+}
+
+void
+ctlra_impl_usb_mock_idle_iter(struct ctlra_t *ctlra)
+{
+	uint64_t now = usb_mock_now();
+
+	for(uint32_t i = 0; i < mock_count; i++) {
+		struct usb_mock_t *m = &mocks[i];
+		struct ctlra_dev_t *dev = m->dev;
+		if(!dev || dev->banished)
+			continue;
+
+		/* writes complete in submission order */
+		while(m->write_count &&
+		      m->write_done_ns[m->write_head] <= now) {
+			m->write_head = (m->write_head + 1) % MOCK_INFLIGHT_MAX;
+			m->write_count--;
+			dev->usb_xfer_counts[USB_XFER_INFLIGHT_WRITE]--;
+		}
+
+		/* a report needs both a read to be submitted, and to be
+		 * due. Reports not picked up in time are delivered late,
+		 * which shows up as event latency */
+		while(m->period_ns && m->next_report_ns <= now &&
+		      dev->usb_xfer_counts[USB_XFER_INFLIGHT_READ]) {
+			uint32_t size = m->cfg.report_size;
+			memset(m->report, 0, size);
+			if(mock_fill)
+				mock_fill(i, m->report_idx, m->report, size,
+					  mock_fill_ud);
+
+			dev->usb_xfer_counts[USB_XFER_INFLIGHT_READ]--;
+			mock_report_due = m->next_report_ns;
+			m->next_report_ns += m->period_ns;
+			m->report_idx++;
+
+			if(dev->usb_read_cb)
+				dev->usb_read_cb(dev, m->cfg.endpoint,
+						 m->report, size);
+			/* read_cb may banish the device */
+			if(dev->banished)
+				break;
+		}
+	}
+}
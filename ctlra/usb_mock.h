@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CTLRA_USB_MOCK_H
+#define CTLRA_USB_MOCK_H
+
+#include <stdint.h>
+
+struct ctlra_t;
+struct ctlra_dev_t;
+
+/* The mock USB transport emulates devices in-process, without libusb.
+ * It is intended for benchmarking how ctlra_idle_iter(), the drivers and
+ * the application feedback scale with the number of devices. Enable it
+ * before ctlra_create(), and ctlra_probe() connects every mock device.
+ */
+struct ctlra_usb_mock_dev_t {
+	uint16_t vendor_id;
+	uint16_t device_id;
+	/* endpoint and size of the reports the device sends */
+	uint8_t endpoint;
+	uint8_t report_size;
+	/* number of reports per second the device sends */
+	uint32_t report_rate_hz;
+	/* time until an interrupt or bulk write completes */
+	uint32_t write_latency_us;
+};
+
+/* Called to fill each report before it is passed to the driver */
+typedef void (*ctlra_usb_mock_fill_func)(uint32_t mock_idx,
+					 uint64_t report_idx,
+					 uint8_t *data, uint32_t size,
+					 void *userdata);
+
+/* Enables the mock transport with *count* devices. The *devs* array is
+ * copied. Returns 0 on success */
+int ctlra_usb_mock_enable(const struct ctlra_usb_mock_dev_t *devs,
+			  uint32_t count, ctlra_usb_mock_fill_func fill,
+			  void *userdata);
+/* Disables the mock transport, call after ctlra_exit() */
+void ctlra_usb_mock_disable(void);
+
+/* Time the report currently being decoded was due, on CLOCK_MONOTONIC
+ * in nanoseconds. Used in event callbacks to measure event latency */
+uint64_t ctlra_usb_mock_report_due_ns(void);
+
+/* Internal, from usb.c and ctlra.c */
+int ctlra_impl_usb_mock_active(void);
+int ctlra_impl_usb_mock_probe(struct ctlra_t *ctlra);
+int ctlra_impl_usb_mock_open(struct ctlra_dev_t *dev, int vid, int pid);
+void ctlra_impl_usb_mock_close(struct ctlra_dev_t *dev);
+void ctlra_impl_usb_mock_read(struct ctlra_dev_t *dev);
+int ctlra_impl_usb_mock_write(struct ctlra_dev_t *dev, uint32_t size,
+			      int bulk);
+void ctlra_impl_usb_mock_idle_iter(struct ctlra_t *ctlra);
+
+#endif /* CTLRA_USB_MOCK_H */
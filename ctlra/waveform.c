@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "impl.h"
+#include "pixel.h"
+#include "waveform.h"
+
+/* rows of the area a column covers, inclusive */
+struct ctlra_waveform_peak_t {
+	uint16_t top;
+	uint16_t bottom;
+};
+
+struct ctlra_screen_waveform_t {
+	/* screen and area */
+	uint32_t screen_w;
+	uint32_t format;
+	uint32_t bytes;
+	struct ctlra_screen_zone_t area;
+	uint8_t fg[4];
+	uint8_t bg[4];
+
+	/* peak ring: the producer owns *head*, the draw owns *drawn* */
+	uint32_t size;
+	struct ctlra_waveform_peak_t *peaks;
+	uint32_t head;
+	uint32_t drawn;
+	uint32_t valid;
+};
+
+struct ctlra_screen_waveform_t *
+ctlra_impl_waveform_new(uint32_t w, uint32_t h, uint32_t format,
+			const struct ctlra_screen_zone_t *area,
+			uint32_t fg, uint32_t bg)
+{
+	const int mono = format == CTLRA_PIXEL_FORMAT_MONO1;
+	const uint32_t bytes = ctlra_pixel_format_bpp(format) / 8;
+	if(!area || !area->w || !area->h || area->x >= w || area->y >= h ||
+	   area->w > w - area->x || area->h > h - area->y ||
+	   area->h > UINT16_MAX || (!mono && !bytes))
+		return 0;
+	/* whole pages only, so moving a page never touches other rows */
+	if(mono && (area->y % 8 || area->h % 8))
+		return 0;
+
+	struct ctlra_screen_waveform_t *wf =
+		calloc(1, sizeof(struct ctlra_screen_waveform_t));
+	if(!wf)
+		return 0;
+	wf->screen_w = w;
+	wf->format = format;
+	wf->bytes = bytes;
+	wf->area = *area;
+	/* a power of two, so indices stay in order as the head wraps */
+	wf->size = 1;
+	while(wf->size < area->w * 2)
+		wf->size <<= 1;
+	wf->peaks = calloc(wf->size, sizeof(struct ctlra_waveform_peak_t));
+	if(!wf->peaks || ctlra_pixel_colour_get(format, fg, wf->fg) ||
+	   ctlra_pixel_colour_get(format, bg, wf->bg)) {
+		ctlra_screen_waveform_destroy(wf);
+		return 0;
+	}
+	/* an empty waveform is a flat line through the middle */
+	for(uint32_t i = 0; i < wf->size; i++)
+		wf->peaks[i].top = wf->peaks[i].bottom = area->h / 2;
+	return wf;
+}
+
+struct ctlra_screen_waveform_t *
+ctlra_screen_waveform_create(struct ctlra_dev_t *dev, uint32_t screen_idx,
+			     const struct ctlra_screen_zone_t *area,
+			     uint32_t fg, uint32_t bg)
+{
+	if(!dev)
+		return 0;
+	const struct ctlra_item_info_t *item =
+		ctlra_impl_screen_item(dev, screen_idx);
+	if(!item)
+		return 0;
+	return ctlra_impl_waveform_new(item->params[0], item->params[1],
+				       item->params[3], area, fg, bg);
+}
+
+void ctlra_screen_waveform_destroy(struct ctlra_screen_waveform_t *wf)
+{
+	if(!wf)
+		return;
+	free(wf->peaks);
+	free(wf);
+}
+
+static inline uint16_t
+waveform_row(float v, uint32_t h)
+{
+	/* +1 is the top row, -1 the bottom one */
+	float r = (1.f - v) * 0.5f * (h - 1) + 0.5f;
+	if(!(r > 0.f))
+		return 0;
+	if(r > h - 1)
+		return h - 1;
+	return r;
+}
+
+void ctlra_screen_waveform_push(struct ctlra_screen_waveform_t *wf,
+				const float *min, const float *max,
+				uint32_t count)
+{
+	if(!wf || !min || !max)
+		return;
+	const uint32_t h = wf->area.h;
+	uint32_t head = __atomic_load_n(&wf->head, __ATOMIC_RELAXED);
+	for(uint32_t i = 0; i < count; i++) {
+		struct ctlra_waveform_peak_t *p =
+			&wf->peaks[(head + i) & (wf->size - 1)];
+		uint16_t top = waveform_row(max[i], h);
+		uint16_t bottom = waveform_row(min[i], h);
+		p->top = top < bottom ? top : bottom;
+		p->bottom = top < bottom ? bottom : top;
+	}
+	/* publish the peaks written above to the draw */
+	__atomic_store_n(&wf->head, head + count, __ATOMIC_RELEASE);
+}
+
+void ctlra_screen_waveform_invalidate(struct ctlra_screen_waveform_t *wf)
+{
+	if(wf)
+		wf->valid = 0;
+}
+
+static inline void
+waveform_put(uint8_t *dst, const uint8_t *px, uint32_t bytes)
+{
+	switch(bytes) {
+	case 1: *dst = *px; break;
+	case 2: memcpy(dst, px, 2); break;
+	case 4: memcpy(dst, px, 4); break;
+	}
+}
+
+/* Moves the area *cols* columns left */
+static void
+waveform_shift(struct ctlra_screen_waveform_t *wf, uint8_t *px,
+	       uint32_t cols)
+{
+	const struct ctlra_screen_zone_t *a = &wf->area;
+	if(wf->format == CTLRA_PIXEL_FORMAT_MONO1) {
+		/* a byte per column in each page */
+		for(uint32_t p = a->y / 8; p < (a->y + a->h) / 8; p++) {
+			uint8_t *row = &px[p * wf->screen_w + a->x];
+			memmove(row, row + cols, a->w - cols);
+		}
+		return;
+	}
+
+	const uint32_t b = wf->bytes;
+	uint8_t *first = &px[(a->y * wf->screen_w + a->x) * b];
+	if(a->w == wf->screen_w) {
+		memmove(first, first + cols * b, (a->w * a->h - cols) * b);
+		return;
+	}
+	for(uint32_t y = 0; y < a->h; y++) {
+		uint8_t *row = first + y * wf->screen_w * b;
+		memmove(row, row + cols * b, (a->w - cols) * b);
+	}
+}
+
+static inline const struct ctlra_waveform_peak_t *
+waveform_peak(const struct ctlra_screen_waveform_t *wf, uint32_t idx)
+{
+	return &wf->peaks[idx & (wf->size - 1)];
+}
+
+/* Rasterises columns *x0* up to the area width from the peaks that end
+ * at *end* in the ring */
+static void
+waveform_columns(struct ctlra_screen_waveform_t *wf, uint8_t *px,
+		 uint32_t x0, uint32_t end)
+{
+	const struct ctlra_screen_zone_t *a = &wf->area;
+	const uint32_t first = end - (a->w - x0);
+
+	if(wf->format == CTLRA_PIXEL_FORMAT_MONO1) {
+		const uint32_t page0 = a->y / 8;
+		for(uint32_t p = 0; p < a->h / 8; p++) {
+			uint8_t *row = &px[(page0 + p) * wf->screen_w + a->x];
+			for(uint32_t x = x0; x < a->w; x++) {
+				const struct ctlra_waveform_peak_t *pk =
+					waveform_peak(wf, first + x - x0);
+				uint8_t v = 0;
+				for(uint32_t r = 0; r < 8; r++) {
+					uint32_t y = p * 8 + r;
+					int in = y >= pk->top &&
+						 y <= pk->bottom;
+					v |= (in ? wf->fg[0] : wf->bg[0]) << r;
+				}
+				row[x] = v;
+			}
+		}
+		return;
+	}
+
+	const uint32_t b = wf->bytes;
+	for(uint32_t y = 0; y < a->h; y++) {
+		uint8_t *row = &px[((a->y + y) * wf->screen_w + a->x) * b];
+		for(uint32_t x = x0; x < a->w; x++) {
+			const struct ctlra_waveform_peak_t *pk =
+				waveform_peak(wf, first + x - x0);
+			int in = y >= pk->top && y <= pk->bottom;
+			waveform_put(&row[x * b], in ? wf->fg : wf->bg, b);
+		}
+	}
+}
+
+int32_t ctlra_screen_waveform_draw(struct ctlra_screen_waveform_t *wf,
+				   uint8_t *pixel_data,
+				   struct ctlra_screen_zone_t *damage)
+{
+	if(!wf || !pixel_data)
+		return -EINVAL;
+
+	const uint32_t head = __atomic_load_n(&wf->head, __ATOMIC_ACQUIRE);
+	uint32_t cols = head - wf->drawn;
+	if(wf->valid && cols == 0)
+		return 0;
+
+	const uint32_t w = wf->area.w;
+	if(!wf->valid || cols >= w) {
+		waveform_columns(wf, pixel_data, 0, head);
+		cols = w;
+	} else {
+		waveform_shift(wf, pixel_data, cols);
+		waveform_columns(wf, pixel_data, w - cols, head);
+	}
+	wf->drawn = head;
+	wf->valid = 1;
+
+	if(damage) {
+		const struct ctlra_screen_zone_t *a = &wf->area;
+		ctlra_impl_zone_grow(damage, a->x, a->y, a->x + a->w,
+				     a->y + a->h);
+	}
+	return cols;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2017, OpenAV Productions,
+ * Harry van Haaren <harryhaaren@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CTLRA_WAVEFORM_H
+#define CTLRA_WAVEFORM_H
+
+#include <stdint.h>
+
+struct ctlra_screen_zone_t;
+struct ctlra_screen_waveform_t;
+
+/* Scrolling waveforms, see ctlra_screen_waveform_create(). The
+ * application pushes one min/max peak per column into a ring, and each
+ * draw moves the pixels already in the framebuffer left by the number
+ * of columns pushed since the last draw, then rasterises only the new
+ * columns on the right. When the area spans whole screen rows the move
+ * is a single memmove: the pixels that wrap into the previous row land
+ * in the new columns, which are rasterised anyway. The ring holds at
+ * least two areas worth of columns, so a producer on another thread can
+ * run ahead of the draw by up to the area width.
+ */
+
+/* Creates a waveform in *area* of a *w* x *h* screen of *format* */
+struct ctlra_screen_waveform_t *
+ctlra_impl_waveform_new(uint32_t w, uint32_t h, uint32_t format,
+			const struct ctlra_screen_zone_t *area,
+			uint32_t fg, uint32_t bg);
+
+#endif /* CTLRA_WAVEFORM_H */
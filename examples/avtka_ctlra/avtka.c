@@ -31,36 +31,6 @@ void simple_feedback_func(struct ctlra_dev_t *dev, void *d)
 	ctlra_dev_light_flush(dev, 1);
 }
 
-static inline
-void pixel_convert_from_argb(int r, int g, int b, uint8_t *data)
-{
-	r = ((int)((r / 255.0) * 31)) & ((1<<5)-1);
-	g = ((int)((g / 255.0) * 63)) & ((1<<6)-1);
-	b = ((int)((b / 255.0) * 31)) & ((1<<5)-1);
-
-	uint16_t combined = (b | g << 5 | r << 11);
-	data[0] = combined >> 8;
-	data[1] = combined & 0xff;
-}
-
-void convert_scalar(unsigned char *data, uint8_t *pixels, uint32_t stride)
-{
-	const uint16_t HEIGHT = 272;
-	const uint16_t WIDTH = 480;
-	uint16_t *write_head = (uint16_t*)pixels;
-	/* Copy the Cairo pixels to the usb buffer, taking the
-	 * stride of the cairo memory into account, converting from
-	 * RGB into the BGR that the screen expects */
-	for(int j = 0; j < HEIGHT; j++) {
-		for(int i = 0; i < WIDTH; i++) {
-			uint8_t *p = &data[(j * stride) + (i*4)];
-			int idx = (j * WIDTH) + (i);
-			pixel_convert_from_argb(p[2], p[1], p[0],
-						(uint8_t*)&write_head[idx]);
-		}
-	}
-}
-
 int32_t screen_redraw_cb(struct ctlra_dev_t *dev, uint32_t screen_idx,
 			 uint8_t *pixel_data, uint32_t bytes,
 			 struct ctlra_screen_zone_t *zone,
@@ -86,8 +56,9 @@ int32_t screen_redraw_cb(struct ctlra_dev_t *dev, uint32_t screen_idx,
 	}
 	int stride = cairo_image_surface_get_stride(surf);
 
-	/* convert from ARGB32 to 565 */
-	convert_scalar(data, pixel_data, stride);
+	/* convert from ARGB32 to the screen's format */
+	ctlra_screen_convert(dev, screen_idx, pixel_data,
+			     CTLRA_PIXEL_FORMAT_ARGB32, data, stride, NULL);
 
 	/* fill in redraw co-ords */
 	avtka_redraw_get_damaged_area(a, &zone->x, &zone->y,
@@ -0,0 +1,1179 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "ctlra.h"
+/* for the capture file format, used to feed reports to the drivers */
+#include "capture.h"
+/* for the scaling benchmark, which emulates many devices */
+#include "usb_mock.h"
+/* for the colour quantisation benchmark */
+#include "palette.h"
+/* for the screen diff benchmark */
+#include "devices/ni_screen.h"
+/* for the pixel conversion benchmark */
+#include "pixel.h"
+/* for the text rendering benchmark */
+#include "text.h"
+/* for the scrolling waveform benchmark */
+#include "waveform.h"
+
+/* Driver decode benchmark: feeds recorded or synthetic USB reports to
+ * each driver's usb_read_cb using the Ctlra USB replay backend, so no
+ * hardware is required. Results are printed as CSV, one line per
+ * device and scenario:
+ *   device,scenario,reports,ns_per_report,events_per_sec,allocs_per_report
+ *
+ * Usage: ctlra_bench [-n reports] [-o results.csv] [capture files...]
+ *
+ * Capture files recorded with CTLRA_USB_CAPTURE=<file> are benchmarked
+ * in addition to the synthetic scenarios. Note that in replay mode USB
+ * writes are not submitted, so allocations of the write path are not
+ * included in the count.
+ *
+ * With -s, a scaling benchmark is run instead: 1 to 64 devices are
+ * emulated by the mock USB transport, and the idle loop of an app that
+ * writes LED feedback every iteration is timed. Output is one CSV line
+ * per device count:
+ *   devices,iterations,iter_ns_mean,iter_ns_max,latency_us_p50,
+ *   latency_us_p99,latency_us_max,cpu_percent
+ * Options: -r report rate (Hz), -l write latency (us), -t duration of
+ * each step (ms), -i sleep between idle iterations (us).
+ *
+ * With -f, the cost of a full LED refresh is timed for each device on
+ * the mock transport, comparing one ctlra_dev_light_set() per light with
+ * ctlra_dev_lights_set_dense(). The -n option sets the number of frames.
+ * Output is one line per device and method:
+ *   device,method,lights,ns_per_frame
+ *
+ * With -p, RGB to palette quantisation is timed, comparing the per-call
+ * HSV arithmetic the MK3 driver used with the shared lookup table. The
+ * -n option sets the number of colours converted. Output is one line
+ * per method:
+ *   method,colours,ns_per_colour,mismatch_percent
+ *
+ * With -d, the screen frame diff of the MK3 and D2 drivers is run over
+ * synthetic UI content. Each frame is decoded onto the previous one to
+ * check the result. The -n option sets the number of frames. Output is
+ * one line per scenario, where full_frames counts frames sent as a
+ * full blit and bytes_per_frame includes those:
+ *   scenario,frames,bytes_per_frame,full_frames,ns_per_frame,exact
+ * The exit status is 1 if any scenario is not exact.
+ *
+ * With -c, each pixel format conversion kernel the CPU supports converts
+ * 480x272 frames, and its output is checked against the scalar kernel.
+ * Sprite blend kernels are checked the same way, and 1 bit conversion
+ * of 128x64 frames is timed for each dither mode. The -n option sets
+ * the number of frames. Output is one line per kernel:
+ *   kernel,frames,ns_per_frame,mpx_per_sec,mismatch
+ * The exit status is 1 if any kernel has a mismatch.
+ *
+ * With -x, a page of 16 parameter labels is drawn with the built-in font
+ * into a 480x272 screen, with a warm glyph cache, a cold one, and into a
+ * 1 bit screen. Converting a whole ARGB32 frame, as drawing the labels
+ * with cairo requires, is timed for comparison. The -n option sets the
+ * number of frames. Output is one line per scenario, where damage_px is
+ * the size of the zone reported as changed:
+ *   scenario,frames,ns_per_frame,damage_px
+ *
+ * With -w, a 480x96 waveform on a 480x272 screen scrolls by 4 columns a
+ * frame. Scrolling, which draws only new columns, is timed against
+ * redrawing the whole area every frame, for a full width area, a narrower
+ * one and a 1 bit screen. The -n option sets the number of frames.
+ * Output is one line per scenario, damage_px being the pixels sent:
+ *   scenario,frames,ns_per_frame,damage_px
+ */
+
+static uint64_t allocs;
+
+#ifdef __GLIBC__
+/* Count allocations by interposing the libc allocator */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+	allocs++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+	allocs++;
+	return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	allocs++;
+	return __libc_realloc(ptr, size);
+}
+#endif
+
+#define MAX_REPORTS 4
+
+struct bench_dev_t {
+	const char *name;
+	uint16_t vid;
+	uint16_t pid;
+	uint8_t endpoint;
+	/* sizes of the reports the device sends, used round-robin */
+	uint8_t report_sizes[MAX_REPORTS];
+};
+
+static const struct bench_dev_t devices[] = {
+	{ "Maschine Mk3",     0x17cc, 0x1600, 0x83, {128, 42} },
+	{ "Maschine Mikro Mk2", 0x17cc, 0x1200, 0x81, {65, 6} },
+	{ "Kontrol D2",       0x17cc, 0x1400, 0x81, {25, 17} },
+	{ "Maschine Jam",     0x17cc, 0x1500, 0x81, {49, 17} },
+	{ "Kontrol S2 Mk2",   0x17cc, 0x1320, 0x83, {17, 51} },
+	{ "Kontrol X1 Mk2",   0x17cc, 0x1220, 0x81, {31} },
+	{ "Kontrol F1",       0x17cc, 0x1120, 0x81, {22} },
+	{ "Kontrol Z1",       0x17cc, 0x1210, 0x82, {30} },
+	{ "SpaceMouse Pro",   0x256f, 0xc632, 0x81, {7, 13} },
+};
+#define NUM_DEVICES (sizeof(devices) / sizeof(devices[0]))
+
+/* Scenarios fill the report payload for report number *i*. They are
+ * generic - the aim is to make each control of every driver change */
+typedef void (*scenario_fill)(uint32_t i, uint8_t *buf, uint32_t size);
+
+static void fill_idle(uint32_t i, uint8_t *buf, uint32_t size)
+{
+	memset(buf, 0, size);
+}
+
+static void fill_sweep(uint32_t i, uint8_t *buf, uint32_t size)
+{
+	/* triangle wave, moves every fader/dial on every report */
+	uint32_t t = (i * 16) & 0x1ff;
+	memset(buf, t > 0xff ? 0x1ff - t : t, size);
+}
+
+static void fill_pressed(uint32_t i, uint8_t *buf, uint32_t size)
+{
+	memset(buf, 0xff, size);
+}
+
+static void fill_spin(uint32_t i, uint8_t *buf, uint32_t size)
+{
+	/* single steps: nibble and byte encoders turn by one each report */
+	memset(buf, i & 0xff, size);
+}
+
+static const struct {
+	const char *name;
+	scenario_fill fill;
+} scenarios[] = {
+	{ "idle", fill_idle },
+	{ "fader_sweep", fill_sweep },
+	{ "all_pressed", fill_pressed },
+	{ "encoder_spin", fill_spin },
+};
+#define NUM_SCENARIOS (sizeof(scenarios) / sizeof(scenarios[0]))
+
+static uint64_t events;
+
+void bench_event_func(struct ctlra_dev_t* dev, uint32_t num_events,
+		      struct ctlra_event_t** e, void *userdata)
+{
+	events += num_events;
+}
+
+int bench_accept_func(struct ctlra_t *ctlra,
+		      const struct ctlra_dev_info_t *info,
+		      struct ctlra_dev_t *dev, void *userdata)
+{
+	ctlra_dev_set_event_func(dev, bench_event_func);
+	return 1;
+}
+
+static int write_capture(const char *path, const struct bench_dev_t *d,
+			 scenario_fill fill, uint32_t num_reports)
+{
+	FILE *f = fopen(path, "wb");
+	if(!f)
+		return -1;
+
+	struct ctlra_capture_header_t hdr = {
+		.magic = CTLRA_CAPTURE_MAGIC,
+		.version = CTLRA_CAPTURE_VERSION,
+		.header_size = sizeof(hdr),
+	};
+	fwrite(&hdr, sizeof(hdr), 1, f);
+
+	int num_sizes = 0;
+	while(num_sizes < MAX_REPORTS && d->report_sizes[num_sizes])
+		num_sizes++;
+
+	uint8_t buf[256];
+	for(uint32_t i = 0; i < num_reports; i++) {
+		struct ctlra_capture_record_t rec = {
+			.time_ns = i * 1000000ull,
+			.vendor_id = d->vid,
+			.device_id = d->pid,
+			.endpoint = d->endpoint,
+			.size = d->report_sizes[i % num_sizes],
+		};
+		/* each report type sees every step of the scenario */
+		fill(i / num_sizes, buf, rec.size);
+		fwrite(&rec, sizeof(rec), 1, f);
+		fwrite(buf, rec.size, 1, f);
+	}
+
+	fclose(f);
+	return 0;
+}
+
+static uint64_t ns_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t cpu_ns_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+#define LATENCY_SAMPLES_MAX (1 << 20)
+static uint64_t *latency_samples;
+static uint32_t latency_count;
+
+void scaling_event_func(struct ctlra_dev_t* dev, uint32_t num_events,
+			struct ctlra_event_t** e, void *userdata)
+{
+	/* latency from the report being due to the app seeing it */
+	uint64_t lat = ns_now() - ctlra_usb_mock_report_due_ns();
+	for(uint32_t i = 0; i < num_events; i++)
+		if(latency_count < LATENCY_SAMPLES_MAX)
+			latency_samples[latency_count++] = lat;
+}
+
+void scaling_feedback_func(struct ctlra_dev_t *dev, void *d)
+{
+	/* a typical app: update a few lights every iteration */
+	static uint32_t iter;
+	iter++;
+	for(int i = 0; i < 8; i++)
+		ctlra_dev_light_set(dev, i, (iter + i) & 1 ? 0xffffffff : 0);
+	ctlra_dev_light_flush(dev, 0);
+}
+
+int scaling_accept_func(struct ctlra_t *ctlra,
+			const struct ctlra_dev_info_t *info,
+			struct ctlra_dev_t *dev, void *userdata)
+{
+	ctlra_dev_set_event_func(dev, scaling_event_func);
+	ctlra_dev_set_feedback_func(dev, scaling_feedback_func);
+	return 1;
+}
+
+static void scaling_fill(uint32_t mock_idx, uint64_t report_idx,
+			 uint8_t *data, uint32_t size, void *userdata)
+{
+	/* mix of spinning and sweeping controls */
+	fill_spin(report_idx, data, size / 2);
+	fill_sweep(report_idx, &data[size / 2], size - size / 2);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+static void bench_scaling(FILE *out, uint32_t rate_hz, uint32_t latency_us,
+			  uint32_t duration_ms, uint32_t sleep_us)
+{
+	latency_samples = malloc(LATENCY_SAMPLES_MAX * sizeof(uint64_t));
+	if(!latency_samples)
+		return;
+
+	fprintf(out, "devices,iterations,iter_ns_mean,iter_ns_max,"
+		"latency_us_p50,latency_us_p99,latency_us_max,cpu_percent\n");
+
+	for(uint32_t num = 1; num <= 64; num *= 2) {
+		struct ctlra_usb_mock_dev_t mock[64];
+		for(uint32_t i = 0; i < num; i++) {
+			const struct bench_dev_t *d = &devices[i % NUM_DEVICES];
+			mock[i] = (struct ctlra_usb_mock_dev_t) {
+				.vendor_id = d->vid,
+				.device_id = d->pid,
+				.endpoint = d->endpoint,
+				.report_size = d->report_sizes[0],
+				.report_rate_hz = rate_hz,
+				.write_latency_us = latency_us,
+			};
+		}
+		if(ctlra_usb_mock_enable(mock, num, scaling_fill, 0x0))
+			break;
+
+		struct ctlra_t *ctlra = ctlra_create(NULL);
+		int num_devs = ctlra_probe(ctlra, scaling_accept_func, 0x0);
+		if(num_devs != num)
+			fprintf(stderr, "scaling: %d of %d devices connected\n",
+				num_devs, num);
+
+		latency_count = 0;
+		uint64_t iters = 0, iter_total = 0, iter_max = 0;
+		uint64_t cpu_start = cpu_ns_now();
+		uint64_t start = ns_now();
+		uint64_t end = start + duration_ms * 1000000ull;
+
+		while(ns_now() < end) {
+			uint64_t t = ns_now();
+			ctlra_idle_iter(ctlra);
+			t = ns_now() - t;
+			iter_total += t;
+			iter_max = t > iter_max ? t : iter_max;
+			iters++;
+			if(sleep_us)
+				usleep(sleep_us);
+		}
+
+		uint64_t wall = ns_now() - start;
+		uint64_t cpu = cpu_ns_now() - cpu_start;
+
+		ctlra_exit(ctlra);
+		ctlra_usb_mock_disable();
+
+		uint64_t p50 = 0, p99 = 0, pmax = 0;
+		if(latency_count) {
+			qsort(latency_samples, latency_count, sizeof(uint64_t),
+			      cmp_u64);
+			p50 = latency_samples[latency_count / 2];
+			p99 = latency_samples[(latency_count * 99ull) / 100];
+			pmax = latency_samples[latency_count - 1];
+		}
+
+		fprintf(out, "%u,%lu,%lu,%lu,%.1f,%.1f,%.1f,%.1f\n", num,
+			(unsigned long)iters,
+			(unsigned long)(iters ? iter_total / iters : 0),
+			(unsigned long)iter_max, p50 / 1e3, p99 / 1e3,
+			pmax / 1e3, 100. * cpu / wall);
+	}
+
+	free(latency_samples);
+}
+
+/* replays the capture at *path*, and prints a line of results */
+static void bench_replay(FILE *out, const char *device, const char *scenario,
+			 const char *path, uint32_t num_reports)
+{
+	setenv("CTLRA_USB_REPLAY", path, 1);
+	setenv("CTLRA_USB_REPLAY_FAST", "1", 1);
+
+	struct ctlra_t *ctlra = ctlra_create(NULL);
+	int num_devs = ctlra_probe(ctlra, bench_accept_func, 0x0);
+	if(num_devs == 0) {
+		fprintf(stderr, "%s: no driver connected, skipping\n", device);
+		ctlra_exit(ctlra);
+		return;
+	}
+
+	events = 0;
+	uint64_t allocs_start = allocs;
+	uint64_t start = ns_now();
+
+	/* in fast replay mode, one iteration feeds every report */
+	ctlra_idle_iter(ctlra);
+
+	uint64_t elapsed = ns_now() - start;
+	uint64_t num_allocs = allocs - allocs_start;
+
+	fprintf(out, "%s,%s,%u,%.1f,%.0f,%.3f\n", device, scenario,
+		num_reports, (double)elapsed / num_reports,
+		events / (elapsed / 1e9), (double)num_allocs / num_reports);
+
+	ctlra_exit(ctlra);
+}
+
+/* light ids above the device's range are ignored by the drivers, so
+ * this covers all LEDs of every supported device */
+#define FRAME_LIGHTS 256
+
+int frame_accept_func(struct ctlra_t *ctlra,
+		      const struct ctlra_dev_info_t *info,
+		      struct ctlra_dev_t *dev, void *userdata)
+{
+	*(struct ctlra_dev_t **)userdata = dev;
+	return 1;
+}
+
+static void bench_frame(FILE *out, uint32_t num_frames)
+{
+	uint32_t values[FRAME_LIGHTS];
+
+	fprintf(out, "device,method,lights,ns_per_frame\n");
+
+	for(int d = 0; d < NUM_DEVICES; d++) {
+		struct ctlra_usb_mock_dev_t mock = {
+			.vendor_id = devices[d].vid,
+			.device_id = devices[d].pid,
+			.endpoint = devices[d].endpoint,
+			.report_size = devices[d].report_sizes[0],
+			.report_rate_hz = 1,
+		};
+		if(ctlra_usb_mock_enable(&mock, 1, scaling_fill, 0x0))
+			break;
+
+		struct ctlra_dev_t *dev = 0;
+		struct ctlra_t *ctlra = ctlra_create(NULL);
+		ctlra_probe(ctlra, frame_accept_func, &dev);
+		if(!dev) {
+			ctlra_exit(ctlra);
+			ctlra_usb_mock_disable();
+			continue;
+		}
+
+		for(int m = 0; m < 2; m++) {
+			uint64_t start = ns_now();
+			for(uint32_t f = 0; f < num_frames; f++) {
+				/* a moving pattern, so values change per frame */
+				for(uint32_t i = 0; i < FRAME_LIGHTS; i++)
+					values[i] = ((i + f) & 3) ?
+						0xff0000ff * (i & 1) : 0;
+				if(m == 0) {
+					for(uint32_t i = 0; i < FRAME_LIGHTS; i++)
+						ctlra_dev_light_set(dev, i,
+								    values[i]);
+				} else {
+					ctlra_dev_lights_set_dense(dev, values,
+								   FRAME_LIGHTS);
+				}
+			}
+			uint64_t elapsed = ns_now() - start;
+			fprintf(out, "%s,%s,%u,%.1f\n", devices[d].name,
+				m == 0 ? "light_set" : "lights_set_dense",
+				FRAME_LIGHTS, (double)elapsed / num_frames);
+		}
+
+		ctlra_exit(ctlra);
+		ctlra_usb_mock_disable();
+	}
+}
+
+/* The MK3 light_set() colour path before the palette tables */
+static uint8_t palette_hsv_arith(uint32_t light_status)
+{
+	const uint8_t r = ((light_status >> 16) & 0xFF);
+	const uint8_t g = ((light_status >>  8) & 0xFF);
+	const uint8_t b = ((light_status >>  0) & 0xFF);
+
+	uint8_t max = r > g ? r : g;
+	max = b > max ? b : max;
+	uint8_t min = r < g ? r : g;
+	min = b < min ? b : min;
+
+	uint8_t v = max;
+	uint8_t h;
+	if (v == 0 || (max - min) == 0) {
+		h = 0;
+	} else {
+		if (max == r)
+			h = 0 + 43 * (g - b) / (max - min);
+		else if (max == g)
+			h = 85 + 43 * (b - r) / (max - min);
+		else
+			h = 171 + 43 * (r - g) / (max - min);
+	}
+
+	uint8_t hue = h / 16 + 1;
+	if(r == g && r == b)
+		hue = 0xff;
+	if(light_status == 0)
+		hue = 0;
+	return hue;
+}
+
+static struct ctlra_palette_t bench_palette;
+
+static uint8_t palette_lut(uint32_t light_status)
+{
+	uint8_t hue = ctlra_palette_lookup(&bench_palette, light_status);
+	if(light_status == 0)
+		hue = 0;
+	return hue;
+}
+
+static void bench_palette_quantise(FILE *out, uint32_t num_colours)
+{
+	/* random colours with full brightness, as an app animating pads */
+	uint32_t *colours = malloc(num_colours * sizeof(uint32_t));
+	uint8_t *results = malloc(num_colours);
+	if(!colours || !results)
+		goto done;
+
+	uint32_t seed = 0x12345678;
+	for(uint32_t i = 0; i < num_colours; i++) {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		colours[i] = 0x7f000000 | (seed & 0xffffff);
+	}
+
+	uint64_t start = ns_now();
+	ctlra_palette_init(&bench_palette, ctlra_palette_ni_hue,
+			   (void *)(uintptr_t)0xff);
+	uint64_t init_ns = ns_now() - start;
+
+	struct {
+		const char *name;
+		uint8_t (*func)(uint32_t);
+	} methods[] = {
+		{"hsv_arith", palette_hsv_arith},
+		{"lut_15bit", palette_lut},
+	};
+
+	fprintf(out, "method,colours,ns_per_colour,mismatch_percent\n");
+	for(int m = 0; m < 2; m++) {
+		uint32_t mismatch = 0;
+		start = ns_now();
+		for(uint32_t i = 0; i < num_colours; i++)
+			results[i] = methods[m].func(colours[i]);
+		uint64_t elapsed = ns_now() - start;
+
+		/* the lookup reduces to 15 bits, count changed hues */
+		for(uint32_t i = 0; i < num_colours; i++)
+			mismatch += results[i] != palette_hsv_arith(colours[i]);
+
+		fprintf(out, "%s,%u,%.2f,%.2f\n", methods[m].name, num_colours,
+			(double)elapsed / num_colours,
+			100.0 * mismatch / num_colours);
+	}
+	fprintf(out, "# lut_15bit table init %.1f us, %u bytes\n",
+		init_ns / 1000., CTLRA_PALETTE_SIZE);
+
+done:
+	free(colours);
+	free(results);
+}
+
+#define SCR_PX (NI_SCREEN_W * NI_SCREEN_H)
+
+/* Static UI: two panels, a header bar and rows of text-like noise */
+static void screen_ui_draw(uint16_t *px)
+{
+	for(uint32_t y = 0; y < NI_SCREEN_H; y++) {
+		for(uint32_t x = 0; x < NI_SCREEN_W; x++) {
+			uint16_t c = 0x0841;
+			if(y < 24)
+				c = 0x3186;
+			else if(x > 16 && x < 232 && y > 40 && y < 256)
+				c = 0x2104;
+			else if(x > 248 && x < 464 && y > 40 && y < 256)
+				c = 0x2104;
+			/* 8px high "text" lines, glyph-ish bit patterns */
+			if((y % 16) < 8 && y > 40 && (x % 120) < 96 &&
+			   ((x * 7 + y * 13) % 5) < 2)
+				c = 0xffff;
+			px[y * NI_SCREEN_W + x] = c;
+		}
+	}
+}
+
+static void screen_rect(uint16_t *px, uint32_t x, uint32_t y,
+			uint32_t w, uint32_t h, uint16_t c)
+{
+	for(uint32_t j = y; j < y + h; j++)
+		for(uint32_t i = x; i < x + w; i++)
+			px[j * NI_SCREEN_W + i] = c;
+}
+
+/* Applies an encoded transfer to *screen*, as the device would */
+static int screen_decode(uint8_t *screen, const uint8_t *cmd, uint32_t size)
+{
+	uint32_t idx = NI_SCREEN_HEADER_SIZE;
+	uint32_t pos = 0;
+	while(idx < size - NI_SCREEN_FOOTER_SIZE) {
+		uint8_t op = cmd[idx];
+		uint32_t pairs = (cmd[idx+1] << 16) | (cmd[idx+2] << 8) |
+				 cmd[idx+3];
+		idx += NI_SCREEN_CMD_SIZE;
+		if(pos + pairs * 4 > SCR_PX * 2)
+			return -1;
+		if(op == 0x0) {
+			memcpy(&screen[pos], &cmd[idx], pairs * 4);
+			idx += pairs * 4;
+		} else if(op == 0x1) {
+			for(uint32_t i = 0; i < pairs; i++)
+				memcpy(&screen[pos + i * 4], &cmd[idx], 4);
+			idx += 4;
+		} else if(op != 0x2) {
+			return -1;
+		}
+		pos += pairs * 4;
+	}
+	return 0;
+}
+
+enum {
+	SCREEN_STATIC,
+	SCREEN_METER,
+	SCREEN_CURSOR,
+	SCREEN_SCROLL,
+	NUM_SCREEN_SCENARIOS,
+};
+static const char *screen_scenarios[] = {
+	"static", "meter", "cursor", "scroll",
+};
+
+static int bench_screen_diff(FILE *out, uint32_t num_frames)
+{
+	int fails = 1;
+	uint16_t *px = malloc(SCR_PX * 2);
+	uint8_t *screen = malloc(SCR_PX * 2);
+	uint8_t *cmd = malloc(NI_SCREEN_PARTIAL_MAX);
+	struct ni_screen_diff_t *diff = malloc(sizeof(*diff));
+	uint8_t header[NI_SCREEN_HEADER_SIZE] = {0};
+	uint8_t footer[NI_SCREEN_FOOTER_SIZE] = {0};
+	if(!px || !screen || !cmd || !diff)
+		goto done;
+
+	fprintf(out, "scenario,frames,bytes_per_frame,full_frames,"
+		"ns_per_frame,exact\n");
+	fails = 0;
+
+	for(int s = 0; s < NUM_SCREEN_SCENARIOS; s++) {
+		screen_ui_draw(px);
+		ni_screen_diff_full(diff, (uint8_t *)px);
+		memcpy(screen, px, SCR_PX * 2);
+
+		uint64_t bytes = 0;
+		uint64_t ns = 0;
+		uint32_t full = 0;
+		int exact = 1;
+		for(uint32_t f = 0; f < num_frames; f++) {
+			uint32_t t = f % 64;
+			switch(s) {
+			case SCREEN_METER:
+				/* two level meters moving every frame */
+				screen_rect(px, 200, 44, 24, 208, 0x2104);
+				screen_rect(px, 200, 252 - t * 3, 24, t * 3,
+					    0x07e0);
+				screen_rect(px, 440, 44, 24, 208, 0x2104);
+				screen_rect(px, 440, 60 + t * 3, 24,
+					    192 - t * 3, 0xf800);
+				break;
+			case SCREEN_CURSOR:
+				/* a playhead moving over a panel */
+				screen_rect(px, 20 + (t + 63) % 64 * 3, 44, 2,
+					    208, 0x2104);
+				screen_rect(px, 20 + t * 3, 44, 2, 208, 0xffe0);
+				break;
+			case SCREEN_SCROLL:
+				/* scroll by a line, so every row changes */
+				memmove(&px[NI_SCREEN_W * 24],
+					&px[NI_SCREEN_W * 25],
+					NI_SCREEN_W * (NI_SCREEN_H - 25) * 2);
+				break;
+			}
+
+			uint64_t start = ns_now();
+			uint32_t size = ni_screen_encode_diff(cmd, diff,
+							      header, footer,
+							      (uint8_t *)px);
+			ns += ns_now() - start;
+
+			if(size >= NI_SCREEN_FULL_SIZE) {
+				full++;
+				bytes += NI_SCREEN_FULL_SIZE;
+				memcpy(screen, px, SCR_PX * 2);
+			} else if(size) {
+				bytes += size;
+				if(screen_decode(screen, cmd, size))
+					exact = 0;
+			}
+			if(memcmp(screen, px, SCR_PX * 2))
+				exact = 0;
+		}
+
+		fprintf(out, "%s,%u,%.1f,%u,%.1f,%d\n", screen_scenarios[s],
+			num_frames, (double)bytes / num_frames, full,
+			(double)ns / num_frames, exact);
+		fails += !exact;
+	}
+
+done:
+	free(px);
+	free(screen);
+	free(cmd);
+	free(diff);
+	return fails;
+}
+
+static int bench_pixel_convert(FILE *out, uint32_t num_frames)
+{
+	int fails = 1;
+	const uint32_t num_px = SCR_PX;
+	uint8_t *src = malloc(num_px * 4);
+	uint8_t *dst = malloc(num_px * 2);
+	uint8_t *ref = malloc(num_px * 2);
+	if(!src || !dst || !ref)
+		goto done;
+	fails = 0;
+
+	for(uint32_t i = 0; i < num_px * 4; i++)
+		src[i] = (i * 2654435761u) >> 24;
+
+	fprintf(out, "kernel,frames,ns_per_frame,mpx_per_sec,mismatch\n");
+
+	for(uint32_t k = 0; k < ctlra_pixel_kernels_count; k++) {
+		const struct ctlra_pixel_kernel_t *kern =
+			&ctlra_pixel_kernels[k];
+		if(!ctlra_pixel_isa_supported(kern->isa))
+			continue;
+		uint32_t src_row = NI_SCREEN_W *
+			ctlra_pixel_format_bpp(kern->src_format) / 8;
+		uint32_t dst_row = NI_SCREEN_W *
+			ctlra_pixel_format_bpp(kern->dst_format) / 8;
+
+		/* the scalar kernel of the same conversion is the reference */
+		for(uint32_t r = 0; r < ctlra_pixel_kernels_count; r++) {
+			const struct ctlra_pixel_kernel_t *s =
+				&ctlra_pixel_kernels[r];
+			if(s->isa == CTLRA_PIXEL_ISA_SCALAR &&
+			   s->src_format == kern->src_format &&
+			   s->dst_format == kern->dst_format)
+				s->convert(ref, src, num_px);
+		}
+
+		/* one row at a time, as ctlra_screen_convert() does */
+		uint64_t start = ns_now();
+		for(uint32_t f = 0; f < num_frames; f++)
+			for(uint32_t y = 0; y < NI_SCREEN_H; y++)
+				kern->convert(&dst[y * dst_row],
+					      &src[y * src_row],
+					      NI_SCREEN_W);
+		uint64_t elapsed = ns_now() - start;
+
+		double ns = (double)elapsed / num_frames;
+		int mismatch = memcmp(dst, ref, dst_row * NI_SCREEN_H) != 0;
+		fprintf(out, "%s,%u,%.1f,%.1f,%d\n", kern->name, num_frames,
+			ns, num_px * 1000. / ns, mismatch);
+		fails += mismatch;
+	}
+
+	/* 1 bit page packing, over the bytes of src as grey rows */
+	uint8_t pattern[8][16];
+	for(int r = 0; r < 8; r++)
+		for(int x = 0; x < 16; x++)
+			pattern[r][x] = (r * 16 + x) * 2;
+	const uint32_t pages = NI_SCREEN_H / 8;
+	for(uint32_t k = 0; k < ctlra_pixel_page_kernels_count; k++) {
+		const struct ctlra_pixel_page_kernel_t *kern =
+			&ctlra_pixel_page_kernels[k];
+		if(!ctlra_pixel_isa_supported(kern->isa))
+			continue;
+
+		for(int pass = 0; pass < 2; pass++) {
+			uint8_t *o = pass ? dst : ref;
+			ctlra_pixel_page_func pack = pass ? kern->pack :
+				ctlra_pixel_page_kernels[0].pack;
+			uint32_t frames = pass ? num_frames : 1;
+			uint64_t start = ns_now();
+			for(uint32_t f = 0; f < frames; f++) {
+				for(uint32_t p = 0; p < pages; p++) {
+					const uint8_t *rows[8];
+					for(int r = 0; r < 8; r++)
+						rows[r] = &src[(p * 8 + r) *
+							       NI_SCREEN_W];
+					pack(&o[p * NI_SCREEN_W], rows,
+					     pattern, NI_SCREEN_W);
+				}
+			}
+			if(!pass)
+				continue;
+			double ns = (double)(ns_now() - start) / num_frames;
+			int mismatch = memcmp(dst, ref,
+					      pages * NI_SCREEN_W) != 0;
+			fprintf(out, "%s,%u,%.1f,%.1f,%d\n", kern->name,
+				num_frames, ns, num_px * 1000. / ns, mismatch);
+			fails += mismatch;
+		}
+	}
+
+	/* sprite blending, premultiplied src over dst with varied alpha */
+	uint8_t *alpha = &src[num_px * 2];
+	for(uint32_t k = 0; k < ctlra_pixel_blend_kernels_count; k++) {
+		const struct ctlra_pixel_blend_kernel_t *kern =
+			&ctlra_pixel_blend_kernels[k];
+		if(!ctlra_pixel_isa_supported(kern->isa))
+			continue;
+		const uint32_t bytes = ctlra_pixel_format_bpp(kern->format) / 8;
+		const uint32_t row = NI_SCREEN_W * bytes;
+
+		for(int pass = 0; pass < 2; pass++) {
+			uint8_t *o = pass ? dst : ref;
+			ctlra_pixel_blend_func blend = kern->blend;
+			for(uint32_t r = 0; !pass && r < k; r++) {
+				const struct ctlra_pixel_blend_kernel_t *s =
+					&ctlra_pixel_blend_kernels[r];
+				if(s->isa == CTLRA_PIXEL_ISA_SCALAR &&
+				   s->format == kern->format)
+					blend = s->blend;
+			}
+			uint32_t frames = pass ? num_frames : 1;
+			uint64_t start = ns_now();
+			for(uint32_t f = 0; f < frames; f++) {
+				/* the same destination every frame */
+				memset(o, 0x5a, row * NI_SCREEN_H);
+				for(uint32_t y = 0; y < NI_SCREEN_H; y++)
+					blend(&o[y * row], &src[y * row],
+					      &alpha[y * NI_SCREEN_W],
+					      NI_SCREEN_W);
+			}
+			if(!pass)
+				continue;
+			double ns = (double)(ns_now() - start) / num_frames;
+			int mismatch = memcmp(dst, ref, row * NI_SCREEN_H) != 0;
+			fprintf(out, "%s,%u,%.1f,%.1f,%d\n", kern->name,
+				num_frames, ns, num_px * 1000. / ns, mismatch);
+			fails += mismatch;
+		}
+	}
+
+	/* whole Mikro MK2 sized frames from ARGB32, per dither mode. The
+	 * threshold mode is checked against a plain grey >= 128 test, the
+	 * dithered modes only against failing */
+	static const char *dither_names[] = {
+		"mono1_threshold", "mono1_ordered", "mono1_floyd_steinberg",
+	};
+	ctlra_pixel_row_func grey =
+		ctlra_pixel_kernel_get(CTLRA_PIXEL_FORMAT_ARGB32,
+				       CTLRA_PIXEL_FORMAT_GREY8);
+	memset(ref, 0, 128 * 64 / 8);
+	for(uint32_t y = 0; grey && y < 64; y++) {
+		uint8_t row[128];
+		grey(row, &src[y * 128 * 4], 128);
+		for(uint32_t x = 0; x < 128; x++)
+			ref[(y / 8) * 128 + x] |= (row[x] >= 128) << (y % 8);
+	}
+	for(uint32_t d = 0; d < 3; d++) {
+		int32_t ret = 0;
+		uint64_t start = ns_now();
+		for(uint32_t f = 0; f < num_frames; f++)
+			ret |= ctlra_pixel_mono1_convert(dst, 128, 64,
+						CTLRA_PIXEL_FORMAT_ARGB32,
+						src, 128 * 4, d, 0);
+		double ns = (double)(ns_now() - start) / num_frames;
+		int mismatch = ret != 0 || !grey ||
+			(d == CTLRA_DITHER_THRESHOLD &&
+			 memcmp(dst, ref, 128 * 64 / 8) != 0);
+		fprintf(out, "%s,%u,%.1f,%.1f,%d\n", dither_names[d],
+			num_frames, ns, 128 * 64 * 1000. / ns, mismatch);
+		fails += mismatch;
+	}
+
+done:
+	free(src);
+	free(dst);
+	free(ref);
+	return fails;
+}
+
+static const char *text_labels[] = {
+	"Cutoff 12.0k", "Reso   0.45", "Drive  3.2dB", "Mix     100%",
+	"Attack  12ms", "Decay  340ms", "Sustain -6dB", "Release 1.2s",
+	"LFO Rate 4Hz", "LFO Depth 8%", "Detune +7ct", "Glide  off",
+	"Pan   L 12", "Send A -inf", "Send B -9dB", "Volume -3dB",
+};
+
+static uint32_t text_page(struct ctlra_text_cache_t *cache, uint8_t *px,
+			  uint32_t w, uint32_t h, uint32_t format,
+			  uint32_t scale)
+{
+	struct ctlra_screen_zone_t zone = {0};
+	const uint32_t line = CTLRA_FONT_H * scale + 2;
+	for(uint32_t i = 0; i < 16; i++)
+		ctlra_impl_text_draw(cache, px, w, h, format,
+				     (i / 8) * (w / 2) + 2, (i % 8) * line,
+				     scale, 0xffffff, 0x202020,
+				     text_labels[i], &zone);
+	return zone.w * zone.h;
+}
+
+static void bench_text(FILE *out, uint32_t num_frames)
+{
+	uint8_t *src = calloc(SCR_PX, 4);
+	uint8_t *fb = calloc(SCR_PX, 2);
+	uint8_t mono[128 * 64 / 8];
+	struct ctlra_text_cache_t *cache = ctlra_impl_text_cache_new();
+	if(!src || !fb || !cache)
+		goto done;
+
+	fprintf(out, "scenario,frames,ns_per_frame,damage_px\n");
+
+	for(uint32_t scale = 1; scale <= 2; scale++) {
+		uint32_t damage = 0;
+		uint64_t start = ns_now();
+		for(uint32_t f = 0; f < num_frames; f++)
+			damage = text_page(cache, fb, NI_SCREEN_W, NI_SCREEN_H,
+					   CTLRA_PIXEL_FORMAT_RGB565_BE,
+					   scale);
+		double ns = (double)(ns_now() - start) / num_frames;
+		fprintf(out, "labels_scale%u,%u,%.1f,%u\n", scale,
+			num_frames, ns, damage);
+	}
+
+	/* a new cache per frame rasterises every glyph */
+	uint32_t damage = 0;
+	uint64_t start = ns_now();
+	for(uint32_t f = 0; f < num_frames; f++) {
+		struct ctlra_text_cache_t *cold = ctlra_impl_text_cache_new();
+		damage = text_page(cold, fb, NI_SCREEN_W, NI_SCREEN_H,
+				   CTLRA_PIXEL_FORMAT_RGB565_BE, 1);
+		ctlra_impl_text_cache_free(cold);
+	}
+	double ns = (double)(ns_now() - start) / num_frames;
+	fprintf(out, "labels_cold_cache,%u,%.1f,%u\n", num_frames, ns,
+		damage);
+
+	start = ns_now();
+	for(uint32_t f = 0; f < num_frames; f++)
+		damage = text_page(cache, mono, 128, 64,
+				   CTLRA_PIXEL_FORMAT_MONO1, 1);
+	ns = (double)(ns_now() - start) / num_frames;
+	fprintf(out, "labels_mono1,%u,%.1f,%u\n", num_frames, ns, damage);
+
+	ctlra_pixel_row_func conv =
+		ctlra_pixel_kernel_get(CTLRA_PIXEL_FORMAT_ARGB32,
+				       CTLRA_PIXEL_FORMAT_RGB565_BE);
+	start = ns_now();
+	for(uint32_t f = 0; f < num_frames; f++)
+		for(uint32_t y = 0; y < NI_SCREEN_H; y++)
+			conv(&fb[y * NI_SCREEN_W * 2],
+			     &src[y * NI_SCREEN_W * 4], NI_SCREEN_W);
+	ns = (double)(ns_now() - start) / num_frames;
+	fprintf(out, "argb32_full_convert,%u,%.1f,%u\n", num_frames, ns,
+		SCR_PX);
+
+done:
+	ctlra_impl_text_cache_free(cache);
+	free(src);
+	free(fb);
+}
+
+static void bench_waveform_run(FILE *out, const char *name,
+			       uint32_t w, uint32_t h, uint32_t format,
+			       struct ctlra_screen_zone_t area, int full,
+			       uint32_t num_frames)
+{
+	uint8_t *fb = calloc(w * h, 2);
+	struct ctlra_screen_waveform_t *wf =
+		ctlra_impl_waveform_new(w, h, format, &area, 0x4080ff, 0);
+	if(!fb || !wf)
+		goto done;
+
+	float min[4], max[4];
+	uint32_t t = 0;
+	struct ctlra_screen_zone_t zone = {0};
+	uint64_t start = ns_now();
+	for(uint32_t f = 0; f < num_frames; f++) {
+		for(int i = 0; i < 4; i++, t++) {
+			max[i] = ((t * 2654435761u) >> 24) / 255.f;
+			min[i] = -max[i] * 0.8f;
+		}
+		ctlra_screen_waveform_push(wf, min, max, 4);
+		if(full)
+			ctlra_screen_waveform_invalidate(wf);
+		zone = (struct ctlra_screen_zone_t){0};
+		ctlra_screen_waveform_draw(wf, fb, &zone);
+	}
+	double ns = (double)(ns_now() - start) / num_frames;
+	fprintf(out, "%s,%u,%.1f,%u\n", name, num_frames, ns,
+		zone.w * zone.h);
+done:
+	ctlra_screen_waveform_destroy(wf);
+	free(fb);
+}
+
+static void bench_waveform(FILE *out, uint32_t num_frames)
+{
+	const uint32_t rgb = CTLRA_PIXEL_FORMAT_RGB565_BE;
+	const uint32_t mono = CTLRA_PIXEL_FORMAT_MONO1;
+	const struct ctlra_screen_zone_t wide = {0, 88, NI_SCREEN_W, 96};
+	const struct ctlra_screen_zone_t narrow = {40, 88, 400, 96};
+	const struct ctlra_screen_zone_t mikro = {0, 16, 128, 32};
+
+	fprintf(out, "scenario,frames,ns_per_frame,damage_px\n");
+	bench_waveform_run(out, "wide_redraw", NI_SCREEN_W, NI_SCREEN_H, rgb,
+			   wide, 1, num_frames);
+	bench_waveform_run(out, "wide_scroll", NI_SCREEN_W, NI_SCREEN_H, rgb,
+			   wide, 0, num_frames);
+	bench_waveform_run(out, "narrow_redraw", NI_SCREEN_W, NI_SCREEN_H,
+			   rgb, narrow, 1, num_frames);
+	bench_waveform_run(out, "narrow_scroll", NI_SCREEN_W, NI_SCREEN_H,
+			   rgb, narrow, 0, num_frames);
+	bench_waveform_run(out, "mono1_redraw", 128, 64, mono, mikro, 1,
+			   num_frames);
+	bench_waveform_run(out, "mono1_scroll", 128, 64, mono, mikro, 0,
+			   num_frames);
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t num_reports = 100000;
+	FILE *out = stdout;
+	int opt;
+
+	int scaling = 0;
+	int palette = 0;
+	int frame = 0;
+	int screen = 0;
+	int convert = 0;
+	int text = 0;
+	int waveform = 0;
+	uint32_t rate_hz = 1000;
+	uint32_t latency_us = 500;
+	uint32_t duration_ms = 1000;
+	uint32_t sleep_us = 1000;
+
+	while((opt = getopt(argc, argv, "n:o:spfdcxwr:l:t:i:")) != -1) {
+		switch(opt) {
+		case 'n': num_reports = atoi(optarg); break;
+		case 's': scaling = 1; break;
+		case 'p': palette = 1; break;
+		case 'f': frame = 1; break;
+		case 'd': screen = 1; break;
+		case 'c': convert = 1; break;
+		case 'x': text = 1; break;
+		case 'w': waveform = 1; break;
+		case 'r': rate_hz = atoi(optarg); break;
+		case 'l': latency_us = atoi(optarg); break;
+		case 't': duration_ms = atoi(optarg); break;
+		case 'i': sleep_us = atoi(optarg); break;
+		case 'o':
+			out = fopen(optarg, "w");
+			if(!out) {
+				fprintf(stderr, "can't open %s\n", optarg);
+				return -1;
+			}
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n reports] [-o results.csv] "
+				"[capture files...]\n"
+				"       %s -s [-r rate_hz] [-l write_latency_us] "
+				"[-t step_ms] [-i sleep_us] [-o results.csv]\n"
+				"       %s -f [-n frames] [-o results.csv]\n"
+				"       %s -p [-n colours] [-o results.csv]\n"
+				"       %s -d [-n frames] [-o results.csv]\n"
+				"       %s -c [-n frames] [-o results.csv]\n"
+				"       %s -x [-n frames] [-o results.csv]\n"
+				"       %s -w [-n frames] [-o results.csv]\n",
+				argv[0], argv[0], argv[0], argv[0], argv[0],
+				argv[0], argv[0], argv[0]);
+			return -1;
+		}
+	}
+
+	if(frame) {
+		bench_frame(out, num_reports);
+		if(out != stdout)
+			fclose(out);
+		return 0;
+	}
+
+	if(convert) {
+		int fails = bench_pixel_convert(out, num_reports);
+		if(out != stdout)
+			fclose(out);
+		if(fails)
+			fprintf(stderr, "%d kernels differ from scalar\n",
+				fails);
+		return fails != 0;
+	}
+
+	if(waveform) {
+		bench_waveform(out, num_reports);
+		if(out != stdout)
+			fclose(out);
+		return 0;
+	}
+
+	if(text) {
+		bench_text(out, num_reports);
+		if(out != stdout)
+			fclose(out);
+		return 0;
+	}
+
+	if(screen) {
+		int fails = bench_screen_diff(out, num_reports);
+		if(out != stdout)
+			fclose(out);
+		if(fails)
+			fprintf(stderr, "%d scenarios not decoded exactly\n",
+				fails);
+		return fails != 0;
+	}
+
+	if(palette) {
+		bench_palette_quantise(out, num_reports);
+		if(out != stdout)
+			fclose(out);
+		return 0;
+	}
+
+	if(scaling) {
+		bench_scaling(out, rate_hz, latency_us, duration_ms, sleep_us);
+		if(out != stdout)
+			fclose(out);
+		return 0;
+	}
+
+	fprintf(out, "device,scenario,reports,ns_per_report,events_per_sec,"
+		"allocs_per_report\n");
+
+	char path[] = "/tmp/ctlra_bench_XXXXXX";
+	int fd = mkstemp(path);
+	if(fd < 0) {
+		fprintf(stderr, "can't create temp file\n");
+		return -1;
+	}
+	close(fd);
+
+	for(int d = 0; d < NUM_DEVICES; d++) {
+		for(int s = 0; s < NUM_SCENARIOS; s++) {
+			if(write_capture(path, &devices[d], scenarios[s].fill,
+					 num_reports))
+				continue;
+			bench_replay(out, devices[d].name, scenarios[s].name,
+				     path, num_reports);
+		}
+	}
+	unlink(path);
+
+	/* recorded captures: count the reports, then replay them */
+	for(int i = optind; i < argc; i++) {
+		FILE *f = fopen(argv[i], "rb");
+		if(!f)
+			continue;
+		struct ctlra_capture_header_t hdr;
+		struct ctlra_capture_record_t rec;
+		uint32_t count = 0;
+		if(fread(&hdr, sizeof(hdr), 1, f) == 1) {
+			fseek(f, hdr.header_size, SEEK_SET);
+			while(fread(&rec, sizeof(rec), 1, f) == 1 &&
+			      fseek(f, rec.size, SEEK_CUR) == 0)
+				count++;
+		}
+		fclose(f);
+		if(count)
+			bench_replay(out, "capture", argv[i], argv[i], count);
+	}
+
+	if(out != stdout)
+		fclose(out);
+
+	return 0;
+}
@@ -201,6 +201,9 @@ Error creating interface - please report to OpenAV. Exiting.\n", avtka_ui);
 	ctlra_dev_set_remove_func(dev, simple_remove_func);
 	ctlra_dev_set_callback_userdata(dev, userdata);
 
+	/* show pad pressure while held, on devices that can stream it */
+	ctlra_dev_grid_pressure_stream(dev, 0, 100, 0.01f);
+
 	return 1;
 }
 
@@ -0,0 +1,199 @@
+#define _DEFAULT_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+
+#include <linux/uinput.h>
+
+#include "ctlra.h"
+
+/* This example creates a virtual input device using the kernel uinput
+ * module, and opens it with Ctlra's evdev backend (build with
+ * -Devdev=true). Events are injected into the kernel, and read back by
+ * Ctlra, which exercises the evdev backend without any hardware.
+ *
+ * Writing to /dev/uinput usually requires root, or a udev rule.
+ *
+ * It is registered as a meson test: it exits non-zero if the device
+ * doesn't connect or the event counts are wrong, and with 77, which
+ * meson reports as skipped, if uinput isn't available.
+ */
+
+#define UINPUT_DEV_NAME "Ctlra uinput test"
+#define NUM_BUTTONS 8
+#define NUM_ITERS 100
+
+/* each iteration presses and releases a button, moves the dial, and
+ * moves the axis to a new value */
+#define EXPECT_BUTTONS  (NUM_ITERS * 2)
+#define EXPECT_ENCODERS (NUM_ITERS)
+#define EXPECT_SLIDERS  (NUM_ITERS)
+
+/* meson's exit code for a skipped test */
+#define EXIT_SKIP 77
+
+static volatile uint32_t done;
+static uint32_t events_received[CTLRA_EVENT_T_COUNT];
+
+static void uinput_emit(int fd, int type, int code, int value)
+{
+	struct input_event ie;
+	memset(&ie, 0, sizeof(ie));
+	ie.type = type;
+	ie.code = code;
+	ie.value = value;
+	if(write(fd, &ie, sizeof(ie)) != sizeof(ie))
+		printf("uinput: write failed\n");
+}
+
+static int uinput_create(void)
+{
+	int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+	if(fd < 0)
+		return -1;
+
+	ioctl(fd, UI_SET_EVBIT, EV_KEY);
+	for(int i = 0; i < NUM_BUTTONS; i++)
+		ioctl(fd, UI_SET_KEYBIT, BTN_0 + i);
+
+	ioctl(fd, UI_SET_EVBIT, EV_REL);
+	ioctl(fd, UI_SET_RELBIT, REL_DIAL);
+
+	ioctl(fd, UI_SET_EVBIT, EV_ABS);
+	ioctl(fd, UI_SET_ABSBIT, ABS_X);
+
+	struct uinput_user_dev uud;
+	memset(&uud, 0, sizeof(uud));
+	snprintf(uud.name, UINPUT_MAX_NAME_SIZE, UINPUT_DEV_NAME);
+	uud.id.bustype = BUS_VIRTUAL;
+	uud.id.vendor  = 0x1209;
+	uud.id.product = 0x0001;
+	uud.absmin[ABS_X] = 0;
+	uud.absmax[ABS_X] = 1023;
+
+	if(write(fd, &uud, sizeof(uud)) != sizeof(uud) ||
+	   ioctl(fd, UI_DEV_CREATE) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+void uinput_event_func(struct ctlra_dev_t* dev, uint32_t num_events,
+		       struct ctlra_event_t** events, void *userdata)
+{
+	for(uint32_t i = 0; i < num_events; i++) {
+		struct ctlra_event_t *e = events[i];
+		events_received[e->type]++;
+		switch(e->type) {
+		case CTLRA_EVENT_BUTTON:
+			printf("button %d %s\n", e->button.id,
+			       e->button.pressed ? "pressed" : "released");
+			break;
+		case CTLRA_EVENT_ENCODER:
+			printf("encoder %d delta %d\n", e->encoder.id,
+			       e->encoder.delta);
+			break;
+		case CTLRA_EVENT_SLIDER:
+			printf("slider %d value %0.3f\n", e->slider.id,
+			       e->slider.value);
+			break;
+		default:
+			break;
+		};
+	}
+}
+
+int accept_dev_func(struct ctlra_t *ctlra,
+		    const struct ctlra_dev_info_t *info,
+		    struct ctlra_dev_t *dev,
+                    void *userdata)
+{
+	/* only accept the uinput device we created */
+	if(strcmp(info->device, UINPUT_DEV_NAME) != 0)
+		return 0;
+
+	printf("uinput: accepting %s %s\n", info->vendor, info->device);
+	ctlra_dev_set_event_func(dev, uinput_event_func);
+	return 1;
+}
+
+void sighndlr(int signal)
+{
+	done = 1;
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	signal(SIGINT, sighndlr);
+
+	int fd = uinput_create();
+	if(fd < 0) {
+		printf("uinput: failed to create device, is /dev/uinput writable?\n");
+		return EXIT_SKIP;
+	}
+
+	/* give udev time to create the /dev/input/eventX node */
+	usleep(200 * 1000);
+
+	struct ctlra_t *ctlra = ctlra_create(NULL);
+	int num_devs = ctlra_probe(ctlra, accept_dev_func, 0x0);
+	printf("connected devices %d\n", num_devs);
+	if(num_devs < 1) {
+		printf("uinput: FAIL, the uinput device did not connect\n");
+		ctlra_exit(ctlra);
+		ioctl(fd, UI_DEV_DESTROY);
+		close(fd);
+		return 1;
+	}
+
+	for(int i = 0; i < NUM_ITERS && !done; i++) {
+		uinput_emit(fd, EV_KEY, BTN_0 + (i % NUM_BUTTONS), 1);
+		uinput_emit(fd, EV_SYN, SYN_REPORT, 0);
+		uinput_emit(fd, EV_KEY, BTN_0 + (i % NUM_BUTTONS), 0);
+		uinput_emit(fd, EV_REL, REL_DIAL, (i & 1) ? 1 : -1);
+		/* the kernel drops unchanged axis values, the axis starts at
+		 * 0 so every value sent must differ from it and the last */
+		uinput_emit(fd, EV_ABS, ABS_X, i * 10 + 1);
+		uinput_emit(fd, EV_SYN, SYN_REPORT, 0);
+
+		ctlra_idle_iter(ctlra);
+		usleep(10 * 1000);
+	}
+	/* drain events still queued in the kernel */
+	for(int i = 0; i < 50 && !done; i++) {
+		ctlra_idle_iter(ctlra);
+		if(events_received[CTLRA_EVENT_BUTTON] >= EXPECT_BUTTONS &&
+		   events_received[CTLRA_EVENT_ENCODER] >= EXPECT_ENCODERS &&
+		   events_received[CTLRA_EVENT_SLIDER] >= EXPECT_SLIDERS)
+			break;
+		usleep(10 * 1000);
+	}
+
+	printf("received: %d buttons, %d encoders, %d sliders\n",
+	       events_received[CTLRA_EVENT_BUTTON],
+	       events_received[CTLRA_EVENT_ENCODER],
+	       events_received[CTLRA_EVENT_SLIDER]);
+
+	int ret = 0;
+	if(events_received[CTLRA_EVENT_BUTTON] != EXPECT_BUTTONS ||
+	   events_received[CTLRA_EVENT_ENCODER] != EXPECT_ENCODERS ||
+	   events_received[CTLRA_EVENT_SLIDER] != EXPECT_SLIDERS) {
+		printf("uinput: FAIL, expected %d buttons, %d encoders, "
+		       "%d sliders\n", EXPECT_BUTTONS, EXPECT_ENCODERS,
+		       EXPECT_SLIDERS);
+		ret = 1;
+	}
+
+	ctlra_exit(ctlra);
+
+	ioctl(fd, UI_DEV_DESTROY);
+	close(fd);
+
+	return ret;
+}
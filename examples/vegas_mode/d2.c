@@ -41,18 +41,6 @@ void d2_screen_init(struct ctlra_dev_t *dev)
 	printf("d2: screen cb register ret = %d\n", ret);
 }
 
-static inline
-void pixel_convert_from_argb(int r, int g, int b, uint8_t *data)
-{
-	r = ((int)((r / 255.0) * 31)) & ((1<<5)-1);
-	g = ((int)((g / 255.0) * 63)) & ((1<<6)-1);
-	b = ((int)((b / 255.0) * 31)) & ((1<<5)-1);
-
-	uint16_t combined = (b | g << 5 | r << 11);
-	data[0] = combined >> 8;
-	data[1] = combined & 0xff;
-}
-
 void d2_screen_draw(struct ctlra_dev_t *dev, struct dummy_data *d)
 {
 	if(surface == 0)
@@ -86,18 +74,10 @@ void d2_screen_draw(struct ctlra_dev_t *dev, struct dummy_data *d)
 	}
 
 	uint8_t *pixels = ni_kontrol_d2_screen_get_pixels(dev);
-	uint16_t *write_head = (uint16_t*)pixels;
-	/* Copy the Cairo pixels to the usb buffer, taking the
-	 * stride of the cairo memory into account, converting from
-	 * RGB into the BGR that the screen expects */
-	for(int j = 0; j < HEIGHT; j++) {
-		for(int i = 0; i < WIDTH; i++) {
-			uint8_t *p = &data[(j * stride) + (i*4)];
-			int idx = (j * WIDTH) + (i);
-			pixel_convert_from_argb(p[2], p[1], p[0],
-						(uint8_t*)&write_head[idx]);
-		}
-	}
+	if(!pixels)
+		return;
+	ctlra_screen_convert(dev, 0, pixels, CTLRA_PIXEL_FORMAT_ARGB32,
+			     data, stride, NULL);
 
 	ni_kontrol_d2_screen_blit(dev);
 }
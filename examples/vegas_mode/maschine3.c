@@ -1,6 +1,7 @@
 #include "global.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "ctlra.h"
 
@@ -69,54 +70,106 @@ struct maschine3_t
 	uint8_t file_selected;
 
 
-	/* item browser cache */
-	uint8_t items_init;
+	/* item browser sprites, scaled and converted once per screen, as
+	 * sprite ids belong to the screen they were added to */
+	uint8_t browser;
+#define NUM_SCREENS 2
 #define NUM_ITEMS 8
-	cairo_surface_t *item_surfaces[NUM_ITEMS];
+	uint8_t items_init[NUM_SCREENS];
+	int32_t item_sprites[NUM_SCREENS][NUM_ITEMS];
+	int32_t item_h;
 
 #define NUM_ENCODERS 8
 	float encoder_value[NUM_ENCODERS];
 };
 
+/* the Browser button toggles the item browser on the screens */
+#define MK3_BTN_BROWSER 52
+
+/* item images are shown at ITEM_SCALE, with the selected item raised */
+#define ITEM_SCALE 0.35
+#define ITEM_Y     52
+#define ITEM_DROP  35
+
 static
-void maschine3_item_browser(struct dummy_data *d,
-			   cairo_t *cr,
-			   const char *path)
+int maschine3_item_browser(struct dummy_data *d,
+			   struct ctlra_dev_t *dev,
+			   uint32_t screen_idx,
+			   uint8_t *pixels,
+			   struct ctlra_screen_zone_t *damage)
 {
 	struct maschine3_t *m = d->maschine3;
+	int32_t *sprites = m->item_sprites[screen_idx];
 
-	if(!m->items_init) {
-		printf("init now\n");
+	if(!m->items_init[screen_idx]) {
 		char filename[64];
 		for(int i = 0; i < 4; i++) {
+			sprites[i] = -1;
 			snprintf(filename, 64, "item_%d.png", i + 1);
-			m->item_surfaces[i] =
+			cairo_surface_t *png =
 				cairo_image_surface_create_from_png(filename);
+			cairo_status_t st = cairo_surface_status(png);
 			printf("item load %d: ciaro surface status : %s\n", i,
-			       cairo_status_to_string(cairo_surface_status(m->item_surfaces[i])));
+			       cairo_status_to_string(st));
+			if(st != CAIRO_STATUS_SUCCESS) {
+				cairo_surface_destroy(png);
+				continue;
+			}
+
+			/* scale once here, frames only composite sprites */
+			int w = cairo_image_surface_get_width(png) * ITEM_SCALE;
+			int h = cairo_image_surface_get_height(png) * ITEM_SCALE;
+			cairo_surface_t *item =
+				cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+							   w, h);
+			cairo_t *icr = cairo_create(item);
+			cairo_scale(icr, ITEM_SCALE, ITEM_SCALE);
+			cairo_set_source_surface(icr, png, 0, 0);
+			cairo_paint(icr);
+			cairo_destroy(icr);
+			cairo_surface_flush(item);
+
+			sprites[i] = ctlra_screen_sprite_add(dev,
+				screen_idx, CTLRA_PIXEL_FORMAT_ARGB32,
+				cairo_image_surface_get_data(item), w, h,
+				cairo_image_surface_get_stride(item),
+				CTLRA_SPRITE_BLEND);
+			if(sprites[i] < 0)
+				printf("item %d: sprite add failed: %d\n", i,
+				       sprites[i]);
+			else if(h > m->item_h)
+				m->item_h = h;
+			cairo_surface_destroy(item);
+			cairo_surface_destroy(png);
 		}
-		/*
-		cairo_surface_flush(st->surface);
-		cairo_surface_destroy(surf);
-		*/
-		m->items_init = 1;
+		m->items_init[screen_idx] = 1;
 	}
 
-	cairo_save(cr);
-	cairo_scale(cr, 0.35, 0.35);
+	/* clear the strip the items move in, and send only that */
+	int bottom = ITEM_Y + ITEM_DROP + m->item_h;
+	if(bottom > HEIGHT)
+		bottom = HEIGHT;
+	memset(&pixels[ITEM_Y * WIDTH * 2], 0, (bottom - ITEM_Y) * WIDTH * 2);
+	*damage = (struct ctlra_screen_zone_t) {
+		.x = 0, .y = ITEM_Y, .w = WIDTH, .h = bottom - ITEM_Y,
+	};
+
 	for(int i = 0; i < 4; i++) {
-		cairo_save(cr);
-		//int sel = m->file_selected + (4 * (screen_idx == 1));
-		int sel = m->file_selected;
-		float off = ((sel % 8) == i) ? 0 : 1;
-		//cairo_scale(cr, off, off);
-		cairo_translate(cr, 100 * i, 150 + off * 100);
-		cairo_set_source_surface(cr, m->item_surfaces[i],
-					 i * 220, 0);
-		cairo_paint(cr);
-		cairo_restore(cr);
+		if(sprites[i] < 0)
+			continue;
+		int off = ((m->file_selected % 8) == i) ? 0 : 1;
+		int32_t ret = ctlra_screen_sprite_draw(dev, screen_idx, pixels,
+						       sprites[i], i * 112,
+						       ITEM_Y + off * ITEM_DROP,
+						       damage);
+		if(ret) {
+			/* don't retry a sprite the screen doesn't have */
+			printf("item %d: sprite draw failed: %d\n", i, ret);
+			sprites[i] = -1;
+		}
 	}
-	cairo_restore(cr);
+
+	return 2;
 }
 
 static
@@ -222,7 +275,6 @@ int draw_stuff(struct dummy_data *d, uint32_t screen_idx)
 #endif
 
 	if(1) maschine3_file_browser(d, cr, "test");
-	if(0) maschine3_item_browser(d, cr, "blah");
 
 	cairo_surface_flush(surface);
 
@@ -272,8 +324,10 @@ void maschine3_update_state(struct ctlra_dev_t *dev, void *ud)
 	struct maschine3_t *m = d->maschine3;
 
 	int i;
+	static uint32_t frame[VEGAS_BTN_COUNT];
 	for(i = 0; i < VEGAS_BTN_COUNT; i++)
-		ctlra_dev_light_set(dev, i, UINT32_MAX * d->buttons[i]);
+		frame[i] = UINT32_MAX * d->buttons[i];
+	ctlra_dev_lights_set_dense(dev, frame, VEGAS_BTN_COUNT);
 
 	if(!m) {
 		ctlra_dev_light_set(dev, 22, UINT32_MAX);
@@ -289,8 +343,7 @@ void maschine3_update_state(struct ctlra_dev_t *dev, void *ud)
 		break;
 	default:
 		ctlra_dev_light_set(dev, 22, 0);
-		for(i = 0; i < VEGAS_BTN_COUNT; i++)
-			ctlra_dev_light_set(dev, i, UINT32_MAX * d->buttons[i]);
+		ctlra_dev_lights_set_dense(dev, frame, VEGAS_BTN_COUNT);
 		break;
 	}
 }
@@ -412,6 +465,8 @@ void maschine3_pads(struct ctlra_dev_t* dev,
 		switch(e->type) {
 		case CTLRA_EVENT_BUTTON:
 			ctlra_dev_light_set(dev, e->button.id, UINT32_MAX);
+			if(e->button.id == MK3_BTN_BROWSER && e->button.pressed)
+				m->browser = !m->browser;
 			break;
 		case CTLRA_EVENT_ENCODER:
 			//printf("e %d, %f\n", e->encoder.id, e->encoder.delta_float);
@@ -459,6 +514,11 @@ int maschine3_screen_redraw_cb(struct ctlra_dev_t *dev,
 				struct ctlra_screen_zone_t *damage,
 				void *userdata)
 {
+	struct dummy_data *d = userdata;
+	if(d->maschine3 && d->maschine3->browser && screen_idx < NUM_SCREENS)
+		return maschine3_item_browser(d, dev, screen_idx, pixel_data,
+					      damage);
+
 	return maschine3_redraw_screen(screen_idx, pixel_data, bytes,
 				       damage, userdata);
 }